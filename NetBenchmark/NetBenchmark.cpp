@@ -0,0 +1,885 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <ctime>
+#include <iomanip>
+#include <olc_net.h>
+#include <net_transport.h>
+#include <net_shm.h>
+#include <net_client.h>
+#include <net_lagcomp.h>
+#include <net_player_store.h>
+#include <net_bandwidth.h>
+#include <net_trace.h>
+
+/*
+	Microbenchmarks for the NetCommon core. Nothing here touches a real socket -
+	connections talk over memory_transport (or shared memory on Linux), so the
+	numbers are the library's own cost and not the kernel's.
+
+		NetBenchmark [--json <file>] [--filter <text>] [--quick] [--port <n>]
+
+	--json		where to write the results, benchmark.json by default ("-" for stdout)
+	--filter	only run benchmarks whose name contains this
+	--quick		a tenth of the work, for a fast sanity check
+	--port		first of the localhost ports the socket benchmarks use, 60200 to 60206 by default
+
+	The latency and throughput benchmarks are the exception to "no sockets": they
+	ping (or stream to) a real server over TCP loopback - in the default mode, with
+	the low latency profile (net_latency.h), and over each socket backend
+	(net_uring.h) - and report the round trip time distribution or the rate. The
+	rpc ones time a login's worth of calls (net_rpc.h), one after another and all
+	in flight at once.
+
+	Keep the JSON from each release and diff them. Each benchmark runs a few times
+	and reports its best run, which is the least noisy number on a busy machine.
+*/
+
+enum class BenchMsg : uint32_t {
+	Payload
+};
+
+using olc::net::message;
+using olc::net::owned_message;
+using olc::net::connection;
+
+struct vec3 {
+	float x, y, z;
+};
+
+struct blob64 {
+	uint8_t data[64];
+};
+
+// Stops the compiler throwing away work whose result is never used
+static volatile uint64_t g_nSink = 0;
+
+
+struct bench_result {
+	std::string sName;
+	uint64_t nOps = 0;
+	uint64_t nBytes = 0;	// per run, 0 if it doesn't make sense
+	double dSeconds = 0.0;
+
+	// Percentiles, for benchmarks that measure each op on its own
+	std::vector<std::pair<std::string, double>> vPercentiles;
+
+	// Anything else worth keeping, as is
+	std::vector<std::pair<std::string, double>> vCounters;
+};
+
+class Bench {
+
+public:
+	Bench(const std::string& sFilter, bool bQuick) : m_sFilter(sFilter), m_nScale(bQuick ? 10 : 1) {
+
+	}
+
+	// How many ops a benchmark that would normally do n should do this time
+	uint64_t Ops(uint64_t n) const {
+		return std::max<uint64_t>(1, n / m_nScale);
+	}
+
+	bool Wanted(const std::string& sName) const {
+		return m_sFilter.empty() || sName.find(m_sFilter) != std::string::npos;
+	}
+
+	// f() does nOps operations and returns how long the part worth timing took
+	template <typename F>
+	void Run(const std::string& sName, uint64_t nOps, uint64_t nBytesPerOp, F&& f) {
+		if (!Wanted(sName)) return;
+
+		bench_result r;
+		r.sName = sName;
+		r.nOps = nOps;
+		r.nBytes = nOps * nBytesPerOp;
+		r.dSeconds = 1e30;
+		for (int i = 0; i < Repeats; i++) {
+			r.dSeconds = std::min(r.dSeconds, f());
+		}
+
+		std::cout << std::left << std::setw(36) << sName << std::right
+			<< std::setw(14) << std::fixed << std::setprecision(0) << double(r.nOps) / r.dSeconds << " ops/s"
+			<< std::setw(10) << std::setprecision(1) << r.dSeconds * 1e9 / double(r.nOps) << " ns/op";
+		if (r.nBytes) std::cout << std::setw(10) << std::setprecision(1) << double(r.nBytes) / r.dSeconds / 1e6 << " MB/s";
+		std::cout << "\n";
+
+		m_vResults.push_back(r);
+	}
+
+	// Each op timed separately (in seconds), reported as a distribution
+	void Distribution(const std::string& sName, std::vector<double> vSamples) {
+		if (vSamples.empty()) return;
+		std::sort(vSamples.begin(), vSamples.end());
+
+		bench_result r;
+		r.sName = sName;
+		r.nOps = vSamples.size();
+		for (double d : vSamples) r.dSeconds += d;
+
+		auto at = [&](double dFraction) { return vSamples[std::min(vSamples.size() - 1, size_t(dFraction * double(vSamples.size())))]; };
+		r.vPercentiles = { { "p50", at(0.50) }, { "p90", at(0.90) }, { "p99", at(0.99) }, { "max", vSamples.back() } };
+
+		std::cout << std::left << std::setw(36) << sName << std::right << std::fixed << std::setprecision(1);
+		for (auto& p : r.vPercentiles) std::cout << std::setw(6) << p.first << std::setw(10) << p.second * 1e6 << " us";
+		std::cout << "\n";
+
+		m_vResults.push_back(r);
+	}
+
+	// Adds a number to the benchmark that just ran, if it ran
+	void Counter(const std::string& sName, const std::string& sCounter, double dValue) {
+		if (m_vResults.empty() || m_vResults.back().sName != sName) return;
+		m_vResults.back().vCounters.push_back({ sCounter, dValue });
+		std::cout << std::setw(36) << "" << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(24) << sCounter << std::setw(14) << dValue << "\n";
+	}
+
+	std::string Json() const {
+		char sTime[32];
+		std::time_t t = std::time(nullptr);
+		std::strftime(sTime, sizeof(sTime), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&t));
+
+		std::ostringstream os;
+		os << std::setprecision(6);
+		os << "{\n";
+		os << "  \"timestamp\": \"" << sTime << "\",\n";
+#ifdef NDEBUG
+		os << "  \"build\": \"release\",\n";
+#else
+		os << "  \"build\": \"debug\",\n";
+#endif
+		os << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+		os << "  \"scale\": " << m_nScale << ",\n";
+		os << "  \"results\": [\n";
+		for (size_t i = 0; i < m_vResults.size(); i++) {
+			auto& r = m_vResults[i];
+			os << "    { \"name\": \"" << r.sName << "\""
+				<< ", \"ops\": " << r.nOps
+				<< ", \"seconds\": " << r.dSeconds
+				<< ", \"ops_per_sec\": " << double(r.nOps) / r.dSeconds
+				<< ", \"ns_per_op\": " << r.dSeconds * 1e9 / double(r.nOps);
+			if (r.nBytes) os << ", \"bytes_per_sec\": " << double(r.nBytes) / r.dSeconds;
+			for (auto& p : r.vPercentiles) os << ", \"" << p.first << "_ns\": " << p.second * 1e9;
+			for (auto& c : r.vCounters) os << ", \"" << c.first << "\": " << c.second;
+			os << " }" << (i + 1 < m_vResults.size() ? "," : "") << "\n";
+		}
+		os << "  ]\n}\n";
+		return os.str();
+	}
+
+private:
+	static constexpr int Repeats = 3;
+
+	std::string m_sFilter;
+	uint64_t m_nScale;
+	std::vector<bench_result> m_vResults;
+};
+
+static double SecondsSince(std::chrono::steady_clock::time_point tp) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - tp).count();
+}
+
+
+// operator<< and operator>> on message<T>, one type at a time
+template <typename DataType>
+static void BenchSerialize(Bench& bench, const std::string& sType) {
+	uint64_t nOps = bench.Ops(1000000);
+	message<BenchMsg> msg;
+	msg.body.reserve(size_t(nOps) * sizeof(DataType));
+
+	DataType value{};
+	bench.Run("serialize/push/" + sType, nOps, sizeof(DataType), [&]() {
+		msg.body.clear();
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) {
+			msg << value;
+		}
+		return SecondsSince(tp);
+	});
+
+	bench.Run("serialize/pop/" + sType, nOps, sizeof(DataType), [&]() {
+		msg.body.clear();
+		for (uint64_t i = 0; i < nOps; i++) msg << value;
+
+		uint64_t nSum = 0;
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) {
+			msg >> value;
+			nSum += reinterpret_cast<const uint8_t*>(&value)[0];
+		}
+		double d = SecondsSince(tp);
+		g_nSink = g_nSink + nSum;
+		return d;
+	});
+}
+
+
+// Many threads pushing, one popping - the shape of every server's incoming queue
+static void BenchQueue(Bench& bench, size_t nProducers) {
+	uint64_t nOps = bench.Ops(400000) / nProducers * nProducers;
+
+	message<BenchMsg> msg;
+	msg.header.id = BenchMsg::Payload;
+	msg << blob64{};
+
+	bench.Run("tsqueue/producers_" + std::to_string(nProducers), nOps, 0, [&]() {
+		olc::net::tsqueue<owned_message<BenchMsg>> q;
+		std::atomic<bool> bGo = false;
+		std::vector<std::thread> vThreads;
+		for (size_t p = 0; p < nProducers; p++) {
+			vThreads.emplace_back([&]() {
+				while (!bGo) std::this_thread::yield();
+				for (uint64_t i = 0; i < nOps / nProducers; i++) q.push_back({ nullptr, msg });
+			});
+		}
+
+		auto tp = std::chrono::steady_clock::now();
+		bGo = true;
+		uint64_t nPopped = 0;
+		while (nPopped < nOps) {
+			if (q.empty()) {
+				std::this_thread::yield();
+				continue;
+			}
+			g_nSink = g_nSink + q.pop_front().msg.body.size();
+			nPopped++;
+		}
+		double d = SecondsSince(tp);
+
+		for (auto& t : vThreads) t.join();
+		return d;
+	});
+}
+
+
+// What a connection does to every frame, minus the I/O: header and body laid out
+// back to back, then pulled apart again into a message
+static void BenchFraming(Bench& bench, size_t nBody) {
+	uint64_t nOps = bench.Ops(nBody > 1024 ? 50000 : 500000);
+	size_t nFrame = sizeof(olc::net::message_header<BenchMsg>) + nBody;
+
+	message<BenchMsg> msg;
+	msg.header.id = BenchMsg::Payload;
+	msg.body.resize(nBody);
+	msg.header.size = uint32_t(nBody);
+
+	std::vector<uint8_t> vWire;
+	vWire.reserve(size_t(nOps) * nFrame);
+
+	bench.Run("framing/encode/" + std::to_string(nBody), nOps, nFrame, [&]() {
+		vWire.clear();
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) {
+			auto pHeader = reinterpret_cast<const uint8_t*>(&msg.header);
+			vWire.insert(vWire.end(), pHeader, pHeader + sizeof(msg.header));
+			vWire.insert(vWire.end(), msg.body.begin(), msg.body.end());
+		}
+		return SecondsSince(tp);
+	});
+
+	bench.Run("framing/decode/" + std::to_string(nBody), nOps, nFrame, [&]() {
+		message<BenchMsg> msgIn;
+		uint64_t nSum = 0;
+		auto tp = std::chrono::steady_clock::now();
+		size_t nPos = 0;
+		for (uint64_t i = 0; i < nOps; i++) {
+			std::memcpy(&msgIn.header, vWire.data() + nPos, sizeof(msgIn.header));
+			nPos += sizeof(msgIn.header);
+			msgIn.body.resize(msgIn.header.size);
+			std::memcpy(msgIn.body.data(), vWire.data() + nPos, msgIn.header.size);
+			nPos += msgIn.header.size;
+			nSum += msgIn.body.size();
+		}
+		double d = SecondsSince(tp);
+		g_nSink = g_nSink + nSum;
+		return d;
+	});
+}
+
+
+// A client connection sending to a server connection through the whole state
+// machine - lanes, framing, sequence numbers, admission, queueing - over a
+// transport that costs next to nothing. Time runs until the last one is popped.
+static double LoopbackRun(std::unique_ptr<olc::net::byte_transport> pServerEnd, std::unique_ptr<olc::net::byte_transport> pClientEnd,
+	asio::io_context& context, size_t nBody, uint64_t nMessages) {
+
+	olc::net::tsqueue<owned_message<BenchMsg>> qServer;
+	olc::net::tsqueue<owned_message<BenchMsg>> qClient;
+	double d = 0.0;
+	{
+		auto server = std::make_shared<connection<BenchMsg>>(connection<BenchMsg>::owner::server, context, asio::ip::tcp::socket(context), qServer);
+		auto client = std::make_shared<connection<BenchMsg>>(connection<BenchMsg>::owner::client, context, asio::ip::tcp::socket(context), qClient);
+		server->SetTransport(std::move(pServerEnd));
+		server->ConnectToClient(1);
+		client->ConnectToServer(std::move(pClientEnd));
+
+		std::thread thrContext([&]() { context.run(); });
+
+		message<BenchMsg> msg;
+		msg.header.id = BenchMsg::Payload;
+		msg.body.resize(nBody);
+		msg.header.size = uint32_t(nBody);
+
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nMessages; i++) client->Send(msg);
+
+		uint64_t nReceived = 0;
+		while (nReceived < nMessages) {
+			if (qServer.empty()) {
+				std::this_thread::yield();
+				continue;
+			}
+			auto owned = qServer.pop_front();
+			if (owned.msg.header.control != olc::net::control_code::none) continue;
+			owned.remote->MessageConsumed();
+			nReceived++;
+		}
+		d = SecondsSince(tp);
+
+		client->Disconnect();
+		server->Disconnect();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		context.stop();
+		thrContext.join();
+	}
+	return d;
+}
+
+static void BenchLoopback(Bench& bench, size_t nBody) {
+	uint64_t nOps = bench.Ops(nBody > 1024 ? 20000 : 200000);
+	size_t nFrame = sizeof(olc::net::message_header<BenchMsg>) + nBody;
+
+	bench.Run("loopback/memory/" + std::to_string(nBody), nOps, nFrame, [&]() {
+		asio::io_context context;
+		auto ends = olc::net::memory_transport::CreatePair(context, context);
+		return LoopbackRun(std::move(ends.first), std::move(ends.second), context, nBody, nOps);
+	});
+
+#ifdef __linux__
+	bench.Run("loopback/shm/" + std::to_string(nBody), nOps, nFrame, [&]() {
+		asio::io_context context;
+		std::string sName = "/olc-bench-" + std::to_string(getpid());
+		auto pServerSegment = olc::net::shm_transport::CreateSegment(sName, 4 * 1024 * 1024);
+		auto pClientSegment = olc::net::shm_transport::AttachSegment(sName);
+		pServerSegment->Unlink();
+		return LoopbackRun(
+			std::make_unique<olc::net::shm_transport>(context, std::move(pServerSegment), true),
+			std::make_unique<olc::net::shm_transport>(context, std::move(pClientSegment), false),
+			context, nBody, nOps);
+	});
+#endif
+}
+
+
+// Messages far bigger than a chunk, cut into fragments on the way out and put
+// back together into one buffer on the way in
+static void BenchFragmented(Bench& bench, size_t nBody) {
+	uint64_t nOps = bench.Ops(std::max<uint64_t>(uint64_t(64 * 1024 * 1024) / nBody, 8));
+	size_t nFrame = sizeof(olc::net::message_header<BenchMsg>) + nBody;
+
+	bench.Run("loopback/fragmented/" + std::to_string(nBody), nOps, nFrame, [&]() {
+		asio::io_context context;
+		auto ends = olc::net::memory_transport::CreatePair(context, context);
+		return LoopbackRun(std::move(ends.first), std::move(ends.second), context, nBody, nOps);
+	});
+}
+
+
+// Recording a tick of a populated world, and checking one shot against a moment
+// between two of the recorded ticks
+static void BenchLagComp(Bench& bench, size_t nEntities) {
+	olc::net::entity_store store;
+	for (size_t i = 0; i < nEntities; i++) {
+		store.Create(float(i % 100) * 10.0f, float(i / 100) * 10.0f, 0.0f);
+	}
+
+	olc::net::lag_history history(64);
+	auto Step = [&](uint32_t nTick) {
+		for (size_t i = 0; i < store.size(); i++) store.px[i] += 0.5f;
+		history.Record(nTick, store);
+	};
+
+	uint64_t nOps = bench.Ops(2000);
+	bench.Run("lagcomp/record/" + std::to_string(nEntities), nOps, 0, [&]() {
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) Step(uint32_t(i));
+		return SecondsSince(tp);
+	});
+
+	for (uint32_t i = 0; i < 64; i++) Step(i);
+	std::vector<olc::net::rewound_entity> vHits;
+	nOps = bench.Ops(nEntities > 1000 ? 10000 : 100000);
+	bench.Run("lagcomp/rewind_shot/" + std::to_string(nEntities), nOps, 0, [&]() {
+		uint64_t nSum = 0;
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) {
+			olc::net::shot_ray ray{ 0.0f, float(i % 100) * 10.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1000.0f };
+			nSum += history.Rewind(40.5 + double(i % 16), ray, 1.0f, vHits);
+		}
+		double d = SecondsSince(tp);
+		g_nSink = g_nSink + nSum;
+		return d;
+	});
+}
+
+
+// What one trace zone costs when OLC_NET_TRACE is on - called directly, since the
+// zones in the library are compiled out of this build
+static void BenchTrace(Bench& bench) {
+	olc::net::trace_log& trace = olc::net::trace_log::Get();
+	uint64_t nOps = bench.Ops(5000000);
+	bench.Run("trace/zone", nOps, 0, [&]() {
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) {
+			auto tpStart = std::chrono::steady_clock::now();
+			trace.Zone("bench", "i", tpStart, std::chrono::steady_clock::now(), i);
+		}
+		return SecondsSince(tp);
+	});
+}
+
+
+// One client's share of a tick: accumulating priority over the whole world and
+// picking what fits into a 2KB budget
+static void BenchBandwidth(Bench& bench, size_t nEntities) {
+	olc::net::entity_store store;
+	for (size_t i = 0; i < nEntities; i++) {
+		store.Create(float(i % 100) * 10.0f, float(i / 100) * 10.0f, 0.0f);
+	}
+
+	olc::net::priority_accumulator priorities;
+	olc::net::viewer v{ 500.0f, 500.0f, 0.0f, 50.0f, 0.0f };
+	std::vector<olc::net::entity_handle> vSend;
+	auto Cost = [](olc::net::entity_handle h) { return size_t(24 + (h.index % 4) * 8); };
+
+	uint64_t nOps = bench.Ops(nEntities > 1000 ? 2000 : 20000);
+	bench.Run("bandwidth/select/" + std::to_string(nEntities), nOps, 0, [&]() {
+		uint64_t nSum = 0;
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) {
+			priorities.Accumulate(store, v);
+			nSum += priorities.Select(2048, Cost, vSend);
+		}
+		double d = SecondsSince(tp);
+		g_nSink = g_nSink + nSum;
+		return d;
+	});
+}
+
+
+// What the Update thread pays to save a player, how long until a whole batch of
+// them is on disk, and how quickly a restart reads the log back in
+static void BenchStore(Bench& bench, size_t nBody) {
+	std::string sPath = "benchmark_store.db";
+	std::vector<uint8_t> vState(nBody, 0x5A);
+	uint64_t nOps = bench.Ops(100000);
+
+	bench.Run("store/put/" + std::to_string(nBody), nOps, nBody, [&]() {
+		std::error_code ec;
+		std::filesystem::remove(sPath, ec);
+		olc::net::player_store store;
+		store.Open(sPath);
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) store.Put(i, vState);
+		return SecondsSince(tp);
+	});
+
+	bench.Run("store/put_flush/" + std::to_string(nBody), nOps, nBody, [&]() {
+		std::error_code ec;
+		std::filesystem::remove(sPath, ec);
+		olc::net::player_store store;
+		store.Open(sPath);
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < nOps; i++) store.Put(i, vState);
+		store.Flush();
+		return SecondsSince(tp);
+	});
+
+	if (bench.Wanted("store/recover/" + std::to_string(nBody))) {
+		std::error_code ec;
+		std::filesystem::remove(sPath, ec);
+		olc::net::player_store store;
+		store.Open(sPath);
+		for (uint64_t i = 0; i < nOps; i++) store.Put(i, vState);
+	}
+	bench.Run("store/recover/" + std::to_string(nBody), nOps, nBody + sizeof(olc::net::store_record_header), [&]() {
+		olc::net::player_store store;
+		auto tp = std::chrono::steady_clock::now();
+		store.Open(sPath);
+		return SecondsSince(tp);
+	});
+
+	std::error_code ec;
+	std::filesystem::remove(sPath, ec);
+}
+
+
+class EchoServer : public olc::net::server_interface<BenchMsg> {
+
+public:
+	EchoServer(uint16_t nPort) : olc::net::server_interface<BenchMsg>(nPort) {
+
+	}
+
+protected:
+	bool OnClientConnect(std::shared_ptr<connection<BenchMsg>> client) override {
+		return true;
+	}
+
+	void OnMessage(std::shared_ptr<connection<BenchMsg>> client, message<BenchMsg>& msg) override {
+		client->Send(msg);
+	}
+};
+
+// One ping at a time from a client to an echo server over TCP loopback, with the
+// server's game loop spinning on Update() the way SimpleServer's does
+static void BenchLatency(Bench& bench, const std::string& sMode, const olc::net::latency_profile& serverProfile,
+	const olc::net::latency_profile& clientProfile, uint16_t nPort, olc::net::socket_backend backend = olc::net::socket_backend::asio) {
+
+	std::string sName = "latency/tcp/" + sMode;
+	if (!bench.Wanted(sName)) return;
+
+	EchoServer server(nPort);
+	server.SetLatencyProfile(serverProfile);
+	server.SetSocketBackend(backend);
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]() {
+		while (bRunning) {
+			server.Update();
+			// Only matters when there are fewer cores than busy threads
+			if (!serverProfile.bSpin) std::this_thread::yield();
+		}
+	});
+
+	olc::net::client_interface<BenchMsg> client;
+	client.SetLatencyProfile(clientProfile);
+	client.SetSocketBackend(backend);
+	client.Connect("127.0.0.1", nPort);
+
+	auto ping = [&]() {
+		message<BenchMsg> msg;
+		msg.header.id = BenchMsg::Payload;
+		msg << uint64_t(0);
+
+		auto tp = std::chrono::steady_clock::now();
+		client.Send(msg);
+		while (client.Incoming().empty()) {
+			if (!clientProfile.bSpin) std::this_thread::yield();
+		}
+		client.Incoming().pop_front();
+		return SecondsSince(tp);
+	};
+
+	while (!client.IsConnected()) std::this_thread::yield();
+	for (int i = 0; i < 5; i++) ping();
+
+	std::vector<double> vSamples;
+	uint64_t nPings = bench.Ops(300);
+	for (uint64_t i = 0; i < nPings; i++) vSamples.push_back(ping());
+	bench.Distribution(sName, std::move(vSamples));
+
+	client.Disconnect();
+	bRunning = false;
+	thrUpdate.join();
+	server.Stop();
+}
+
+
+class CountServer : public olc::net::server_interface<BenchMsg> {
+
+public:
+	CountServer(uint16_t nPort) : olc::net::server_interface<BenchMsg>(nPort) {
+
+	}
+
+	std::atomic<uint64_t> nReceived = 0;
+
+protected:
+	bool OnClientConnect(std::shared_ptr<connection<BenchMsg>> client) override {
+		return true;
+	}
+
+	void OnMessage(std::shared_ptr<connection<BenchMsg>> client, message<BenchMsg>& msg) override {
+		nReceived++;
+	}
+};
+
+// Several clients streaming messages at a server over TCP loopback as fast as they
+// can, through either socket backend. With io_uring the server's syscalls are
+// counted too - for the asio side, run the same thing under "strace -c -f".
+static void BenchThroughput(Bench& bench, olc::net::socket_backend backend, size_t nClients, size_t nBody, uint16_t nPort) {
+	std::string sName = std::string("throughput/tcp/") + (backend == olc::net::socket_backend::uring ? "uring/" : "asio/")
+		+ std::to_string(nClients) + "x" + std::to_string(nBody);
+	if (!bench.Wanted(sName)) return;
+
+	CountServer server(nPort);
+	olc::net::latency_profile profile;
+	profile.bNoDelay = true;
+	server.SetLatencyProfile(profile);
+	server.SetSocketBackend(backend);
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]() {
+		while (bRunning) {
+			server.Update();
+			std::this_thread::yield();
+		}
+	});
+
+	std::vector<std::unique_ptr<olc::net::client_interface<BenchMsg>>> vClients;
+	for (size_t i = 0; i < nClients; i++) {
+		vClients.push_back(std::make_unique<olc::net::client_interface<BenchMsg>>());
+		vClients.back()->SetLatencyProfile(profile);
+		vClients.back()->SetSocketBackend(backend);
+		vClients.back()->Connect("127.0.0.1", nPort);
+	}
+	for (auto& c : vClients) {
+		while (!c->IsConnected()) std::this_thread::yield();
+	}
+
+	message<BenchMsg> msg;
+	msg.header.id = BenchMsg::Payload;
+	msg.body.resize(nBody);
+	msg.header.size = uint32_t(nBody);
+
+	uint64_t nPerClient = bench.Ops(nBody > 1024 ? 5000 : 50000) / nClients;
+	uint64_t nOps = nPerClient * nClients;
+	olc::net::uring_stats statsBefore{}, statsAfter{};
+	bench.Run(sName, nOps, sizeof(olc::net::message_header<BenchMsg>) + nBody, [&]() {
+		uint64_t nTarget = server.nReceived + nOps;
+		statsBefore = server.GetUringStats();
+		auto tp = std::chrono::steady_clock::now();
+
+		// Round robin, so every connection has something in flight at once
+		for (uint64_t i = 0; i < nPerClient; i++) {
+			for (auto& c : vClients) c->Send(msg);
+		}
+		while (server.nReceived < nTarget) std::this_thread::yield();
+
+		double d = SecondsSince(tp);
+		statsAfter = server.GetUringStats();
+		return d;
+	});
+
+	if (backend == olc::net::socket_backend::uring) {
+		double dOps = double(nOps);
+		bench.Counter(sName, "enters_per_kop", double(statsAfter.nEnters - statsBefore.nEnters) * 1000.0 / dOps);
+		bench.Counter(sName, "wakeups_per_kop", double(statsAfter.nWakeups - statsBefore.nWakeups) * 1000.0 / dOps);
+		bench.Counter(sName, "completions_per_wakeup",
+			double(statsAfter.nCompletions - statsBefore.nCompletions) / std::max(1.0, double(statsAfter.nWakeups - statsBefore.nWakeups)));
+	}
+
+	for (auto& c : vClients) c->Disconnect();
+	bRunning = false;
+	thrUpdate.join();
+	server.Stop();
+}
+
+
+// Many clients sharing a pool's threads, each pinging an echo server once per round,
+// with every reply picked up through the pool's one queue
+static void BenchPool(Bench& bench, size_t nClients, size_t nThreads, uint16_t nPort) {
+	std::string sName = "pool/echo/" + std::to_string(nClients) + "x" + std::to_string(nThreads);
+	if (!bench.Wanted(sName)) return;
+
+	EchoServer server(nPort);
+	olc::net::latency_profile profile;
+	profile.bNoDelay = true;
+	server.SetLatencyProfile(profile);
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]() {
+		while (bRunning) {
+			server.Update();
+			std::this_thread::yield();
+		}
+	});
+
+	olc::net::client_pool<BenchMsg> pool(nThreads, profile);
+	std::vector<std::unique_ptr<olc::net::client_interface<BenchMsg>>> vClients;
+	for (size_t i = 0; i < nClients; i++) {
+		vClients.push_back(std::make_unique<olc::net::client_interface<BenchMsg>>(pool));
+		vClients.back()->SetLatencyProfile(profile);
+		vClients.back()->Connect("127.0.0.1", nPort);
+	}
+	for (auto& c : vClients) {
+		while (!c->IsConnected()) std::this_thread::yield();
+	}
+
+	message<BenchMsg> msg;
+	msg.header.id = BenchMsg::Payload;
+	msg << uint64_t(0);
+
+	uint64_t nRounds = std::max<uint64_t>(bench.Ops(100000) / nClients, 1);
+	bench.Run(sName, nRounds * nClients, sizeof(olc::net::message_header<BenchMsg>) + msg.body.size(), [&]() {
+		auto tp = std::chrono::steady_clock::now();
+		for (uint64_t r = 0; r < nRounds; r++) {
+			for (auto& c : vClients) c->Send(msg);
+
+			size_t nReplies = 0;
+			while (nReplies < nClients) {
+				nReplies += pool.Drain([](olc::net::client_interface<BenchMsg>&, message<BenchMsg>&) {});
+				if (nReplies < nClients) std::this_thread::yield();
+			}
+		}
+		return SecondsSince(tp);
+	});
+
+	vClients.clear();
+	pool.Stop();
+	bRunning = false;
+	thrUpdate.join();
+	server.Stop();
+}
+
+
+// A login's worth of queries as RPC calls to a server that answers them straight
+// away - waiting on each reply before the next call, or sending them all and then
+// waiting. Serial costs a round trip per call, pipelined about one in all.
+static void BenchRpc(Bench& bench, bool bPipelined, size_t nCalls, uint16_t nPort) {
+	std::string sName = std::string("rpc/tcp/") + (bPipelined ? "pipelined/" : "serial/") + std::to_string(nCalls);
+	if (!bench.Wanted(sName)) return;
+
+	EchoServer server(nPort);
+	olc::net::latency_profile profile;
+	profile.bNoDelay = true;
+	server.SetLatencyProfile(profile);
+	server.SetRpcHandler(BenchMsg::Payload, [](std::shared_ptr<connection<BenchMsg>>, message<BenchMsg>& msg, olc::net::rpc_responder<BenchMsg> reply) {
+		reply.Send(msg);
+	});
+	server.Start();
+
+	std::atomic<bool> bRunning = true;
+	std::thread thrUpdate([&]() {
+		while (bRunning) {
+			server.Update();
+			std::this_thread::yield();
+		}
+	});
+
+	olc::net::client_interface<BenchMsg> client;
+	client.SetLatencyProfile(profile);
+	client.Connect("127.0.0.1", nPort);
+	while (!client.IsConnected()) std::this_thread::yield();
+
+	message<BenchMsg> msg;
+	msg.header.id = BenchMsg::Payload;
+	msg << uint64_t(0);
+
+	auto login = [&]() {
+		auto tp = std::chrono::steady_clock::now();
+		if (bPipelined) {
+			std::vector<std::future<message<BenchMsg>>> vReplies;
+			for (size_t i = 0; i < nCalls; i++) vReplies.push_back(client.Call(msg));
+			for (auto& f : vReplies) f.get();
+		}
+		else {
+			for (size_t i = 0; i < nCalls; i++) client.Call(msg).get();
+		}
+		return SecondsSince(tp);
+	};
+
+	for (int i = 0; i < 5; i++) login();
+
+	std::vector<double> vSamples;
+	uint64_t nLogins = bench.Ops(200);
+	for (uint64_t i = 0; i < nLogins; i++) vSamples.push_back(login());
+	bench.Distribution(sName, std::move(vSamples));
+
+	client.Disconnect();
+	bRunning = false;
+	thrUpdate.join();
+	server.Stop();
+}
+
+
+int main(int argc, char* argv[]) {
+	std::string sJson = "benchmark.json";
+	std::string sFilter;
+	bool bQuick = false;
+	uint16_t nPort = 60200;
+
+	for (int i = 1; i < argc; i++) {
+		std::string sArg = argv[i];
+		if (sArg == "--json" && i + 1 < argc) sJson = argv[++i];
+		else if (sArg == "--filter" && i + 1 < argc) sFilter = argv[++i];
+		else if (sArg == "--quick") bQuick = true;
+		else if (sArg == "--port" && i + 1 < argc) nPort = uint16_t(std::stoul(argv[++i]));
+		else {
+			std::cout << "Usage: NetBenchmark [--json <file>] [--filter <text>] [--quick] [--port <n>]\n";
+			return 1;
+		}
+	}
+
+	// Connection chatter would only get in the way of the numbers
+	olc::net::net_log::Get().SetLevel(olc::net::log_level::error);
+
+	Bench bench(sFilter, bQuick);
+
+	BenchSerialize<uint8_t>(bench, "uint8");
+	BenchSerialize<int32_t>(bench, "int32");
+	BenchSerialize<double>(bench, "double");
+	BenchSerialize<vec3>(bench, "vec3");
+	BenchSerialize<blob64>(bench, "blob64");
+
+	for (size_t n : { 1, 2, 4, 8 }) BenchQueue(bench, n);
+
+	for (size_t n : { 0, 16, 256, 4096 }) BenchFraming(bench, n);
+
+	for (size_t n : { 16, 256, 4096 }) BenchLoopback(bench, n);
+	for (size_t n : { 256 * 1024, 4 * 1024 * 1024 }) BenchFragmented(bench, n);
+
+	for (size_t n : { 1000, 10000 }) BenchLagComp(bench, n);
+
+	for (size_t n : { 1000, 10000 }) BenchBandwidth(bench, n);
+
+	BenchTrace(bench);
+
+	for (size_t n : { 256, 4096 }) BenchStore(bench, n);
+
+	// Server I/O, server game loop and client each get a core of their own if there
+	// are enough to go round - otherwise spinning would only fight over them
+	auto lowServer = olc::net::latency_profile::LowLatency(0, 1);
+	auto lowClient = olc::net::latency_profile::LowLatency(2, -1);
+	if (std::thread::hardware_concurrency() < 4) {
+		lowServer = lowClient = olc::net::latency_profile();
+		lowServer.bNoDelay = lowClient.bNoDelay = true;
+		lowServer.nBusyPollMicros = lowClient.nBusyPollMicros = 50;
+	}
+	BenchLatency(bench, "default", {}, {}, nPort);
+	BenchLatency(bench, "low_latency", lowServer, lowClient, uint16_t(nPort + 1));
+
+	// Same ping, and a bulk stream from several clients, over each socket backend
+	olc::net::latency_profile noDelay;
+	noDelay.bNoDelay = true;
+	BenchLatency(bench, "asio", noDelay, noDelay, uint16_t(nPort + 2));
+	BenchLatency(bench, "uring", noDelay, noDelay, uint16_t(nPort + 3), olc::net::socket_backend::uring);
+	for (auto backend : { olc::net::socket_backend::asio, olc::net::socket_backend::uring }) {
+		for (size_t nBody : { 64, 4096 }) BenchThroughput(bench, backend, 4, nBody, uint16_t(nPort + 4));
+	}
+
+	// A few thousand clients on a couple of threads, rather than a thread each
+	for (size_t nClients : { 64, 2048 }) BenchPool(bench, nClients, 2, uint16_t(nPort + 5));
+
+	// The same twenty queries, a round trip each or all at once
+	BenchRpc(bench, false, 20, uint16_t(nPort + 6));
+	BenchRpc(bench, true, 20, uint16_t(nPort + 6));
+
+	std::string s = bench.Json();
+	if (sJson == "-") {
+		std::cout << s;
+	}
+	else {
+		std::ofstream file(sJson);
+		file << s;
+		std::cout << "Results written to " << sJson << "\n";
+	}
+
+	return 0;
+}
@@ -0,0 +1,197 @@
+#include <iostream>
+#include <string>
+#include <olc_net.h>
+#include <net_client.h>
+#include <net_cluster.h>
+#include <net_entity_store.h>
+
+/*
+	A small cluster to try things out on one machine. The world is a line, zone n
+	covers x from 100 * (n - 1) up to 100 * n, and players walk along it - when one
+	crosses a boundary, their zone hands them to the next one.
+
+	Start each of these in its own terminal, in any order:
+
+		NetCluster zone 1 60101 2:60102
+		NetCluster zone 2 60102 1:60101
+		NetCluster gateway 60000 1:60101 2:60102
+		NetCluster client 60000
+
+	zone <id> <port> [peer id:port ...]
+	gateway <port> <zone id:port ...>
+	client <gateway port> [steps]
+*/
+
+enum class ClusterMsgTypes : uint32_t {
+	Move,		// client -> zone: float dx
+	Position	// zone -> client: zone id, float x
+};
+
+using olc::net::zone_id;
+using olc::net::player_id;
+
+static const float ZoneWidth = 100.0f;
+
+
+class ZoneServer : public olc::net::cluster_zone<ClusterMsgTypes> {
+
+public:
+	ZoneServer(zone_id nZone, uint16_t nPort) : olc::net::cluster_zone<ClusterMsgTypes>(nZone, nPort) {
+
+	}
+
+protected:
+	void OnPlayerJoin(player_id nPlayer) override {
+		std::cout << "[" << nPlayer << "] Joined\n";
+		m_mapEntities[nPlayer] = m_entities.Create(ZoneWidth * (GetZone() - 1));
+	}
+
+	void OnPlayerLeave(player_id nPlayer) override {
+		std::cout << "[" << nPlayer << "] Left\n";
+		m_entities.Destroy(m_mapEntities[nPlayer]);
+		m_mapEntities.erase(nPlayer);
+	}
+
+	void OnPlayerArrive(player_id nPlayer, zone_id nFrom, olc::net::message<ClusterMsgTypes>& msgState) override {
+		float x = 0.0f;
+		msgState >> x;
+		std::cout << "[" << nPlayer << "] Arrived from zone " << nFrom << " at x = " << x << "\n";
+		m_mapEntities[nPlayer] = m_entities.Create(x);
+	}
+
+	void OnPlayerMessage(player_id nPlayer, olc::net::message<ClusterMsgTypes>& msg) override {
+		switch (msg.header.id) {
+			case ClusterMsgTypes::Move: {
+				float dx = 0.0f;
+				msg >> dx;
+
+				auto h = m_mapEntities[nPlayer];
+				float& x = m_entities.px[m_entities.Dense(h)];
+				x += dx;
+
+				olc::net::message<ClusterMsgTypes> msgOut;
+				msgOut.header.id = ClusterMsgTypes::Position;
+				msgOut << x << GetZone();
+				SendToPlayer(nPlayer, msgOut);
+
+				// Walked off the edge of this zone - hand them to the next one along
+				zone_id nTarget = zone_id(x / ZoneWidth) + 1;
+				if (x >= 0.0f && nTarget != GetZone()) {
+					olc::net::message<ClusterMsgTypes> msgState;
+					msgState << x;
+					if (HandOff(nPlayer, nTarget, msgState)) {
+						std::cout << "[" << nPlayer << "] Handed to zone " << nTarget << "\n";
+						m_entities.Destroy(h);
+						m_mapEntities.erase(nPlayer);
+					}
+				}
+			}
+			break;
+
+			default:
+			break;
+		}
+	}
+
+private:
+	olc::net::entity_store m_entities;
+	std::unordered_map<player_id, olc::net::entity_handle> m_mapEntities;
+};
+
+
+class Client : public olc::net::client_interface<ClusterMsgTypes> {
+
+};
+
+
+// "2:60102" -> zone 2 on port 60102, on this machine
+static bool ParsePeer(const std::string& s, zone_id& nZone, uint16_t& nPort) {
+	size_t i = s.find(':');
+	if (i == std::string::npos) return false;
+	nZone = zone_id(std::stoul(s.substr(0, i)));
+	nPort = uint16_t(std::stoul(s.substr(i + 1)));
+	return true;
+}
+
+static void Usage() {
+	std::cout << "Usage: NetCluster zone <id> <port> [peer id:port ...]\n"
+		<< "       NetCluster gateway <port> <zone id:port ...>\n"
+		<< "       NetCluster client <gateway port> [steps]\n";
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		Usage();
+		return 1;
+	}
+
+	std::string sMode = argv[1];
+
+	if (sMode == "zone" && argc >= 4) {
+		ZoneServer server(zone_id(std::stoul(argv[2])), uint16_t(std::stoul(argv[3])));
+		for (int i = 4; i < argc; i++) {
+			zone_id nZone; uint16_t nPort;
+			if (ParsePeer(argv[i], nZone, nPort)) server.AddPeer(nZone, "127.0.0.1", nPort);
+		}
+		server.Start();
+
+		while (1) {
+			server.Update();
+			// Several of these share one machine, so don't spin flat out
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	else if (sMode == "gateway") {
+		olc::net::cluster_gateway<ClusterMsgTypes> server(uint16_t(std::stoul(argv[2])));
+		for (int i = 3; i < argc; i++) {
+			zone_id nZone; uint16_t nPort;
+			if (ParsePeer(argv[i], nZone, nPort)) server.AddZone(nZone, "127.0.0.1", nPort);
+		}
+		server.Start();
+
+		while (1) {
+			server.Update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	else if (sMode == "client") {
+		int nSteps = argc > 3 ? std::stoi(argv[3]) : 30;
+
+		Client c;
+		c.Connect("127.0.0.1", uint16_t(std::stoul(argv[2])));
+
+		int nReplies = 0;
+		zone_id nLastZone = 0;
+		auto tpNext = std::chrono::steady_clock::now();
+
+		for (int nSent = 0; nReplies < nSteps; ) {
+			if (nSent < nSteps && std::chrono::steady_clock::now() >= tpNext) {
+				olc::net::message<ClusterMsgTypes> msg;
+				msg.header.id = ClusterMsgTypes::Move;
+				msg << 10.0f;
+				c.Send(msg);
+				nSent++;
+				tpNext += std::chrono::milliseconds(50);
+			}
+
+			while (!c.Incoming().empty()) {
+				auto msg = c.Incoming().pop_front().msg;
+				if (msg.header.id == ClusterMsgTypes::Position) {
+					zone_id nZone = 0;
+					float x = 0.0f;
+					msg >> nZone >> x;
+					std::cout << "x = " << x << " (zone " << nZone << ")" << (nLastZone && nZone != nLastZone ? " <- handed off" : "") << "\n";
+					nLastZone = nZone;
+					nReplies++;
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	else {
+		Usage();
+		return 1;
+	}
+
+	return 0;
+}
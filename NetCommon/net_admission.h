@@ -0,0 +1,91 @@
+#pragma once
+#include "net_common.h"
+
+/*
+	Admission control - what a connection is prepared to accept from the other
+	end, checked before anything is allocated for it.
+
+	Size limits:	a header announcing a body bigger than the limit for its message
+					id closes the connection there and then. Nothing after a lying
+					header can be trusted, so there is no softer option.
+	Rate limits:	token buckets for messages and bytes. A client over its rate is
+					simply not read from until it is back under (TCP pushes back on
+					it), or is disconnected if bDisconnectOnRateLimit is set.
+	Queue share:	how many of one client's messages may sit in the server's incoming
+					queue at once. Past that its reads pause until Update() has worked
+					through half of them, so one flooding client can't starve the rest.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		struct admission_policy {
+			// Largest body accepted for a message id without its own limit. Fragmented
+			// messages are held to the limit as a whole.
+			uint32_t nDefaultMaxBody = 16 * 1024 * 1024;
+			std::vector<uint32_t> vMaxBody;		// indexed by message id, 0 = use the default
+
+			// 0 means unlimited
+			double dMessagesPerSecond = 0.0;
+			double dMessageBurst = 0.0;		// defaults to one second's worth
+			double dBytesPerSecond = 0.0;
+			double dByteBurst = 0.0;
+			bool bDisconnectOnRateLimit = false;
+
+			// 0 means unlimited
+			size_t nMaxQueuedIn = 4096;
+
+			// Bytes of fragmented messages a connection may be putting back together at
+			// once, across all its streams. Streamed messages (net_stream.h) don't count.
+			// 0 means unlimited.
+			size_t nMaxReassemblyBytes = 64 * 1024 * 1024;
+
+			template <typename T>
+			void SetMaxBody(T id, uint32_t nBytes) {
+				size_t i = size_t(id);
+				if (i >= vMaxBody.size()) vMaxBody.resize(i + 1, 0);
+				vMaxBody[i] = nBytes;
+			}
+
+			uint32_t MaxBody(size_t nId) const {
+				return nId < vMaxBody.size() && vMaxBody[nId] != 0 ? vMaxBody[nId] : nDefaultMaxBody;
+			}
+		};
+
+
+		// Refills continuously at dRate up to dBurst. Taking more than is there runs the
+		// bucket into debt, and the caller is told how long that takes to pay back.
+		class token_bucket {
+
+		public:
+			void Configure(double dRate, double dBurst) {
+				m_dRate = dRate;
+				m_dBurst = dBurst > 0.0 ? dBurst : dRate;
+				m_dTokens = m_dBurst;
+				m_tpLast = std::chrono::steady_clock::now();
+			}
+
+			bool Enabled() const {
+				return m_dRate > 0.0;
+			}
+
+			std::chrono::nanoseconds Take(double n, std::chrono::steady_clock::time_point tpNow) {
+				double dElapsed = std::chrono::duration<double>(tpNow - m_tpLast).count();
+				m_tpLast = tpNow;
+				m_dTokens = std::min(m_dBurst, m_dTokens + dElapsed * m_dRate) - n;
+
+				if (m_dTokens >= 0.0) return std::chrono::nanoseconds(0);
+				return std::chrono::nanoseconds(int64_t(-m_dTokens / m_dRate * 1e9));
+			}
+
+		private:
+			double m_dRate = 0.0;
+			double m_dBurst = 0.0;
+			double m_dTokens = 0.0;
+			std::chrono::steady_clock::time_point m_tpLast;
+		};
+
+	}
+
+}
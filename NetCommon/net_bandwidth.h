@@ -0,0 +1,281 @@
+#pragma once
+#include "net_common.h"
+#include "net_connection.h"
+#include "net_entity_store.h"
+
+/*
+	Bandwidth budget - how many bytes of entity updates each client gets this tick,
+	and which updates they should be.
+
+	Without it a tick sends whatever the handlers produce, and a client on a weak
+	link falls further and further behind, eventually seeing a world that is
+	seconds old. Instead each tick:
+
+		size_t nBudget = client.budget.Tick(*client.pConnection, tickLength);
+
+		client.priorities.Accumulate(store, viewer, fnRelevance);	// every tick
+		client.priorities.Select(nBudget, fnUpdateSize, vSend);		// highest first
+		for (auto h : vSend) ... serialise h and MessageClient() it ...
+
+	bandwidth_budget estimates what the link can take. It watches two counters the
+	connection keeps anyway - bytes handed to the socket, and bytes still queued
+	in the outbound lanes. While the queue stays short and the client is using
+	what it is given, the rate creeps up; as soon as the queue is longer than
+	maxQueueDelay worth of sending, the rate drops to a bit under what was actually
+	delivered, which drains the queue. Each tick may then send one tick's worth at
+	that rate, less anything already queued beyond that.
+
+	priority_accumulator picks what goes into those bytes. Every candidate update
+	gets some priority each tick - more for things that are close and relevant -
+	and keeps what it had until it is sent. Sending resets it to zero. So a far
+	away, unimportant entity still gets its turn eventually, it just waits longer,
+	and the client always gets the freshest state of whatever it receives rather
+	than a backlog of old states.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		struct bandwidth_options {
+			double dInitialRate = 64.0 * 1024.0;		// bytes per second to start with
+			double dMinRate = 4.0 * 1024.0;			// never throttle below this
+			double dMaxRate = 8.0 * 1024.0 * 1024.0;
+			double dIncrease = 32.0 * 1024.0;		// bytes per second gained per second while uncongested
+			double dDecrease = 0.8;					// fraction of the delivered rate kept when congested
+			std::chrono::milliseconds maxQueueDelay{ 100 };
+		};
+
+
+		class bandwidth_budget {
+
+		public:
+			bandwidth_budget(const bandwidth_options& options = {}) : m_options(options), m_dRate(options.dInitialRate) {
+			}
+
+			// Call once per tick with the connection's counters and how long the tick
+			// was. Returns how many bytes may be queued to the client this tick.
+			size_t Tick(uint64_t nBytesWritten, size_t nBacklog, std::chrono::nanoseconds tickLength) {
+				double dSeconds = std::max(std::chrono::duration<double>(tickLength).count(), 1e-6);
+
+				// What the socket actually took since last time
+				if (m_bStarted) {
+					double dDelivered = double(nBytesWritten - m_nLastWritten) / dSeconds;
+					m_dDelivered = m_dDelivered > 0.0 ? m_dDelivered + (dDelivered - m_dDelivered) / 8.0 : dDelivered;
+				}
+				m_bStarted = true;
+				m_nLastWritten = nBytesWritten;
+
+				double dMaxDelay = std::chrono::duration<double>(m_options.maxQueueDelay).count();
+
+				// How long the queue will take to drain at the rate it is really draining
+				double dDrain = m_dDelivered > 0.0 ? std::min(m_dDelivered, m_dRate) : m_dRate;
+				double dQueueDelay = double(nBacklog) / std::max(dDrain, m_options.dMinRate);
+				m_dSinceCut += dSeconds;
+
+				if (dQueueDelay > dMaxDelay) {
+					// Congested. Cut at most once per queue delay, the queue needs a moment to
+					// respond before it's worth judging again.
+					if (m_dSinceCut > dMaxDelay) {
+						double dBase = m_dDelivered > 0.0 ? std::min(m_dRate, m_dDelivered) : m_dRate;
+						m_dRate = dBase * m_options.dDecrease;
+						m_dSinceCut = 0.0;
+						m_nCuts++;
+					}
+				}
+				else if (dQueueDelay < dMaxDelay / 4.0 && m_dDelivered >= m_dRate * 0.75) {
+					// Queue is short and the client is actually using the rate it has - it
+					// might be able to take more. If it isn't (nothing much to send) a
+					// higher rate wouldn't tell us anything.
+					m_dRate += m_options.dIncrease * dSeconds;
+				}
+				m_dRate = std::clamp(m_dRate, m_options.dMinRate, m_options.dMaxRate);
+
+				// One tick's worth, less whatever is still queued beyond one tick's worth
+				double dTick = m_dRate * dSeconds;
+				double dOver = std::max(double(nBacklog) - dTick, 0.0);
+				return size_t(std::max(dTick - dOver, 0.0));
+			}
+
+			template <typename T>
+			size_t Tick(const connection<T>& c, std::chrono::nanoseconds tickLength) {
+				return Tick(c.BytesWritten(), c.OutboundBacklog(), tickLength);
+			}
+
+			// Current allowance in bytes per second
+			double Rate() const {
+				return m_dRate;
+			}
+
+			// Smoothed bytes per second the socket has actually taken
+			double Delivered() const {
+				return m_dDelivered;
+			}
+
+			// How many times congestion has cut the rate
+			uint64_t Cuts() const {
+				return m_nCuts;
+			}
+
+		private:
+			bandwidth_options m_options;
+			double m_dRate;
+			double m_dDelivered = 0.0;
+			double m_dSinceCut = 0.0;
+			uint64_t m_nLastWritten = 0;
+			uint64_t m_nCuts = 0;
+			bool m_bStarted = false;
+		};
+
+
+		// Where a client is looking from, for distance based priority
+		struct viewer {
+			float x = 0.0f, y = 0.0f, z = 0.0f;
+			float fNear = 10.0f;	// within this an update is worth full priority, beyond it priority falls off
+			float fRange = 0.0f;	// nothing beyond this is a candidate at all, 0 for no limit
+		};
+
+
+		class priority_accumulator {
+
+		public:
+			// Adds this tick's priority for an entity to what it has built up
+			void Accumulate(entity_handle h, float fPriority) {
+				size_t i = Lookup(h);
+				if (i != npos) {
+					m_vEntries[i].fPriority += fPriority;
+					return;
+				}
+
+				if (h.index >= m_vDenseOfIndex.size()) m_vDenseOfIndex.resize(h.index + 1, uint32_t(npos));
+				size_t nSlot = m_vDenseOfIndex[h.index];
+				if (nSlot < m_vEntries.size() && m_vEntries[nSlot].handle.index == h.index) {
+					// The index has been recycled and whatever had it before was never
+					// forgotten - the new entity takes over its entry rather than leaving
+					// one nothing can reach any more
+					m_vEntries[nSlot] = { h, fPriority };
+					return;
+				}
+				m_vDenseOfIndex[h.index] = uint32_t(m_vEntries.size());
+				m_vEntries.push_back({ h, fPriority });
+			}
+
+			// Every entity in the store as seen from v. fnRelevance(handle, nDense) returns
+			// a multiplier, 0 for "not a candidate this tick" (e.g. it hasn't changed).
+			template <typename F>
+			void Accumulate(const entity_store& store, const viewer& v, F&& fnRelevance) {
+				float fNear2 = std::max(v.fNear * v.fNear, 1e-6f);
+				float fRange2 = v.fRange > 0.0f ? v.fRange * v.fRange : std::numeric_limits<float>::max();
+				size_t n = store.size();
+				for (size_t i = 0; i < n; i++) {
+					float dx = store.px[i] - v.x, dy = store.py[i] - v.y, dz = store.pz[i] - v.z;
+					float d2 = dx * dx + dy * dy + dz * dz;
+					if (d2 > fRange2) continue;
+
+					entity_handle h = store.Handle(i);
+					float fRelevance = fnRelevance(h, i);
+					if (fRelevance <= 0.0f) continue;
+					Accumulate(h, fRelevance / (1.0f + d2 / fNear2));
+				}
+			}
+
+			void Accumulate(const entity_store& store, const viewer& v) {
+				Accumulate(store, v, [](entity_handle, size_t) { return 1.0f; });
+			}
+
+			// The entity is gone, or the client no longer needs it
+			void Forget(entity_handle h) {
+				size_t i = Lookup(h);
+				if (i == npos) return;
+				m_vDenseOfIndex[h.index] = uint32_t(npos);
+				if (i != m_vEntries.size() - 1) {
+					m_vEntries[i] = m_vEntries.back();
+					m_vDenseOfIndex[m_vEntries[i].handle.index] = uint32_t(i);
+				}
+				m_vEntries.pop_back();
+			}
+
+			float Priority(entity_handle h) const {
+				size_t i = Lookup(h);
+				return i == npos ? 0.0f : m_vEntries[i].fPriority;
+			}
+
+			size_t size() const {
+				return m_vEntries.size();
+			}
+
+			void clear() {
+				m_vEntries.clear();
+				m_vDenseOfIndex.clear();
+			}
+
+			// Fills vOut with the highest priority entities whose updates fit in nBudget
+			// bytes, fnCost(handle) giving each one's size. Those chosen start again from
+			// zero. Returns the bytes used.
+			template <typename F>
+			size_t Select(size_t nBudget, F&& fnCost, std::vector<entity_handle>& vOut) {
+				vOut.clear();
+				if (nBudget == 0 || m_vEntries.empty()) return 0;
+
+				// Priorities are copied next to the indices so sorting doesn't chase them
+				m_vOrder.resize(m_vEntries.size());
+				for (size_t i = 0; i < m_vOrder.size(); i++) m_vOrder[i] = { m_vEntries[i].fPriority, uint32_t(i) };
+				auto byPriority = [](const ranked& a, const ranked& b) { return a.fPriority > b.fPriority; };
+
+				// Usually only a small part of the candidates fit, so sort just enough of
+				// the front and only sort more if the budget isn't used up by then. Once what
+				// is left is smaller than anything seen so far, assume nothing else fits.
+				size_t nUsed = 0;
+				size_t nSorted = 0;
+				size_t nBatch = 64;
+				size_t nSmallest = nBudget;
+				while (nSorted < m_vOrder.size() && nBudget - nUsed >= nSmallest) {
+					size_t nEnd = std::min(nSorted + nBatch, m_vOrder.size());
+					std::nth_element(m_vOrder.begin() + nSorted, m_vOrder.begin() + nEnd - 1, m_vOrder.end(), byPriority);
+					std::sort(m_vOrder.begin() + nSorted, m_vOrder.begin() + nEnd, byPriority);
+					for (size_t k = nSorted; k < nEnd && nBudget - nUsed >= nSmallest; k++) {
+						auto& e = m_vEntries[m_vOrder[k].nEntry];
+						if (e.fPriority <= 0.0f) return nUsed;
+						size_t nCost = fnCost(e.handle);
+						nSmallest = std::min(nSmallest, nCost);
+						if (nUsed + nCost > nBudget) continue;	// something smaller might still fit
+						nUsed += nCost;
+						e.fPriority = 0.0f;
+						vOut.push_back(e.handle);
+					}
+					nSorted = nEnd;
+					nBatch *= 4;
+				}
+				return nUsed;
+			}
+
+		private:
+			static constexpr size_t npos = uint32_t(-1);
+
+			struct entry {
+				entity_handle handle;
+				float fPriority;
+			};
+
+			struct ranked {
+				float fPriority;
+				uint32_t nEntry;
+			};
+
+			size_t Lookup(entity_handle h) const {
+				if (h.index >= m_vDenseOfIndex.size()) return npos;
+				size_t i = m_vDenseOfIndex[h.index];
+				return i < m_vEntries.size() && m_vEntries[i].handle == h ? i : npos;
+			}
+
+		private:
+			std::vector<entry> m_vEntries;
+			std::vector<uint32_t> m_vDenseOfIndex;	// an index recycled under a new generation reuses its entry
+
+			// Scratch for Select()
+			std::vector<ranked> m_vOrder;
+		};
+
+	}
+
+}
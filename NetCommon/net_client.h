@@ -3,6 +3,18 @@
 #include "net_threadsafe_queue.h"
 #include "net_message.h"
 #include "net_threadsafe_queue.h"
+#include "net_connection.h"
+#include "net_session.h"
+#include "net_lanes.h"
+#include "net_admission.h"
+#include "net_shm.h"
+#include "net_log.h"
+#include "net_latency.h"
+#include "net_uring.h"
+#include "net_client_pool.h"
+#include "net_timesync.h"
+#include "net_stream.h"
+#include "net_rpc.h"
 
 namespace olc {
 
@@ -16,37 +28,218 @@ namespace olc {
 
 		public:
 
-			client_interface() : m_socket(m_context) {
+			client_interface() : m_pOwnContext(std::make_unique<asio::io_context>()), m_context(*m_pOwnContext),
+				m_socket(m_context), m_qMessagesIn(m_qOwnMessagesIn) {
 				// Initialize the socket with the io context, so it can do stuff
+				m_pRpc = std::make_shared<rpc_caller<T>>(m_context);
+			}
+
+			// Runs on one of the pool's contexts instead of a thread of its own, and what
+			// it receives goes into the pool's queue - see net_client_pool.h
+			client_interface(client_pool<T>& pool) : m_context(pool.NextContext()), m_pPool(&pool),
+				m_socket(m_context), m_qMessagesIn(pool.Incoming()) {
+				m_pRpc = std::make_shared<rpc_caller<T>>(m_context);
 			}
 
 			virtual ~client_interface() {
 				Disconnect();
+
+				if (m_pPool) {
+					for (auto pConnection : m_vRegistered) m_pPool->Unregister(pConnection, this);
+				}
 			}
 
 			bool Connect(const std::string& host, const uint16_t port) {
+				m_sHost = host;
+				m_nPort = port;
+				m_sShmName.clear();
+
 				try {
 					asio::ip::tcp::resolver resolver(m_context);		// resolver is used to take DNS names ( like www.example.com ) and convert it into actual ip addresses that can be connected to
 					
 					// resolver does some magic and gets the endpoints lol
 					asio::ip::tcp::resolver::results_type m_endpoints = resolver.resolve(host, std::to_string(port));
 
-					m_connection = std::make_unique<connection<T>>(
-						connection<T>::owner::client,
-						m_context,
-						asio::ip::tcp::socket(m_context),
-						m_qMessagesIn
-					);	// The client creates that connection object
-
-
+					CreateConnection();
+					if (m_pPool) {
+						m_pUring = m_pPool->UringFor(m_context);
+					}
+					else if (m_backend == socket_backend::uring && !m_pUring) {
+						m_pUring = uring_loop::Create(m_context, m_uringOptions);
+					}
+					if (m_pUring) m_connection->SetUring(m_pUring);
 					m_connection->ConnectToServer(m_endpoints);	// connect object to server
 
-					thrContext = std::thread([this]() {m_context.run();  });
+					if (!m_pPool) thrContext = std::thread([this]() { RunContext(m_context, m_latencyProfile); });
 				}
 				catch (std::exception& e) {
-					std::cerr << "Client Exception: " << e.what() << "\n";
+					LogError("Client Exception: {}", e.what());
 					return false;
 				}
+
+				return true;
+			}
+
+#ifdef __linux__
+			// Connect to a server on this machine through the shared memory segment it put up
+			// with AcceptSharedMemory(sName). Everything else behaves as over TCP.
+			bool ConnectSharedMemory(const std::string& sName) {
+				m_sShmName = sName;
+
+				// The server only puts a new segment up a few milliseconds after the last one
+				// was taken, so someone else attaching just before us is worth waiting out
+				auto pSegment = shm_transport::AttachSegment(sName);
+				for (int i = 0; !pSegment && i < 200; i++) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(5));
+					pSegment = shm_transport::AttachSegment(sName);
+				}
+				if (!pSegment) {
+					LogError("Client Exception: no shared memory server at {}", sName);
+					return false;
+				}
+
+				CreateConnection();
+				m_connection->ConnectToServer(std::make_unique<shm_transport>(m_context, std::move(pSegment), false));
+
+				if (!m_pPool) thrContext = std::thread([this]() { RunContext(m_context, m_latencyProfile); });
+				return true;
+			}
+#endif
+
+			// Connect again to the same server after the connection dropped. If the server
+			// has sessions enabled and we come back within its window, we keep our id and
+			// only receive the messages we missed rather than a full resync.
+			bool Reconnect() {
+				if (m_connection) {
+					// Let the old connection wind down completely before we drop it, its
+					// handlers still point at it
+					m_connection->Disconnect();
+					if (thrContext.joinable()) {
+						thrContext.join();
+					}
+					m_connectionPrevious = std::move(m_connection);
+				}
+
+				// Anything Send() posted after the drop still has to run against the old
+				// connection, which is what puts it into the replay ring. A pool's context
+				// is still running for everyone else, so there we wait for it instead.
+				if (m_pPool) {
+					client_pool<T>::Settle(m_context);
+				}
+				else {
+					m_context.restart();
+					m_context.poll();
+					m_context.restart();
+				}
+
+#ifdef __linux__
+				if (!m_sShmName.empty()) return ConnectSharedMemory(m_sShmName);
+#endif
+				return Connect(m_sHost, m_nPort);
+			}
+
+			// Weights and chunking of our outbound lanes, takes effect on the next Connect()
+			void SetLanePolicy(const lane_policy& policy) {
+				m_lanePolicy = policy;
+			}
+
+			// Pinning, spinning and socket options, see net_latency.h. Takes effect on the
+			// next Connect(). nUpdateCore is not used - pin your own game loop.
+			void SetLatencyProfile(const latency_profile& profile) {
+				m_latencyProfile = profile;
+			}
+
+			// Socket I/O through asio's reactor or io_uring, see net_uring.h. Takes effect on
+			// the next Connect(), falling back to asio if io_uring isn't available. Clients
+			// in a pool use the pool's setting instead.
+			void SetSocketBackend(socket_backend backend, const uring_options& options = {}) {
+				m_backend = backend;
+				m_uringOptions = options;
+			}
+
+			// How hard io_uring is working, all zeroes when it isn't in use
+			uring_stats GetUringStats() const {
+				return m_pUring ? m_pUring->Stats() : uring_stats{};
+			}
+
+			// Mostly the body size limits - a server is trusted not to flood us
+			void SetAdmissionPolicy(const admission_policy& policy) {
+				m_admissionPolicy = policy;
+			}
+
+			// Bounds on how much we keep around to replay to the server after a resume
+			void SetSessionPolicy(const session_policy& policy) {
+				m_sessionPolicy = policy;
+			}
+
+			// Messages with this id are handed to handler a piece at a time as they arrive,
+			// on the asio thread, instead of going into Incoming() - see net_stream.h.
+			// Takes effect on the next Connect().
+			void SetStreamHandler(T id, stream_handler<T> handler) {
+				auto pStreams = m_pStreams ? std::make_shared<stream_table<T>>(*m_pStreams) : std::make_shared<stream_table<T>>();
+				pStreams->Set(id, std::move(handler));
+				m_pStreams = std::move(pStreams);
+			}
+
+			// How often we sample the server's clock, see net_timesync.h. Takes effect on
+			// the next Connect().
+			void SetTimeSyncPolicy(const time_sync_policy& policy) {
+				m_syncPolicy = policy;
+			}
+
+			// The server's steady_clock right now, so the game can stamp input and place
+			// snapshots on the server's timeline. Before the first sample this is just our
+			// own clock; across a Reconnect() it carries on from the last estimate.
+			std::chrono::steady_clock::time_point ServerTimeNow() const {
+				return m_connection ? m_connection->PeerTimeNow() : std::chrono::steady_clock::now();
+			}
+
+			// Whether ServerTimeNow() has a sample from the current connection behind it
+			bool IsTimeSynced() const {
+				return m_connection && m_connection->TimeSyncSamples() > 0;
+			}
+
+			// Smoothed round trip time to the server, zero until the first sample
+			std::chrono::nanoseconds RoundTripTime() const {
+				return m_connection ? m_connection->RoundTripTime() : std::chrono::nanoseconds(0);
+			}
+
+			// How much consecutive round trips differ
+			std::chrono::nanoseconds Jitter() const {
+				return m_connection ? m_connection->Jitter() : std::chrono::nanoseconds(0);
+			}
+
+			// Sends msg as a call and hands back its reply without waiting for it, so
+			// as many calls as you like can be in flight at once - see net_rpc.h. The
+			// future throws rpc_error if there is no reply within timeout. Calls still
+			// outstanding across a Reconnect() are answered once the session resumes.
+			std::future<message<T>> Call(const message<T>& msg, std::chrono::milliseconds timeout = std::chrono::seconds(5), lane l = lane::realtime) {
+				auto pPromise = std::make_shared<std::promise<message<T>>>();
+				auto f = pPromise->get_future();
+				Call(msg, [pPromise](rpc_status status, message<T>& reply) {
+					if (status == rpc_status::ok) pPromise->set_value(std::move(reply));
+					else pPromise->set_exception(std::make_exception_ptr(rpc_error(status)));
+				}, timeout, l);
+				return f;
+			}
+
+			// Same, but fnDone is called with the reply instead, on the asio thread
+			void Call(const message<T>& msg, typename rpc_caller<T>::callback fnDone,
+				std::chrono::milliseconds timeout = std::chrono::seconds(5), lane l = lane::realtime) {
+				if (!IsConnected() && !(m_connection && m_connection->HasSession())) {
+					message<T> msgNone;
+					fnDone(rpc_status::disconnected, msgNone);
+					return;
+				}
+
+				message<T> msgCall = msg;
+				m_pRpc->Prepare(msgCall, timeout, std::move(fnDone));
+				m_connection->Send(msgCall, l);
+			}
+
+			// Calls sent that haven't had their reply yet
+			size_t OutstandingCalls() const {
+				return m_pRpc->Outstanding();
 			}
 
 			bool IsConnected() {
@@ -62,23 +255,39 @@ namespace olc {
 				if (IsConnected()) {
 					m_connection->Disconnect();
 				}
+				m_pRpc->FailAll(rpc_status::disconnected);
+
+				// A pool's context carries on for the other clients
+				if (m_pPool) return;
 
 				m_context.stop();
 
 				if (thrContext.joinable()) {
 					thrContext.join();
 				}
-				
+
+				// Let the close posted above run, so a transport holding on to a handler
+				// (and through it the connection) lets go of it
+				m_context.restart();
+				m_context.poll();
+
+				// The next Connect() starts a new one
+				if (m_pUring) {
+					m_pUring->Shutdown();
+					m_pUring.reset();
+				}
 			}
 
 			// Send message to server
-			void Send(const message<T>& msg)
+			void Send(const message<T>& msg, lane l = lane::realtime)
 			{
-				if (IsConnected())
-					m_connection->Send(msg);
+				// With a session, messages sent while dropped are kept for Reconnect()
+				if (IsConnected() || (m_connection && m_connection->HasSession()))
+					m_connection->Send(msg, l);
 			}
 
-			// Retrieve queue of messages
+			// Retrieve queue of messages - for a client in a pool that is the pool's queue,
+			// shared with every other client in it
 			tsqueue<owned_message<T>>& Incoming() {
 				return m_qMessagesIn;
 			}
@@ -86,8 +295,50 @@ namespace olc {
 
 
 		protected:
-			// asio context handles data transfer
-			asio::io_context m_context;
+			void CreateConnection() {
+				// Connect() again without a Disconnect() in between - on a shared context the
+				// old one is still open, and its handlers would keep it going
+				if (m_pPool && m_connection) {
+					m_connection->Disconnect();
+				}
+
+				m_connection = std::make_shared<connection<T>>(
+					connection<T>::owner::client,
+					m_context,
+					asio::ip::tcp::socket(m_context),
+					m_qMessagesIn
+				);	// The client creates that connection object
+
+				// So the pool can tell whose messages are whose. The old connection stays
+				// registered too, what it received before the drop is still ours.
+				if (m_pPool) {
+					m_pPool->Register(m_connection.get(), this);
+					m_vRegistered.push_back(m_connection.get());
+				}
+
+				m_connection->SetLanePolicy(m_lanePolicy);
+				m_connection->SetAdmissionPolicy(m_admissionPolicy);
+				m_connection->SetTimeSyncPolicy(m_syncPolicy);
+				m_connection->SetStreamHandlers(m_pStreams);
+				m_connection->SetRpcCaller(m_pRpc);
+				m_connection->SetLatencyProfile(m_latencyProfile);
+
+				// Keep recent sends around in case we drop and the server asks for them again
+				m_connection->SetReplayCapacity(m_sessionPolicy.nReplayMessages, m_sessionPolicy.nReplayBytes);
+
+				// Coming back from a drop - take the old session with us so the server can
+				// resume it instead of treating us as a brand new player
+				if (m_connectionPrevious) {
+					m_connection->InheritSession(*m_connectionPrevious);
+					m_connectionPrevious.reset();
+				}
+			}
+
+		protected:
+			// asio context handles data transfer - our own, unless we are in a pool
+			std::unique_ptr<asio::io_context> m_pOwnContext;
+			asio::io_context& m_context;
+			client_pool<T>* m_pPool = nullptr;
 			// we need a context because the client is going to be in charge of setting up the connection first
 			std::thread thrContext;
 
@@ -95,12 +346,30 @@ namespace olc {
 			asio::ip::tcp::socket m_socket;
 
 			// client has a single instnace of a connection object which handles data transfer
-			std::unique_ptr<connection<T>> m_connection;
+			std::shared_ptr<connection<T>> m_connection;
+
+			// Where we connected to, and the session we are trying to get back to
+			std::string m_sHost;
+			uint16_t m_nPort = 0;
+			std::string m_sShmName;		// set when connected over shared memory instead
+			std::shared_ptr<connection<T>> m_connectionPrevious;
+			std::vector<const connection<T>*> m_vRegistered;
+			session_policy m_sessionPolicy;
+			time_sync_policy m_syncPolicy;
+			std::shared_ptr<const stream_table<T>> m_pStreams;
+			std::shared_ptr<rpc_caller<T>> m_pRpc;		// outlives connections, so calls survive a Reconnect()
+			lane_policy m_lanePolicy;
+			admission_policy m_admissionPolicy;
+			latency_profile m_latencyProfile;
+			socket_backend m_backend = socket_backend::asio;
+			uring_options m_uringOptions;
+			std::shared_ptr<uring_loop> m_pUring;
 
 
 		private:
 			// This is the thread safe queue for incoming messages from the server 
-			tsqueue<owned_message<T>> m_qMessagesIn;
+			tsqueue<owned_message<T>> m_qOwnMessagesIn;
+			tsqueue<owned_message<T>>& m_qMessagesIn;
 
 
 
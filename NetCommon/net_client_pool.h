@@ -0,0 +1,213 @@
+#pragma once
+#include "net_common.h"
+#include "net_threadsafe_queue.h"
+#include "net_message.h"
+#include "net_connection.h"
+#include "net_latency.h"
+#include "net_uring.h"
+#include <future>
+
+/*
+	Client pool - many client_interfaces sharing a few threads.
+
+	A plain client_interface owns an io_context and a thread to run it, which is
+	fine for a game client and hopeless for a bot farm or a gateway with links to
+	thousands of zones. Clients made from a pool share its contexts instead, and
+	deliver what they receive into one queue:
+
+		client_pool<MsgTypes> pool(4);					// 4 contexts, a thread each
+		std::vector<std::unique_ptr<client_interface<MsgTypes>>> vBots;
+		for (...) vBots.push_back(std::make_unique<client_interface<MsgTypes>>(pool));
+
+		pool.Drain([](client_interface<MsgTypes>& bot, message<MsgTypes>& msg) {
+			...											// one lock for the whole batch
+		});
+
+	A connection's handlers assume nothing else of theirs runs at the same time, so
+	rather than one context run by several threads, each thread gets a context of
+	its own and clients are dealt out between them. A pool can also be put on a
+	context somebody else owns and runs - from one thread only, for the same reason.
+
+	The pool has to outlive its clients. Clients should be destroyed on the thread
+	that calls Drain(), or at least not while it is running.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		template <typename T>
+		class client_interface;
+
+
+		template <typename T>
+		class client_pool {
+
+		public:
+			// nThreads contexts of our own, each run by a thread of its own
+			client_pool(size_t nThreads = 1, const latency_profile& profile = {}) {
+				nThreads = std::max<size_t>(nThreads, 1);
+				for (size_t i = 0; i < nThreads; i++) {
+					m_vOwnContexts.push_back(std::make_unique<asio::io_context>());
+					m_vContexts.push_back(m_vOwnContexts.back().get());
+					m_vWork.emplace_back(asio::make_work_guard(*m_vContexts.back()));
+				}
+				m_vUring.resize(nThreads);
+
+				for (size_t i = 0; i < nThreads; i++) {
+					latency_profile p = profile;
+					if (p.nIoCore >= 0) p.nIoCore += int(i);
+					m_vThreads.emplace_back([this, i, p]() { RunContext(*m_vContexts[i], p); });
+				}
+			}
+
+			// On a context someone else owns and runs
+			client_pool(asio::io_context& context) {
+				m_vContexts.push_back(&context);
+				m_vUring.resize(1);
+			}
+
+			~client_pool() {
+				Stop();
+			}
+
+			client_pool(const client_pool&) = delete;
+			client_pool& operator=(const client_pool&) = delete;
+
+			// Stops our own threads. Clients still around after this can't do anything.
+			void Stop() {
+				for (auto& w : m_vWork) w.reset();
+				for (auto& c : m_vOwnContexts) c->stop();
+				for (auto& t : m_vThreads) {
+					if (t.joinable()) t.join();
+				}
+
+				std::scoped_lock lock(m_mux);
+				for (auto& p : m_vUring) {
+					if (p) p->Shutdown();
+				}
+			}
+
+			// io_uring for every client's socket, see net_uring.h. Set before any of them
+			// connect; falls back to asio if io_uring isn't available.
+			void SetSocketBackend(socket_backend backend, const uring_options& options = {}) {
+				m_backend = backend;
+				m_uringOptions = options;
+			}
+
+			// How hard io_uring is working, summed over every context
+			uring_stats GetUringStats() const {
+				std::scoped_lock lock(m_mux);
+				uring_stats total{};
+				for (auto& p : m_vUring) {
+					if (!p) continue;
+					uring_stats s = p->Stats();
+					total.nEnters += s.nEnters;
+					total.nSubmitted += s.nSubmitted;
+					total.nCompletions += s.nCompletions;
+					total.nWakeups += s.nWakeups;
+				}
+				return total;
+			}
+
+			// Everything every client received, remote says which connection it came in on
+			tsqueue<owned_message<T>>& Incoming() {
+				return m_qMessagesIn;
+			}
+
+			// Hands everything queued so far to f(client, msg), taking it from the queue in
+			// one go. Messages for clients that have since been destroyed are dropped.
+			template <typename F>
+			size_t Drain(F&& f) {
+				m_qMessagesIn.pop_all(m_deqBatch);
+
+				// Who each one is for, looked up under one lock for the whole batch
+				m_vBatchOwners.clear();
+				{
+					std::scoped_lock lock(m_mux);
+					for (auto& owned : m_deqBatch) {
+						auto it = m_mapOwners.find(owned.remote.get());
+						m_vBatchOwners.push_back(it != m_mapOwners.end() ? it->second : nullptr);
+					}
+				}
+
+				size_t nDelivered = 0;
+				for (size_t i = 0; i < m_deqBatch.size(); i++) {
+					if (!m_vBatchOwners[i]) continue;
+					f(*m_vBatchOwners[i], m_deqBatch[i].msg);
+					nDelivered++;
+				}
+				m_deqBatch.clear();
+				return nDelivered;
+			}
+
+			size_t Threads() const {
+				return m_vContexts.size();
+			}
+
+		protected:
+			friend class client_interface<T>;
+
+			// Clients are dealt out between the contexts in turn
+			asio::io_context& NextContext() {
+				return *m_vContexts[m_nNext.fetch_add(1, std::memory_order_relaxed) % m_vContexts.size()];
+			}
+
+			// The io_uring loop for a context, made the first time anyone on it asks
+			std::shared_ptr<uring_loop> UringFor(asio::io_context& context) {
+				if (m_backend != socket_backend::uring) return nullptr;
+
+				std::scoped_lock lock(m_mux);
+				for (size_t i = 0; i < m_vContexts.size(); i++) {
+					if (m_vContexts[i] != &context) continue;
+					if (!m_vUring[i]) m_vUring[i] = uring_loop::Create(context, m_uringOptions);
+					return m_vUring[i];
+				}
+				return nullptr;
+			}
+
+			void Register(const connection<T>* pConnection, client_interface<T>* pClient) {
+				std::scoped_lock lock(m_mux);
+				m_mapOwners[pConnection] = pClient;
+			}
+
+			void Unregister(const connection<T>* pConnection, client_interface<T>* pClient) {
+				std::scoped_lock lock(m_mux);
+				// The address may have been reused by someone else's connection by now
+				auto it = m_mapOwners.find(pConnection);
+				if (it != m_mapOwners.end() && it->second == pClient) m_mapOwners.erase(it);
+			}
+
+			// Waits until everything already posted to the context has run, and whatever
+			// that posted in turn. Never from the context's own thread.
+			static void Settle(asio::io_context& context, int nRounds = 2) {
+				for (int i = 0; i < nRounds; i++) {
+					std::promise<void> done;
+					auto f = done.get_future();
+					asio::post(context, [&done]() { done.set_value(); });
+					f.wait();
+				}
+			}
+
+		private:
+			std::vector<std::unique_ptr<asio::io_context>> m_vOwnContexts;
+			std::vector<asio::io_context*> m_vContexts;
+			std::vector<asio::executor_work_guard<asio::io_context::executor_type>> m_vWork;
+			std::vector<std::thread> m_vThreads;
+			std::atomic<size_t> m_nNext = 0;
+
+			socket_backend m_backend = socket_backend::asio;
+			uring_options m_uringOptions;
+			std::vector<std::shared_ptr<uring_loop>> m_vUring;
+
+			mutable std::mutex m_mux;
+			std::unordered_map<const connection<T>*, client_interface<T>*> m_mapOwners;
+
+			tsqueue<owned_message<T>> m_qMessagesIn;
+			std::deque<owned_message<T>> m_deqBatch;	// scratch for Drain()
+			std::vector<client_interface<T>*> m_vBatchOwners;
+		};
+
+	}
+
+}
@@ -0,0 +1,691 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+#include "net_connection.h"
+#include "net_server.h"
+
+/*
+	Cluster mode - one world spread over several server processes.
+
+	Gateway:	what clients connect to. It keeps every client socket (and its
+				session) for as long as the client is around, and relays that
+				client's messages to whichever zone currently owns the player.
+	Zone:		runs the game for part of the world. It never sees a client socket,
+				only players - ids the gateway gave it - and talks to them, to the
+				gateway and to its peer zones over ordinary connection<T> links.
+
+	Every message between cluster nodes is a control_code::cluster frame with an
+	envelope on the end of its body: the player (or zone) it concerns, then the
+	operation. The game's own message id and body go through untouched.
+
+	Handing a player from zone A to zone B, without the client noticing:
+		1. A sends the player's state to B (handoff), tells the gateway the player is
+		   B's now (route), and leaves a tombstone behind.
+		2. The gateway sends everything from the player to B from then on, and
+		   answers A with a fence - nothing more for that player will reach A.
+		3. Anything that was already on its way to A is forwarded to B by the
+		   tombstone. When the fence arrives A tells B (handoff_end).
+		4. Until handoff_end, B holds back what came straight from the gateway, and
+		   what its game sends the player. A's messages were all ahead of its route,
+		   so both directions stay in the order they were sent.
+
+	The handoff and the gateway's first frames for the player reach B over
+	different links, so the gateway's may well get there first. B holds frames for
+	a player it has never heard of until the handoff arrives - up to a limit, and
+	for a while (SetArrivalWait), after which they are dropped.
+
+	B may pass the player on again before its own handoff has settled. What it was
+	holding back then goes along behind whatever A still has to send.
+
+	Links between nodes are retried every second until they connect, so processes
+	can be started in any order. Anything sent over a link that is down is lost.
+
+	Only connections a node marks as links (connection::SetClusterLink) may carry
+	cluster frames, and they are held to the same admission limits as anything
+	else. A zone takes every connection as a would-be link, but drops it unless
+	its first frame is a hello with the cluster's key (SetClusterKey) - set the
+	same key on every node if the zones' ports can be reached from outside.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		using zone_id = uint32_t;
+		using player_id = uint32_t;
+
+		enum class cluster_op : uint8_t {
+			hello,			// first frame on a link - who is on the other end (zone id, 0 = gateway)
+			join,			// gateway -> zone: a new player starts here
+			leave,			// gateway -> zone: the player has gone
+			forward,		// a player's message, either way
+			zone,			// zone -> zone: a message for the other zone itself
+			handoff,		// zone -> zone: a player is yours now, body is their state
+			route,			// zone -> gateway: send this player's messages to another zone
+			fence,			// gateway -> zone: no more of this player's messages are coming
+			handoff_end		// zone -> zone: everything the old zone had for the player has been sent
+		};
+
+		// Envelope on the end of the body, so popping it leaves the game's message as it was
+		template <typename T>
+		void ClusterWrap(message<T>& msg, cluster_op op, uint32_t nTarget) {
+			msg << nTarget << op;
+		}
+
+		// False if there isn't an envelope there to pop
+		template <typename T>
+		bool ClusterUnwrap(message<T>& msg, cluster_op& op, uint32_t& nTarget) {
+			if (msg.body.size() < sizeof(op) + sizeof(nTarget)) return false;
+			msg >> op >> nTarget;
+			msg.header.control = control_code::none;
+			msg.header.size = uint32_t(msg.body.size());
+			return true;
+		}
+
+
+		// An outgoing link from one cluster node to another, reconnecting as needed.
+		// Frames it receives land in the owner's incoming queue like any other.
+		template <typename T>
+		class cluster_link {
+
+		public:
+			cluster_link(asio::io_context& context, tsqueue<owned_message<T>>& qIn, const std::string& sHost, uint16_t nPort, zone_id nSelf, uint64_t nKey)
+				: m_context(context), m_qMessagesIn(qIn), m_sHost(sHost), m_nPort(nPort), m_nSelf(nSelf), m_nKey(nKey) {
+			}
+
+			~cluster_link() {
+				if (m_connection) m_connection->Disconnect();
+			}
+
+			// Called regularly from the owner's Update thread
+			void Maintain() {
+				if (m_connection && (m_connection->IsConnected() || m_connection->IsConnecting())) return;
+
+				auto tpNow = std::chrono::steady_clock::now();
+				if (tpNow < m_tpRetry) return;
+				m_tpRetry = tpNow + std::chrono::seconds(1);
+
+				if (m_connection) {
+					// Let whatever is left of the old one run on the context before it goes
+					asio::post(m_context, [pOld = std::move(m_connection)]() {});
+				}
+
+				try {
+					asio::ip::tcp::resolver resolver(m_context);
+					auto endpoints = resolver.resolve(m_sHost, std::to_string(m_nPort));
+
+					m_connection = std::make_shared<connection<T>>(
+						connection<T>::owner::client, m_context, asio::ip::tcp::socket(m_context), m_qMessagesIn);
+					m_connection->SetClusterLink(true);
+					m_connection->ConnectToServer(endpoints);
+
+					// Queued until the connect completes, so it is always the first frame
+					message<T> msg;
+					msg << m_nKey;
+					ClusterWrap(msg, cluster_op::hello, m_nSelf);
+					m_connection->SendControl(msg, control_code::cluster);
+				}
+				catch (std::exception& e) {
+					LogError("[CLUSTER] Link Exception: {}", e.what());
+					m_connection.reset();
+				}
+			}
+
+			bool Send(const message<T>& msg, cluster_op op, uint32_t nTarget) {
+				if (!m_connection) return false;
+
+				message<T> msgOut = msg;
+				ClusterWrap(msgOut, op, nTarget);
+				return m_connection->SendControl(msgOut, control_code::cluster);
+			}
+
+			bool IsConnected() const {
+				return m_connection && m_connection->IsConnected();
+			}
+
+			bool Is(const std::shared_ptr<connection<T>>& conn) const {
+				return conn && conn == m_connection;
+			}
+
+		private:
+			asio::io_context& m_context;
+			tsqueue<owned_message<T>>& m_qMessagesIn;
+			std::string m_sHost;
+			uint16_t m_nPort = 0;
+			zone_id m_nSelf = 0;
+			uint64_t m_nKey = 0;
+
+			std::shared_ptr<connection<T>> m_connection;
+			std::chrono::steady_clock::time_point m_tpRetry;
+		};
+
+
+		template <typename T>
+		class cluster_gateway : public server_interface<T> {
+
+		public:
+			// Sessions are always on, so clients can drop and come back to the same
+			// player, and so new clients are approved on the Update thread
+			cluster_gateway(uint16_t port, const session_policy& policy = {}) : server_interface<T>(port) {
+				this->EnableSessions(policy);
+			}
+
+			// The links use the base class's context, so it has to stop before they go
+			virtual ~cluster_gateway() {
+				this->Stop();
+			}
+
+			// Shared by every node in the cluster, see above. Set it before adding zones.
+			void SetClusterKey(uint64_t nKey) {
+				m_nKey = nKey;
+			}
+
+			// The first zone added is where new players start, unless PickZone says otherwise
+			void AddZone(zone_id nZone, const std::string& sHost, uint16_t nPort) {
+				m_mapZones[nZone] = std::make_unique<cluster_link<T>>(this->m_asioContext, this->m_qMessagesIn, sHost, nPort, 0, m_nKey);
+				if (m_nDefaultZone == 0) m_nDefaultZone = nZone;
+			}
+
+		protected:
+			virtual zone_id PickZone(std::shared_ptr<connection<T>> client) {
+				return m_nDefaultZone;
+			}
+
+			bool OnClientConnect(std::shared_ptr<connection<T>> client) override {
+				return !m_mapZones.empty();
+			}
+
+			void OnClientApproved(std::shared_ptr<connection<T>> client) override {
+				zone_id nZone = PickZone(client);
+				m_mapPlayers[client->GetID()] = { client, nZone };
+				SendToZone(nZone, message<T>(), cluster_op::join, client->GetID());
+			}
+
+			void OnClientDisconnect(std::shared_ptr<connection<T>> client) override {
+				if (!client) return;
+
+				auto it = m_mapPlayers.find(client->GetID());
+				if (it == m_mapPlayers.end() || it->second.client != client) return;
+
+				SendToZone(it->second.nZone, message<T>(), cluster_op::leave, it->first);
+				m_mapPlayers.erase(it);
+			}
+
+			void OnMessage(std::shared_ptr<connection<T>> client, message<T>& msg) override {
+				if (msg.header.control != control_code::cluster) {
+					// From a player - pass it on to their zone
+					auto it = m_mapPlayers.find(client->GetID());
+					if (it != m_mapPlayers.end() && it->second.client == client) {
+						SendToZone(it->second.nZone, msg, cluster_op::forward, it->first);
+					}
+					return;
+				}
+
+				zone_id nFrom = ZoneOf(client);
+				if (nFrom == 0) return;
+
+				cluster_op op;
+				uint32_t nTarget = 0;
+				if (!ClusterUnwrap(msg, op, nTarget)) {
+					LogWarn("[CLUSTER] Malformed Frame From Zone {}", nFrom);
+					return;
+				}
+
+				switch (op) {
+				case cluster_op::forward: {
+					// From a zone, for a player
+					auto it = m_mapPlayers.find(nTarget);
+					if (it != m_mapPlayers.end()) this->MessageClient(it->second.client, msg);
+				}
+				break;
+
+				case cluster_op::route: {
+					zone_id nZone = 0;
+					if (msg.body.size() != sizeof(nZone)) {
+						LogWarn("[CLUSTER] Malformed Route From Zone {}", nFrom);
+						break;
+					}
+					msg >> nZone;
+					auto it = m_mapPlayers.find(nTarget);
+					if (it != m_mapPlayers.end() && m_mapZones.count(nZone)) {
+						it->second.nZone = nZone;
+					}
+					// Everything we sent the old zone for this player is ahead of this
+					SendToZone(nFrom, message<T>(), cluster_op::fence, nTarget);
+				}
+				break;
+
+				default:
+					break;
+				}
+			}
+
+			void OnUpdate() override {
+				for (auto& [nZone, link] : m_mapZones) link->Maintain();
+			}
+
+		private:
+			void SendToZone(zone_id nZone, const message<T>& msg, cluster_op op, uint32_t nTarget) {
+				auto it = m_mapZones.find(nZone);
+				if (it != m_mapZones.end()) it->second->Send(msg, op, nTarget);
+			}
+
+			zone_id ZoneOf(const std::shared_ptr<connection<T>>& conn) const {
+				for (auto& [nZone, link] : m_mapZones) {
+					if (link->Is(conn)) return nZone;
+				}
+				return 0;
+			}
+
+		private:
+			struct player {
+				std::shared_ptr<connection<T>> client;
+				zone_id nZone = 0;
+			};
+
+			std::unordered_map<zone_id, std::unique_ptr<cluster_link<T>>> m_mapZones;
+			std::unordered_map<player_id, player> m_mapPlayers;
+			zone_id m_nDefaultZone = 0;
+			uint64_t m_nKey = 0;
+		};
+
+
+		template <typename T>
+		class cluster_zone : public server_interface<T> {
+
+		public:
+			// Zone ids start at 1, 0 is the gateway
+			cluster_zone(zone_id nZone, uint16_t port) : server_interface<T>(port), m_nZone(nZone) {
+			}
+
+			virtual ~cluster_zone() {
+				this->Stop();
+			}
+
+			// Shared by every node in the cluster, see above. Set it before adding peers.
+			void SetClusterKey(uint64_t nKey) {
+				m_nKey = nKey;
+			}
+
+			// How long frames from the gateway for a player we don't know yet are held,
+			// waiting for their handoff to turn up, and how many of them per player
+			void SetArrivalWait(std::chrono::milliseconds wait, size_t nMaxFrames) {
+				m_arrivalWait = wait;
+				m_nMaxEarlyFrames = nMaxFrames;
+			}
+
+			void AddPeer(zone_id nZone, const std::string& sHost, uint16_t nPort) {
+				m_mapPeers[nZone] = std::make_unique<cluster_link<T>>(this->m_asioContext, this->m_qMessagesIn, sHost, nPort, m_nZone, m_nKey);
+			}
+
+			zone_id GetZone() const {
+				return m_nZone;
+			}
+
+			bool IsLocal(player_id nPlayer) const {
+				return m_mapPlayers.count(nPlayer) != 0;
+			}
+
+			// Reaches the player wherever they are - the gateway holds every client
+			bool SendToPlayer(player_id nPlayer, const message<T>& msg) {
+				if (!m_pGateway) return false;
+
+				message<T> msgOut = msg;
+				ClusterWrap(msgOut, cluster_op::forward, nPlayer);
+				SendToGateway(nPlayer, std::move(msgOut));
+				return true;
+			}
+
+			// Arrives in the other zone's OnZoneMessage
+			bool SendToZone(zone_id nZone, const message<T>& msg) {
+				auto it = m_mapPeers.find(nZone);
+				return it != m_mapPeers.end() && it->second->Send(msg, cluster_op::zone, m_nZone);
+			}
+
+			// Moves a local player to another zone, along with whatever state the game put
+			// in msgState. The player stops being local straight away. Fails, leaving the
+			// player here, if that zone or the gateway can't be reached right now.
+			bool HandOff(player_id nPlayer, zone_id nZone, const message<T>& msgState) {
+				auto it = m_mapPlayers.find(nPlayer);
+				auto itPeer = m_mapPeers.find(nZone);
+				if (it == m_mapPlayers.end() || itPeer == m_mapPeers.end() || !itPeer->second->IsConnected()) return false;
+				if (!m_pGateway || !m_pGateway->IsConnected()) return false;
+
+				itPeer->second->Send(msgState, cluster_op::handoff, nPlayer);
+
+				message<T> msgRoute;
+				msgRoute << nZone;
+				ClusterWrap(msgRoute, cluster_op::route, nPlayer);
+				SendToGateway(nPlayer, std::move(msgRoute));
+
+				auto& t = m_mapTombstones[nPlayer];
+				t.nZone = nZone;
+				t.bFenced = false;
+				t.bUpstreamDone = !it->second.bArriving;
+				t.vHeld = std::move(it->second.vHeld);
+				t.vHeldOut = std::move(it->second.vHeldOut);
+
+				m_mapPlayers.erase(it);
+				return true;
+			}
+
+		protected:
+			virtual void OnPlayerJoin(player_id nPlayer) {
+
+			}
+
+			virtual void OnPlayerLeave(player_id nPlayer) {
+
+			}
+
+			virtual void OnPlayerMessage(player_id nPlayer, message<T>& msg) {
+
+			}
+
+			// A player handed over from another zone, with the state it sent along
+			virtual void OnPlayerArrive(player_id nPlayer, zone_id nFrom, message<T>& msgState) {
+
+			}
+
+			virtual void OnZoneMessage(zone_id nFrom, message<T>& msg) {
+
+			}
+
+		protected:
+			// Anything connecting to a zone had better be another cluster node - it gets
+			// to prove it with its hello
+			bool OnClientConnect(std::shared_ptr<connection<T>> client) override {
+				client->SetClusterLink(true);
+				return true;
+			}
+
+			void OnClientDisconnect(std::shared_ptr<connection<T>> client) override {
+				if (client == m_pGateway) m_pGateway.reset();
+				m_mapLinks.erase(client.get());
+			}
+
+			void OnMessage(std::shared_ptr<connection<T>> client, message<T>& msg) override {
+				if (!client) return;
+
+				cluster_op op;
+				uint32_t nTarget = 0;
+				auto itLink = m_mapLinks.find(client.get());
+				if (msg.header.control != control_code::cluster || !ClusterUnwrap(msg, op, nTarget)) {
+					DropNode(client, "Malformed Frame");
+					return;
+				}
+
+				if (itLink == m_mapLinks.end()) {
+					uint64_t nKey = 0;
+					if (op != cluster_op::hello || msg.body.size() != sizeof(nKey)) {
+						DropNode(client, "No Hello");
+						return;
+					}
+					msg >> nKey;
+					if (nKey != m_nKey) {
+						DropNode(client, "Wrong Cluster Key");
+						return;
+					}
+
+					if (nTarget == 0) m_pGateway = client;
+					m_mapLinks[client.get()] = nTarget;
+					return;
+				}
+
+				if (itLink->second == 0) {
+					OnGatewayFrame(op, nTarget, msg);
+				}
+				else {
+					OnPeerFrame(itLink->second, op, nTarget, msg);
+				}
+			}
+
+			void OnUpdate() override {
+				for (auto& [nZone, link] : m_mapPeers) link->Maintain();
+
+				// Frames whose player never arrived
+				auto tpNow = std::chrono::steady_clock::now();
+				for (auto it = m_mapEarly.begin(); it != m_mapEarly.end();) {
+					if (tpNow - it->second.tpFirst > m_arrivalWait) {
+						LogWarn("[CLUSTER] Player {} Never Arrived, Dropping {} Frames", it->first, it->second.vHeld.size());
+						it = m_mapEarly.erase(it);
+					}
+					else {
+						++it;
+					}
+				}
+			}
+
+		private:
+			void DropNode(const std::shared_ptr<connection<T>>& client, const char* sWhy) {
+				LogWarn("[CLUSTER] {} From [{}], Dropping It", sWhy, client->GetID());
+				client->Disconnect(disconnect_reason::policy_violation);
+			}
+
+			void OnGatewayFrame(cluster_op op, player_id nPlayer, message<T>& msg) {
+				switch (op) {
+				case cluster_op::join:
+					m_mapPlayers[nPlayer] = {};
+					OnPlayerJoin(nPlayer);
+					break;
+
+				case cluster_op::forward:
+				case cluster_op::leave: {
+					auto it = m_mapPlayers.find(nPlayer);
+					if (it != m_mapPlayers.end()) {
+						if (it->second.bArriving) {
+							// Newer than anything the old zone still has to send us
+							it->second.vHeld.push_back({ op, std::move(msg) });
+						}
+						else {
+							Deliver(nPlayer, op, msg);
+						}
+					}
+					else {
+						auto itTomb = m_mapTombstones.find(nPlayer);
+						if (itTomb != m_mapTombstones.end() && !itTomb->second.bUpstreamDone) {
+							// Still newer than what the zone before us has to send
+							itTomb->second.vHeld.push_back({ op, std::move(msg) });
+						}
+						else if (itTomb != m_mapTombstones.end()) {
+							ForwardToTombstone(nPlayer, op, msg);
+						}
+						else {
+							// The gateway has switched to us, but the handoff is still on its way
+							HoldEarly(nPlayer, op, msg);
+						}
+					}
+				}
+				break;
+
+				case cluster_op::fence: {
+					auto it = m_mapTombstones.find(nPlayer);
+					if (it != m_mapTombstones.end()) {
+						it->second.bFenced = true;
+						FinishTombstone(nPlayer);
+					}
+				}
+				break;
+
+				default:
+					break;
+				}
+			}
+
+			void OnPeerFrame(zone_id nFrom, cluster_op op, uint32_t nTarget, message<T>& msg) {
+				switch (op) {
+				case cluster_op::zone:
+					OnZoneMessage(nFrom, msg);
+					break;
+
+				case cluster_op::handoff: {
+					auto& p = m_mapPlayers[nTarget];
+					p.bArriving = true;
+					p.vHeld.clear();
+
+					// Whatever the gateway sent ahead of the handoff waits like the rest
+					auto itEarly = m_mapEarly.find(nTarget);
+					if (itEarly != m_mapEarly.end()) {
+						p.vHeld = std::move(itEarly->second.vHeld);
+						m_mapEarly.erase(itEarly);
+					}
+					OnPlayerArrive(nTarget, nFrom, msg);
+				}
+				break;
+
+				case cluster_op::forward:
+				case cluster_op::leave:
+					// Left over from before the handoff, so older than anything held back
+					if (m_mapPlayers.count(nTarget)) {
+						Deliver(nTarget, op, msg);
+					}
+					else {
+						ForwardToTombstone(nTarget, op, msg);
+					}
+					break;
+
+				case cluster_op::handoff_end: {
+					auto it = m_mapPlayers.find(nTarget);
+					if (it == m_mapPlayers.end()) {
+						// Already passed on - what we held goes after them
+						auto itTomb = m_mapTombstones.find(nTarget);
+						if (itTomb == m_mapTombstones.end()) break;
+
+						auto vHeld = std::move(itTomb->second.vHeld);
+						itTomb->second.bUpstreamDone = true;
+						FlushToGateway(itTomb->second.vHeldOut);
+						for (auto& held : vHeld) ForwardToTombstone(nTarget, held.op, held.msg);
+						FinishTombstone(nTarget);
+						break;
+					}
+
+					it->second.bArriving = false;
+					FlushToGateway(it->second.vHeldOut);
+					auto vHeld = std::move(it->second.vHeld);
+					for (auto& held : vHeld) {
+						// a held leave, or the game handing the player on again, ends it here
+						if (!m_mapPlayers.count(nTarget)) {
+							ForwardToTombstone(nTarget, held.op, held.msg);
+						}
+						else {
+							Deliver(nTarget, held.op, held.msg);
+						}
+					}
+				}
+				break;
+
+				default:
+					break;
+				}
+			}
+
+			void Deliver(player_id nPlayer, cluster_op op, message<T>& msg) {
+				if (op == cluster_op::leave) {
+					m_mapPlayers.erase(nPlayer);
+					OnPlayerLeave(nPlayer);
+				}
+				else {
+					OnPlayerMessage(nPlayer, msg);
+				}
+			}
+
+			// Anything about a player that is still arriving waits until the zone before us
+			// has finished with them, so the gateway hears from it first
+			void SendToGateway(player_id nPlayer, message<T>&& msg) {
+				auto it = m_mapPlayers.find(nPlayer);
+				if (it != m_mapPlayers.end() && it->second.bArriving) {
+					it->second.vHeldOut.push_back(std::move(msg));
+					return;
+				}
+
+				auto itTomb = m_mapTombstones.find(nPlayer);
+				if (itTomb != m_mapTombstones.end() && !itTomb->second.bUpstreamDone) {
+					itTomb->second.vHeldOut.push_back(std::move(msg));
+					return;
+				}
+
+				if (m_pGateway) m_pGateway->SendControl(msg, control_code::cluster);
+			}
+
+			void FlushToGateway(std::vector<message<T>>& vHeldOut) {
+				for (auto& msg : vHeldOut) {
+					if (m_pGateway) m_pGateway->SendControl(msg, control_code::cluster);
+				}
+				vHeldOut.clear();
+			}
+
+			void HoldEarly(player_id nPlayer, cluster_op op, message<T>& msg) {
+				auto [it, bNew] = m_mapEarly.try_emplace(nPlayer);
+				if (bNew) it->second.tpFirst = std::chrono::steady_clock::now();
+
+				// A leave is always kept, or the player would never go once they arrive
+				if (op != cluster_op::leave && it->second.vHeld.size() >= m_nMaxEarlyFrames) {
+					LogWarn("[CLUSTER] Too Much For Player {} Before Their Handoff, Dropping", nPlayer);
+					return;
+				}
+				it->second.vHeld.push_back({ op, std::move(msg) });
+			}
+
+			// The player has moved on from here - pass it after them
+			void ForwardToTombstone(player_id nPlayer, cluster_op op, const message<T>& msg) {
+				auto it = m_mapTombstones.find(nPlayer);
+				if (it == m_mapTombstones.end()) return;
+
+				auto itPeer = m_mapPeers.find(it->second.nZone);
+				if (itPeer != m_mapPeers.end()) itPeer->second->Send(msg, op, nPlayer);
+			}
+
+			// Once the gateway has fenced us and the zone before us (if any) is done, the
+			// next zone has everything and can stop holding back
+			void FinishTombstone(player_id nPlayer) {
+				auto it = m_mapTombstones.find(nPlayer);
+				if (it == m_mapTombstones.end() || !it->second.bFenced || !it->second.bUpstreamDone) return;
+
+				auto itPeer = m_mapPeers.find(it->second.nZone);
+				if (itPeer != m_mapPeers.end()) itPeer->second->Send(message<T>(), cluster_op::handoff_end, nPlayer);
+				m_mapTombstones.erase(it);
+			}
+
+		private:
+			struct held_frame {
+				cluster_op op;
+				message<T> msg;
+			};
+
+			struct player {
+				// Handed to us, but the old zone may still have some of their messages
+				bool bArriving = false;
+				std::vector<held_frame> vHeld;
+				std::vector<message<T>> vHeldOut;	// ready wrapped, for the gateway
+			};
+
+			// From the gateway, for a player whose handoff hasn't reached us yet
+			struct early {
+				std::chrono::steady_clock::time_point tpFirst;
+				std::vector<held_frame> vHeld;
+			};
+
+			struct tombstone {
+				zone_id nZone = 0;				// where the player went
+				bool bFenced = false;			// the gateway has stopped sending to us
+				bool bUpstreamDone = true;		// the zone before us has finished too
+				std::vector<held_frame> vHeld;	// from the gateway, waiting on the zone before us
+				std::vector<message<T>> vHeldOut;
+			};
+
+			zone_id m_nZone = 0;
+			uint64_t m_nKey = 0;
+			std::shared_ptr<connection<T>> m_pGateway;
+			std::unordered_map<connection<T>*, zone_id> m_mapLinks;		// inbound links, by who said hello on them
+			std::unordered_map<zone_id, std::unique_ptr<cluster_link<T>>> m_mapPeers;
+
+			std::unordered_map<player_id, player> m_mapPlayers;
+			std::unordered_map<player_id, tombstone> m_mapTombstones;
+			std::unordered_map<player_id, early> m_mapEarly;
+			std::chrono::milliseconds m_arrivalWait{ 5000 };
+			size_t m_nMaxEarlyFrames = 1024;
+		};
+
+	}
+
+}
@@ -11,6 +11,13 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <unordered_map>
+#include <set>
+#include <random>
+#include <functional>
+#include <array>
 
 #ifndef _WIN32
 #define _WIN32_WINNT 0x0A00
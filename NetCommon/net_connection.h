@@ -2,6 +2,19 @@
 #include "net_common.h"
 #include "net_threadsafe_queue.h"
 #include "net_message.h"
+#include "net_session.h"
+#include "net_lanes.h"
+#include "net_recorder.h"
+#include "net_stats.h"
+#include "net_admission.h"
+#include "net_transport.h"
+#include "net_log.h"
+#include "net_latency.h"
+#include "net_uring.h"
+#include "net_trace.h"
+#include "net_timesync.h"
+#include "net_stream.h"
+#include "net_rpc.h"
 
 namespace olc {
 
@@ -20,7 +33,7 @@ namespace olc {
 			};
 
 			connection(owner parent, asio::io_context& asioContext, asio::ip::tcp::socket socket, tsqueue<owned_message<T>>& qIn):
-				m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn)
+				m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn), m_timerRead(asioContext), m_timerSync(asioContext)
 			{
 			
 				m_nOwnerType = parent;	// he initializes this here, just to mentally remind hismelf this this may not be 100% necessary 
@@ -30,9 +43,10 @@ namespace olc {
 			void ConnectToClient(uint32_t uid = 0) {
 				// Only relevant if owner is the server
 				if (m_nOwnerType == owner::server) {
-					if (m_socket.is_open()) {
+					if (IsConnected()) {
 						id = uid;
 						ReadHeader();
+						StartTimeSync();
 					}
 				}
 			}
@@ -41,6 +55,236 @@ namespace olc {
 				return id;
 			}
 
+			// Server side, sessions enabled: start reading, but hold off until the client
+			// tells us (session_open) whether it is new or picking up an old session
+			void AwaitSession() {
+				if (m_nOwnerType == owner::server) {
+					if (IsConnected()) {
+						m_bAwaitingSession = true;
+						ReadHeader();
+					}
+				}
+			}
+
+			// Server side: the client is new, so give it an id and a token it can come back with
+			void StartSession(uint32_t uid, uint64_t nToken, const session_policy& policy) {
+				id = uid;
+				m_nSessionToken = nToken;
+				m_ringReplay.SetCapacity(policy.nReplayMessages, policy.nReplayBytes);
+
+				asio::post(m_asioContext, [this, pSelf = this->shared_from_this()]() {
+					m_bAwaitingSession = false;
+					SendSessionHello(false);
+					ReadHeader();
+					StartTimeSync();
+				});
+			}
+
+			// Server side: a fresh transport has turned up with our token. Swap its socket in
+			// for our dead one and replay whatever the client missed. Our id, our place in
+			// the server's containers and anything the game holds against us stay the same.
+			void ResumeSession(std::shared_ptr<connection<T>> transport, uint32_t nPeerLastReceived) {
+				m_bResumePending = true;
+
+				asio::post(m_asioContext, [this, pSelf = this->shared_from_this(), transport, nPeerLastReceived]() {
+					// Anything still in flight on the old socket is abandoned - bumping the epoch
+					// makes their completion handlers ignore themselves
+					m_nEpoch++;
+					CloseTransport();
+					m_socket = std::move(transport->m_socket);
+					m_pTransport = std::move(transport->m_pTransport);
+
+					CountStat(stat::queued_out, -int64_t(m_qMessagesOut.count()));
+					m_qMessagesOut.clear();
+					m_bSyncAnswerQueued = false;
+					ResetStreams();
+					m_timerRead.cancel();
+					m_bReadParked = false;
+					m_bCloseCounted = false;
+					m_nTimedSeq = 0;		// replayed frames would make a nonsense sample
+					m_bWriting = false;
+					m_bAwaitingSession = false;
+
+					SendSessionHello(true);
+					for (auto& e : m_ringReplay.CollectAfter(nPeerLastReceived)) {
+						QueueFrame(lane(e.nLane), { MakeHeader(*e.msg, e.seq), e.msg });
+					}
+
+					m_bResumePending = false;
+					ReadHeader();
+					StartTimeSync();
+				});
+			}
+
+			// Client side: carry an old connection's session over to this one, so that
+			// connecting with it asks the server to resume rather than start again
+			void InheritSession(connection<T>& old) {
+				id = old.id;
+				m_nSessionToken = old.m_nSessionToken;
+				m_seqIn = old.m_seqIn;
+				m_nSeqOut = old.m_nSeqOut;
+				m_ringReplay.Adopt(old.m_ringReplay);
+
+				// Same server, same clock - keep telling its time until we have fresh samples
+				m_nClockOffset.store(old.m_nClockOffset.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				m_nPeerTimeFloor.store(old.m_nPeerTimeFloor.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+
+			// A connection with no socket at all, used to stand in for a recorded client
+			// during a replay. Whatever is sent to it goes nowhere.
+			void Detach(uint32_t uid) {
+				id = uid;
+				m_bDetached = true;
+			}
+
+			bool IsDetached() const {
+				return m_bDetached;
+			}
+
+			// Only links between cluster nodes may carry control_code::cluster frames (see
+			// net_cluster.h) - anyone else sending one is dropped. Set before it connects.
+			void SetClusterLink(bool bClusterLink) {
+				m_bClusterLink = bClusterLink;
+			}
+
+			bool IsClusterLink() const {
+				return m_bClusterLink;
+			}
+
+			// Every complete inbound message is offered to the recorder, which ignores it
+			// unless a recording is running
+			void SetRecorder(traffic_recorder<T>* pRecorder) {
+				m_pRecorder = pRecorder;
+			}
+
+			// Where this connection counts its traffic, see net_stats.h
+			void SetStats(net_stats* pStats) {
+				m_pStats = pStats;
+			}
+
+			void SetLanePolicy(const lane_policy& policy) {
+				m_qMessagesOut.SetPolicy(policy);
+			}
+
+			// Message ids delivered a piece at a time instead of whole, see net_stream.h
+			void SetStreamHandlers(std::shared_ptr<const stream_table<T>> pStreams) {
+				m_pStreams = std::move(pStreams);
+			}
+
+			// Where answers to our calls go instead of the incoming queue, see net_rpc.h
+			void SetRpcCaller(std::shared_ptr<rpc_caller<T>> pRpc) {
+				m_pRpc = std::move(pRpc);
+			}
+
+			// How often we sample the other end's clock, see net_timesync.h. Set it before
+			// the connection starts.
+			void SetTimeSyncPolicy(const time_sync_policy& policy) {
+				m_syncPolicy = policy;
+				m_clock = clock_estimator(policy.nWindow);
+			}
+
+			// Smoothed round trip time to the other end, zero until the first sample. Taken
+			// from time sync samples, which don't count the time the other end took to
+			// answer. With time sync off it falls back to acks, which include however long
+			// the other end sits on a message before it next sends anything. Any thread.
+			std::chrono::nanoseconds RoundTripTime() const {
+				return std::chrono::nanoseconds(m_nSmoothedRtt.load(std::memory_order_relaxed));
+			}
+
+			// Bytes queued to go out and not yet handed to the socket. Any thread.
+			size_t OutboundBacklog() const {
+				return m_qMessagesOut.bytes();
+			}
+
+			// Bytes handed to the socket since the connection was made. Any thread.
+			uint64_t BytesWritten() const {
+				return m_nBytesWritten.load(std::memory_order_relaxed);
+			}
+
+			// How much the samples wander around RoundTripTime()
+			std::chrono::nanoseconds RoundTripVariation() const {
+				return std::chrono::nanoseconds(m_nRttVariation.load(std::memory_order_relaxed));
+			}
+
+			// How much consecutive time sync round trips differ (RFC 3550 jitter). Any thread.
+			std::chrono::nanoseconds Jitter() const {
+				return std::chrono::nanoseconds(m_nJitter.load(std::memory_order_relaxed));
+			}
+
+			// The other end's steady_clock minus ours, as of the best recent sample. Any thread.
+			std::chrono::nanoseconds ClockOffset() const {
+				return std::chrono::nanoseconds(m_nClockOffset.load(std::memory_order_relaxed));
+			}
+
+			// Time sync answers received on this connection. Any thread.
+			uint64_t TimeSyncSamples() const {
+				return m_nSyncSamples.load(std::memory_order_relaxed);
+			}
+
+			// What the other end's steady_clock reads right now. Never goes backwards, even
+			// when a new sample moves the offset back a little. Any thread.
+			std::chrono::steady_clock::time_point PeerTimeNow() const {
+				int64_t nNow = SteadyNow() + m_nClockOffset.load(std::memory_order_relaxed);
+				int64_t nFloor = m_nPeerTimeFloor.load(std::memory_order_relaxed);
+				while (nNow > nFloor && !m_nPeerTimeFloor.compare_exchange_weak(nFloor, nNow, std::memory_order_relaxed)) {}
+				return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(std::max(nNow, nFloor)));
+			}
+
+			// Limits on what the other end may send us, see net_admission.h. Set it before
+			// the connection starts reading.
+			void SetAdmissionPolicy(const admission_policy& policy) {
+				m_admission = policy;
+				m_bucketMessages.Configure(policy.dMessagesPerSecond, policy.dMessageBurst);
+				m_bucketBytes.Configure(policy.dBytesPerSecond, policy.dByteBurst);
+			}
+
+			// Client side - socket options to apply once connected, see net_latency.h
+			void SetLatencyProfile(const latency_profile& profile) {
+				m_latency = profile;
+			}
+
+			// Client side - once connected, hand the socket to this loop, see net_uring.h
+			void SetUring(std::shared_ptr<uring_loop> pUring) {
+				m_pUring = std::move(pUring);
+			}
+
+			// The server has taken one of our messages off its incoming queue. Called from
+			// the Update thread, it picks reading back up once we are under our share again.
+			void MessageConsumed() {
+				if (QueueShare() == 0) return;
+
+				if (--m_nQueuedIn <= int64_t(QueueShare() / 2) && m_bQueuePaused.exchange(false)) {
+					asio::post(m_asioContext, [this, pSelf = this->shared_from_this()]() { ResumeReading(); });
+				}
+			}
+
+			void SetReplayCapacity(size_t nMaxMessages, size_t nMaxBytes) {
+				m_ringReplay.SetCapacity(nMaxMessages, nMaxBytes);
+				m_seqIn.SetWindow(nMaxMessages);
+			}
+
+			uint64_t GetSessionToken() const {
+				return m_nSessionToken;
+			}
+
+			// A connection with a session outlives its socket - messages sent to it while
+			// it is dropped are kept in the replay ring until it resumes or expires
+			bool HasSession() const {
+				return m_nSessionToken != 0;
+			}
+
+			void EndSession() {
+				m_nSessionToken = 0;
+			}
+
+			bool ResumePending() const {
+				return m_bResumePending;
+			}
+
+			bool CanResumeFrom(uint32_t nPeerLastReceived) {
+				return m_ringReplay.CanResumeFrom(nPeerLastReceived);
+			}
+
 			void ReadHeader()
 			{
 				// If this function is called, we are expecting asio to wait until it receives
@@ -48,24 +292,61 @@ namespace olc {
 				// size, so allocate a transmission buffer large enough to store it. In fact, 
 				// we will construct the message in a "temporary" message object as it's 
 				// convenient to work with.
-				asio::async_read(m_socket, asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
-					[this](std::error_code ec, std::size_t length)
+				ReadBytes(&m_msgTemporaryIn.header, sizeof(message_header<T>),
+					[this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch](std::error_code ec, std::size_t length)
 					{
+						// The socket this read was issued on has been replaced by a resume
+						if (nEpoch != m_nEpoch) return;
+						trace_zone zone("read_header", "id", id);
+
 						if (!ec)
 						{
+							// Everything up to header.ack has arrived at the other end
+							m_ringReplay.Acknowledge(m_msgTemporaryIn.header.ack);
+							SampleRoundTrip(m_msgTemporaryIn.header.ack);
+
+							// Check what we are being asked to make room for before making it.
+							// Fragments are checked against the size their fragment_begin gave.
+							bool bFragment = m_msgTemporaryIn.header.control == control_code::fragment ||
+								m_msgTemporaryIn.header.control == control_code::fragment_end ||
+								m_msgTemporaryIn.header.control == control_code::fragment_begin;
+							if (!bFragment && m_msgTemporaryIn.header.size > m_admission.MaxBody(size_t(m_msgTemporaryIn.header.id)))
+							{
+								LogWarn("[{}] Oversized Message Rejected: {} bytes", id, m_msgTemporaryIn.header.size);
+								DropForViolation(true);
+								return;
+							}
+
+							// Until it has said which session it belongs to, the client has not
+							// been approved - nothing else it sends may reach the server
+							if (m_bAwaitingSession && m_msgTemporaryIn.header.control != control_code::session_open)
+							{
+								LogWarn("[{}] Message Before Session Open", id);
+								DropForViolation(false);
+								return;
+							}
+
+							// Chunks of a large message are stitched back together separately,
+							// so small messages can arrive in between them
+							if (bFragment)
+							{
+								ReadFragment();
+							}
 							// A complete message header has been read, check if this message
 							// has a body to follow...
-							if (m_msgTemporaryIn.header.size > 0)
+							else if (m_msgTemporaryIn.header.size > 0)
 							{
 								// ...it does, so allocate enough space in the messages' body
 								// vector, and issue asio with the task to read the body.
+								if (m_msgTemporaryIn.header.size > m_msgTemporaryIn.body.capacity()) CountStat(stat::allocations);
 								m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.size);
 								ReadBody();
 							}
 							else
 							{
 								// it doesn't, so add this bodyless message to the connections
-								// incoming message queue
+								// incoming message queue - without whatever body the last one had
+								m_msgTemporaryIn.body.clear();
 								AddToIncomingMessageQueue();
 							}
 						}
@@ -73,8 +354,8 @@ namespace olc {
 						{
 							// Reading form the client went wrong, most likely a disconnect
 							// has occurred. Close the socket and let the system tidy it up later.
-							std::cout << "[" << id << "] Read Header Fail.\n";
-							m_socket.close();
+							LogInfo("[{}] Read Header Fail: {}", id, ec);
+							CloseSocket(ec);
 						}
 					});
 			}
@@ -85,9 +366,14 @@ namespace olc {
 				// If this function is called, a header has already been read, and that header
 				// request we read a body, The space for that body has already been allocated
 				// in the temporary message object, so just wait for the bytes to arrive...
-				asio::async_read(m_socket, asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
-					[this](std::error_code ec, std::size_t length)
+				if constexpr (trace_enabled) m_tpReadStart = std::chrono::steady_clock::now();
+				ReadBytes(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size(),
+					[this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch](std::error_code ec, std::size_t length)
 					{
+						if (nEpoch != m_nEpoch) return;
+						TraceSpan("read_body", m_tpReadStart, id);
+						trace_zone zone("read_body", "bytes", length);
+
 						if (!ec)
 						{
 							// ...and they have! The message is now complete, so add
@@ -97,37 +383,248 @@ namespace olc {
 						else
 						{
 							// As above!
-							std::cout << "[" << id << "] Read Body Fail.\n";
-							m_socket.close();
+							LogInfo("[{}] Read Body Fail: {}", id, ec);
+							CloseSocket(ec);
 						}
 					});
 			}
 
 
-			// Async - Prime context to write a message header
-			void WriteHeader() {
-				asio::async_write(m_socket, asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
-					[this](std::error_code ec, std::size_t length) {
-						if (!ec) {
-							if (m_qMessagesOut.front().body.size() > 0) {
-								WriteBody();
-							}
-							else {
-								m_qMessagesOut.pop_front();
+			// ASYNC - Prime context to read the body of one fragment frame. Each of the
+			// sender's lanes is a stream of its own, with at most one message under way.
+			void ReadFragment()
+			{
+				auto& h = m_msgTemporaryIn.header;
+				if (h.stream >= size_t(lane::count)) {
+					LogWarn("[{}] Fragment On Unknown Stream {}", id, h.stream);
+					DropForViolation(false);
+					return;
+				}
+				auto& s = m_streamsIn[h.stream];
 
-								if (!m_qMessagesOut.empty()) {	// If another header
-									// do a recursive call
-									WriteHeader();
-								}
+				if (h.control == control_code::fragment_begin) {
+					if (s.bOpen || h.size != sizeof(fragment_info)) {
+						LogWarn("[{}] Unexpected Fragment Begin On Stream {}", id, h.stream);
+						DropForViolation(false);
+						return;
+					}
+
+					ReadBytes(&m_fragmentInfoIn, sizeof(fragment_info),
+						[this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch](std::error_code ec, std::size_t length)
+						{
+							if (nEpoch != m_nEpoch) return;
+							if (!ec) OpenStream();
+							else {
+								LogInfo("[{}] Read Fragment Fail: {}", id, ec);
+								CloseSocket(ec);
 							}
+						});
+					return;
+				}
+
+				// Has to fit what was announced, and end exactly where it said it would
+				bool bEnd = h.control == control_code::fragment_end;
+				uint64_t nAfter = uint64_t(s.nReceived) + h.size;
+				if (!s.bOpen || nAfter > s.msg.header.size || bEnd != (nAfter == s.msg.header.size)) {
+					LogWarn("[{}] Fragment Doesn't Fit Stream {}", id, h.stream);
+					DropForViolation(false);
+					return;
+				}
+
+				if (s.pHandler || s.bSkip) {
+					ReadStreamPiece(h.stream, h.size, bEnd);
+					return;
+				}
+
+				ReadBytes(s.msg.body.data() + s.nReceived, h.size,
+					[this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch, nStream = h.stream, bEnd](std::error_code ec, std::size_t length)
+					{
+						if (nEpoch != m_nEpoch) return;
+						trace_zone zone("read_fragment", "bytes", length);
+
+						if (!ec)
+						{
+							m_streamsIn[nStream].nReceived += uint32_t(length);
+							if (bEnd) FinishStream(nStream);
+							else ReadHeader();
+						}
+						else
+						{
+							LogInfo("[{}] Read Fragment Fail: {}", id, ec);
+							CloseSocket(ec);
+						}
+					});
+			}
+
+			// A fragment_begin has told us how big the message is and what it is, so
+			// this is where it is held to our limits - before any of it arrives
+			void OpenStream() {
+				auto& h = m_msgTemporaryIn.header;
+				auto& s = m_streamsIn[h.stream];
+				uint32_t nTotal = m_fragmentInfoIn.nTotal;
+
+				if (nTotal > m_admission.MaxBody(size_t(h.id))) {
+					LogWarn("[{}] Oversized Message Rejected: {} bytes", id, nTotal);
+					DropForViolation(true);
+					return;
+				}
+
+				if (m_fragmentInfoIn.control == control_code::cluster && !m_bClusterLink) {
+					LogWarn("[{}] Cluster Frame From Outside The Cluster", id);
+					DropForViolation(false);
+					return;
+				}
+
+				if (m_seqIn.TooFarAhead(h.seq)) {
+					LogWarn("[{}] Sequence Out Of Window: {} after {}", id, h.seq, m_seqIn.LastContiguous());
+					DropForViolation(false);
+					return;
+				}
+
+				s = {};
+				s.bOpen = true;
+				s.msg.header = h;
+				s.msg.header.size = nTotal;
+				s.msg.header.control = m_fragmentInfoIn.control;
+				s.msg.header.stream = 0;
+
+				if (m_fragmentInfoIn.control == control_code::none && h.rpc == rpc_kind::none && m_pStreams) {
+					s.pHandler = m_pStreams->Find(h.id);
+				}
+
+				if (s.pHandler) {
+					// A resume replaying something we already have - read it, don't deliver it
+					s.bSkip = m_seqIn.Seen(h.seq);
+				}
+				else {
+					if (m_admission.nMaxReassemblyBytes > 0 && m_nReassemblyBytes + nTotal > m_admission.nMaxReassemblyBytes) {
+						LogWarn("[{}] Reassembly Limit Exceeded: {} bytes", id, m_nReassemblyBytes + nTotal);
+						DropForViolation(true);
+						return;
+					}
+					m_nReassemblyBytes += nTotal;
+
+					// All of it in one go, rather than growing piece by piece
+					CountStat(stat::allocations);
+					s.msg.body.resize(nTotal);
+				}
+
+				// The other lanes won't wait for it, so don't hold the window back either
+				if (!s.bSkip) m_seqIn.Open(h.seq);
+
+				ReadHeader();
+			}
+
+			// A streamed message is read in pieces no bigger than StreamReadSize, however
+			// big the sender's fragments are, and each goes straight to the handler
+			void ReadStreamPiece(uint8_t nStream, size_t nLeft, bool bEnd) {
+				size_t nRead = std::min(nLeft, StreamReadSize);
+				if (nRead > m_vStreamBuffer.capacity()) CountStat(stat::allocations);
+				m_vStreamBuffer.resize(nRead);
+
+				ReadBytes(m_vStreamBuffer.data(), nRead,
+					[this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch, nStream, nLeft, bEnd](std::error_code ec, std::size_t length)
+					{
+						if (nEpoch != m_nEpoch) return;
+						trace_zone zone("read_fragment", "bytes", length);
+
+						if (ec) {
+							LogInfo("[{}] Read Fragment Fail: {}", id, ec);
+							CloseSocket(ec);
+							return;
+						}
+
+						auto& s = m_streamsIn[nStream];
+						stream_chunk<T> chunk;
+						chunk.header = s.msg.header;
+						chunk.nOffset = s.nReceived;
+						chunk.pData = m_vStreamBuffer.data();
+						chunk.nSize = length;
+						s.nReceived += uint32_t(length);
+						chunk.bLast = s.nReceived == s.msg.header.size;
+						if (!s.bSkip) (*s.pHandler)(Self(), chunk);
+
+						if (nLeft > length) ReadStreamPiece(nStream, nLeft - length, bEnd);
+						else if (bEnd) FinishStream(nStream);
+						else ReadHeader();
+					});
+			}
+
+			// The last fragment of a stream is in
+			void FinishStream(uint8_t nStream) {
+				auto& s = m_streamsIn[nStream];
+
+				if (!s.pHandler) {
+					// Carries on exactly like a message that arrived in one piece
+					m_nReassemblyBytes -= s.msg.header.size;
+					m_msgTemporaryIn = std::move(s.msg);
+					m_bReassembled = true;
+					s = {};
+					AddToIncomingMessageQueue();
+					return;
+				}
+
+				bool bDeliver = !s.bSkip && m_seqIn.Accept(s.msg.header.seq);
+				size_t nBytes = sizeof(message_header<T>) + s.msg.header.size;
+				if (bDeliver && m_pStats) m_pStats->MessageIn(size_t(s.msg.header.id), nBytes);
+				s = {};
+
+				if (bDeliver) ContinueReading(nBytes, false);
+				else ReadHeader();
+			}
+
+			void ResetStreams() {
+				for (auto& s : m_streamsIn) s = {};
+				m_nReassemblyBytes = 0;
+			}
+
+			// The other end broke the framing or our limits - there is no getting back in
+			// step with it after that
+			void DropForViolation(bool bOversized) {
+				if (bOversized) CountStat(stat::oversized_frames);
+				CountClose(disconnect_reason::policy_violation);
+				CloseTransport();
+			}
+
+			// Ourselves, the same way the incoming queue names us
+			std::shared_ptr<connection<T>> Self() {
+				if (m_nOwnerType == owner::server) return this->shared_from_this();
+				return this->weak_from_this().lock();
+			}
+
+
+			// Async - Prime context to write the next frame, header and body in one go
+			void WriteFrame() {
+				m_bWriting = true;
+
+				// Stamp the latest sequence number we have received right before it goes out
+				m_qMessagesOut.front().header.ack = m_seqIn.LastContiguous();
+
+				if (m_pStats || trace_enabled) m_tpWriteStart = std::chrono::steady_clock::now();
+
+				// Time one sequenced frame at a time until the other end acks it
+				if (m_nTimedSeq == 0 && m_qMessagesOut.front().header.seq != 0) {
+					m_nTimedSeq = m_qMessagesOut.front().header.seq;
+					m_tpTimedSend = std::chrono::steady_clock::now();
+				}
+
+				auto& frame = m_qMessagesOut.front();
+				WriteBytes(&frame.header, sizeof(message_header<T>), frame.pBody, frame.header.size,
+					[this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch](std::error_code ec, std::size_t length) {
+						if (nEpoch != m_nEpoch) return;
+						trace_zone zone("write", "id", id);
+
+						if (!ec) {
+							FrameWritten();
+							WriteNext();
 						}
 						else {
 							// ...asio failed to write the message, we could analyse why but 
 							// for now simply assume the connection has died by closing the
 							// socket. When a future attempt to write to this client fails due
 							// to the closed socket, it will be tidied up.
-							std::cout << "[" << id << "] Write Header Fail.\n";
-							m_socket.close();
+							LogWarn("[{}] Write Fail: {}", id, ec);
+							CloseSocket(ec, disconnect_reason::write_error);
 						}
 
 					}
@@ -135,54 +632,353 @@ namespace olc {
 				);
 			}
 
-			// Async - Prime context to read a write body
-			void WriteBody() {
-				asio::async_write(m_socket,
-					asio::buffer(
-						m_qMessagesOut.front().body.data(),
-						m_qMessagesOut.front().body.size()
-					),
-					[this](std::error_code ec, std::size_t length) {
-						if (!ec) {
-							m_qMessagesOut.pop_front();
 
-							if (!m_qMessagesOut.empty()) {
-								WriteHeader();
-							}
-						}
-						else {
-							std::cout << "[" << id << "] Write Body Fail.\n";
-							m_socket.close();
-						}
-					}
-				);
+			// The frame at the front of the lanes is fully on the wire
+			void FrameWritten() {
+				auto& frame = m_qMessagesOut.front();
+				TraceSpan("write", m_tpWriteStart, id);
+				m_nBytesWritten.fetch_add(sizeof(message_header<T>) + frame.header.size, std::memory_order_relaxed);
+				if (m_pStats) {
+					bool bComplete = frame.header.control != control_code::fragment && frame.header.control != control_code::fragment_begin;
+					m_pStats->FrameOut(size_t(frame.header.id), sizeof(message_header<T>) + frame.header.size, bComplete);
+					if (bComplete) m_pStats->Add(stat::queued_out, -1);
+					if (std::chrono::steady_clock::now() - m_tpWriteStart > net_stats::WriteStallThreshold) m_pStats->Add(stat::write_stalls);
+				}
+
+				// Answers are the only time sync frames carrying three stamps
+				if (frame.header.control == control_code::time_sync && frame.header.size == 3 * sizeof(int64_t) + sizeof(uint8_t)) {
+					m_bSyncAnswerQueued = false;
+				}
+
+				m_qMessagesOut.Complete();
+			}
+
+			// The other end has everything up to nAck. If that covers the frame being timed,
+			// fold the sample in the way TCP does (RFC 6298).
+			void SampleRoundTrip(uint32_t nAck) {
+				if (m_nTimedSeq == 0 || int32_t(nAck - m_nTimedSeq) < 0) return;
+				m_nTimedSeq = 0;
+
+				// Time sync gives cleaner samples, don't muddy them with these
+				if (m_syncPolicy.bEnabled) return;
+
+				FoldRoundTrip(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_tpTimedSend).count());
+			}
+
+			void FoldRoundTrip(int64_t nSample) {
+				int64_t nSmoothed = m_nSmoothedRtt.load(std::memory_order_relaxed);
+				int64_t nVariation = m_nRttVariation.load(std::memory_order_relaxed);
+				if (nSmoothed == 0) {
+					nSmoothed = nSample;
+					nVariation = nSample / 2;
+				}
+				else {
+					nVariation = (3 * nVariation + std::abs(nSmoothed - nSample)) / 4;
+					nSmoothed = (7 * nSmoothed + nSample) / 8;
+				}
+				m_nSmoothedRtt.store(nSmoothed, std::memory_order_relaxed);
+				m_nRttVariation.store(nVariation, std::memory_order_relaxed);
+			}
+
+			// Closes the socket after a failed read or write, counting why exactly once
+			void CloseSocket(const std::error_code& ec, disconnect_reason reason = disconnect_reason::read_error) {
+				if (ec == asio::error::eof) reason = disconnect_reason::remote_closed;
+
+				// Aborted operations are the fallout of a close that was already counted
+				if (ec != asio::error::operation_aborted) CountClose(reason);
+
+				CloseTransport();
 			}
 
+			// Everything below the framing goes through these, so that something other
+			// than the TCP socket can carry the bytes - see net_transport.h
+			template <typename Handler>
+			void ReadBytes(void* pData, size_t nBytes, Handler&& handler) {
+				if (m_pTransport) m_pTransport->async_read(pData, nBytes, std::forward<Handler>(handler));
+				else asio::async_read(m_socket, asio::buffer(pData, nBytes), std::forward<Handler>(handler));
+			}
+
+			// Header and body in one write - see byte_transport for why that matters
+			template <typename Handler>
+			void WriteBytes(const void* pHead, size_t nHead, const void* pBody, size_t nBody, Handler&& handler) {
+				if (m_pTransport) {
+					m_pTransport->async_write(pHead, nHead, pBody, nBody, std::forward<Handler>(handler));
+				}
+				else {
+					std::array<asio::const_buffer, 2> buffers = { asio::buffer(pHead, nHead), asio::buffer(pBody, nBody) };
+					asio::async_write(m_socket, buffers, std::forward<Handler>(handler));
+				}
+			}
+
+			void CloseTransport() {
+				if (m_pTransport) m_pTransport->close();
+				asio::error_code ecClose;
+				m_socket.close(ecClose);
+				m_timerRead.cancel();
+				m_timerSync.cancel();
+			}
+
+			void CountClose(disconnect_reason reason) {
+				if (m_pStats && !m_bCloseCounted) {
+					m_bCloseCounted = true;
+					m_pStats->Disconnected(reason);
+				}
+			}
+
+			void CountStat(stat s, int64_t n = 1) {
+				if (m_pStats) m_pStats->Add(s, n);
+			}
+
+			// Carry on writing if there is more to go, unless we are holding everything
+			// back until the server answers a resume request
+			void WriteNext() {
+				if (!m_qMessagesOut.empty() && !m_bAwaitingHello) {
+					WriteFrame();
+				}
+				else {
+					m_bWriting = false;
+				}
+			}
 
 			void AddToIncomingMessageQueue() {
+				if (m_msgTemporaryIn.header.control == control_code::cluster) {
+					// Goes up to the cluster node like any other message, limits and all
+					if (!m_bClusterLink) {
+						LogWarn("[{}] Cluster Frame From Outside The Cluster", id);
+						DropForViolation(false);
+						return;
+					}
+				}
+				else if (m_msgTemporaryIn.header.control != control_code::none) {
+					// Framework traffic, never seen by the user
+					HandleControlFrame();
+					return;
+				}
+
+				if (m_seqIn.TooFarAhead(m_msgTemporaryIn.header.seq)) {
+					LogWarn("[{}] Sequence Out Of Window: {} after {}", id, m_msgTemporaryIn.header.seq, m_seqIn.LastContiguous());
+					DropForViolation(false);
+					return;
+				}
+
+				// Lanes overtake each other and a resume may replay things we already
+				// have, so only pass on what is genuinely new
+				if (!m_seqIn.Accept(m_msgTemporaryIn.header.seq)) {
+					ReadHeader();
+					return;
+				}
+
+				// Answers to our calls are matched up here and never queued
+				if (m_pRpc && m_msgTemporaryIn.header.control == control_code::none && (m_msgTemporaryIn.header.rpc == rpc_kind::reply || m_msgTemporaryIn.header.rpc == rpc_kind::error)) {
+					size_t nBytes = sizeof(message_header<T>) + m_msgTemporaryIn.body.size();
+					if (m_pStats) m_pStats->MessageIn(size_t(m_msgTemporaryIn.header.id), nBytes);
+					m_pRpc->Complete(m_msgTemporaryIn);
+					m_bReassembled = false;
+					ContinueReading(nBytes, false);
+					return;
+				}
+
+				// Wanted a piece at a time, but small enough to arrive in one
+				if (m_pStreams && m_msgTemporaryIn.header.control == control_code::none && m_msgTemporaryIn.header.rpc == rpc_kind::none) {
+					if (auto pHandler = m_pStreams->Find(m_msgTemporaryIn.header.id)) {
+						stream_chunk<T> chunk;
+						chunk.header = m_msgTemporaryIn.header;
+						chunk.pData = m_msgTemporaryIn.body.data();
+						chunk.nSize = m_msgTemporaryIn.body.size();
+						chunk.bLast = true;
+						(*pHandler)(Self(), chunk);
+
+						size_t nBytes = sizeof(message_header<T>) + m_msgTemporaryIn.body.size();
+						if (m_pStats) m_pStats->MessageIn(size_t(m_msgTemporaryIn.header.id), nBytes);
+						ContinueReading(nBytes, false);
+						return;
+					}
+				}
+
+				if (m_pRecorder) {
+					m_pRecorder->Record(id, m_msgTemporaryIn);
+				}
+
+				if (m_pStats) {
+					m_pStats->MessageIn(size_t(m_msgTemporaryIn.header.id), sizeof(message_header<T>) + m_msgTemporaryIn.body.size());
+				}
+
+				size_t nBytes = sizeof(message_header<T>) + m_msgTemporaryIn.body.size();
 				if (m_nOwnerType == owner::server) {
 					// servers connections can have multiple connections
 					// Can extract a shared pointer from the shared_from_this func pointer
-					m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn });
+					m_qMessagesIn.push_back({ this->shared_from_this(), TakeIncoming() });
 				}
 				else {
-					// clients can only have one connections
-					m_qMessagesIn.push_back({ nullptr, m_msgTemporaryIn });	// comes from client
+					// clients can only have one connections, unless they are shared between
+					// several links of a cluster node, in which case say which one it was
+					m_qMessagesIn.push_back({ this->weak_from_this().lock(), TakeIncoming() });	// comes from client
+				}
+
+				ContinueReading(nBytes);
+			}
+
+			// m_msgTemporaryIn keeps its buffer for the next message, but one put back
+			// together from fragments has a buffer of its own - hand that over, don't copy it
+			message<T> TakeIncoming() {
+				if (!m_bReassembled) return m_msgTemporaryIn;
+				m_bReassembled = false;
+				return std::exchange(m_msgTemporaryIn, {});
+			}
+
+			// A message has been queued (or handed to a stream handler) - read the next one,
+			// unless this client has gone over its rate or used up its share of the
+			// incoming queue
+			void ContinueReading(size_t nBytes, bool bQueued = true) {
+				if (bQueued && QueueShare() > 0) ++m_nQueuedIn;
+
+				auto tpNow = std::chrono::steady_clock::now();
+				std::chrono::nanoseconds wait(0);
+				if (m_bucketMessages.Enabled()) wait = std::max(wait, m_bucketMessages.Take(1.0, tpNow));
+				if (m_bucketBytes.Enabled()) wait = std::max(wait, m_bucketBytes.Take(double(nBytes), tpNow));
+
+				if (wait.count() > 0) {
+					CountStat(stat::rate_limited);
+					if (m_admission.bDisconnectOnRateLimit) {
+						LogWarn("[{}] Rate Limit Exceeded.", id);
+						CountClose(disconnect_reason::policy_violation);
+						CloseTransport();
+						return;
+					}
+
+					// Stop reading until the buckets have refilled, letting TCP push back
+					m_bReadParked = true;
+					m_timerRead.expires_after(wait);
+					m_timerRead.async_wait([this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch](std::error_code ec) {
+						if (!ec && nEpoch == m_nEpoch) ResumeReading();
+					});
+					return;
 				}
 
+				if (PauseForQueue()) return;
 				ReadHeader();
 			}
 
+			// Picks reading back up after ContinueReading parked it
+			void ResumeReading() {
+				if (!m_bReadParked || !IsConnected()) return;
+				m_bReadParked = false;
+
+				if (PauseForQueue()) return;
+				ReadHeader();
+			}
+
+			// Only the server shares one incoming queue between many connections, and only
+			// its Update() reports back through MessageConsumed
+			size_t QueueShare() const {
+				return m_nOwnerType == owner::server ? m_admission.nMaxQueuedIn : 0;
+			}
+
+			// Parks reading if we have our full share of the incoming queue. MessageConsumed
+			// resumes it once Update() has worked through half of that.
+			bool PauseForQueue() {
+				if (QueueShare() == 0 || m_nQueuedIn < int64_t(QueueShare())) return false;
+
+				m_bReadParked = true;
+				m_bQueuePaused = true;
+				CountStat(stat::reads_paused);
+
+				// Update() may have drained us in the meantime without seeing the flag,
+				// in which case nobody else is going to resume us
+				if (m_nQueuedIn > int64_t(QueueShare() / 2) || !m_bQueuePaused.exchange(false)) return true;
+
+				m_bReadParked = false;
+				return false;
+			}
+
+			void HandleControlFrame() {
+				// Charged to the rate limits like anything else, or a peer could flood us
+				// with these for free
+				size_t nBytes = sizeof(message_header<T>) + m_msgTemporaryIn.body.size();
+
+				switch (m_msgTemporaryIn.header.control) {
+				case control_code::session_open:
+					if (m_nOwnerType == owner::server && m_bAwaitingSession) {
+						// The server decides what to do with this on its own thread, and this
+						// connection stays quiet until it has (see StartSession / ResumeSession)
+						m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn });
+						return;
+					}
+					break;
+
+				case control_code::session_hello:
+					if (m_nOwnerType == owner::client) {
+						uint64_t nToken = 0;
+						uint32_t uid = 0;
+						uint32_t nPeerLastReceived = 0;
+						uint8_t bResumed = 0;
+						if (m_msgTemporaryIn.body.size() != sizeof(bResumed) + sizeof(nPeerLastReceived) + sizeof(uid) + sizeof(nToken)) {
+							LogWarn("[{}] Malformed Session Hello: {} bytes", id, m_msgTemporaryIn.body.size());
+							DropForViolation(false);
+							return;
+						}
+						m_msgTemporaryIn >> bResumed >> nPeerLastReceived >> uid >> nToken;
+
+						id = uid;
+						m_nSessionToken = nToken;
+
+						if (bResumed) {
+							// Whatever we queued while reconnecting is also in the ring, so
+							// throw the queue away and send exactly what the server is missing
+							if (m_ringReplay.Enabled()) {
+								CountStat(stat::queued_out, -int64_t(m_qMessagesOut.count()));
+								m_qMessagesOut.clear();
+								m_bSyncAnswerQueued = false;
+								for (auto& e : m_ringReplay.CollectAfter(nPeerLastReceived)) {
+									m_qMessagesOut.push_back(lane(e.nLane), { MakeHeader(*e.msg, e.seq), e.msg });
+									CountStat(stat::queued_out);
+								}
+							}
+						}
+						else if (m_bAwaitingHello) {
+							// We asked to resume but the server started us from scratch, so the
+							// old session is gone. Whatever is queued still goes out as normal.
+							m_seqIn.Reset();
+							m_ringReplay.Clear();
+						}
+
+						m_bAwaitingHello = false;
+						if (!m_bWriting && !m_qMessagesOut.empty()) {
+							WriteFrame();
+						}
+					}
+					break;
+
+				case control_code::time_sync:
+					HandleTimeSync();
+					break;
+
+				default:
+					break;
+				}
+
+				ContinueReading(nBytes, false);
+			}
+
 			bool ConnectToServer(const asio::ip::tcp::resolver::results_type& endpoints) {
 			
 				// Only client(s) can connect to server
 				if (m_nOwnerType == owner::client) {
+					m_bConnecting = true;
+
 					asio::async_connect(m_socket, endpoints,
-						[this](std::error_code ec, asio::ip::tcp::endpoint endpoint) {
+						[this, pSelf = this->shared_from_this()](std::error_code ec, asio::ip::tcp::endpoint endpoint) {
 							if (!ec) {
-								ReadHeader();
+								ApplySocketOptions(m_socket, m_latency);
+								if (m_pUring) m_pTransport = m_pUring->Adopt(m_socket);
+								Connected();
 							}
 							else {
+								// Nothing to read or write on. Whoever owns us can see we
+								// gave up and try again with a new connection.
+								asio::error_code ecClose;
+								m_socket.close(ecClose);
+								m_bConnecting = false;
 							}
 
 						});
@@ -190,45 +986,232 @@ namespace olc {
 				}
 				return true;
 			}
-			bool Disconnect() {
+
+			// Same again over a transport that is already attached to the server's end
+			bool ConnectToServer(std::unique_ptr<byte_transport> pTransport) {
+
+				if (m_nOwnerType == owner::client) {
+					m_pTransport = std::move(pTransport);
+					m_bConnecting = true;
+					asio::post(m_asioContext, [this, pSelf = this->shared_from_this()]() { Connected(); });
+				}
+				return true;
+			}
+
+			// Server side: bytes for this connection come through pTransport rather than
+			// the socket. Set before ConnectToClient / AwaitSession.
+			void SetTransport(std::unique_ptr<byte_transport> pTransport) {
+				m_pTransport = std::move(pTransport);
+			}
+
+			bool Disconnect(disconnect_reason reason = disconnect_reason::local) {
 			
 				if (IsConnected()) {
-					asio::post(m_asioContext, [this]() {m_socket.close(); });
+					// Whoever told us to go may be about to drop the last reference to us
+					asio::post(m_asioContext, [this, pSelf = this->weak_from_this().lock(), reason]() { CountClose(reason); CloseTransport(); });
 				}
 				return true;
 			}
 			bool IsConnected() const {
-				return m_socket.is_open();
+				return m_pTransport ? m_pTransport->is_open() : m_socket.is_open();
+			}
+
+			bool IsConnecting() const {
+				return m_bConnecting;
+			}
+
+			// Lane picks how urgent this is relative to everything else queued for this
+			// connection - see net_lanes.h
+			bool Send(const message<T>& msg, lane l = lane::realtime) {
+
+				if (m_bDetached) return false;
+
+				CountStat(stat::allocations);
+				return Send(std::make_shared<const message<T>>(msg), l);
 			}
 
-			bool Send(const message<T>& msg) {
-	
+			// Same as above, but shares an already built message instead of copying it -
+			// how one message goes out to many connections (see server_interface::Publish)
+			bool Send(std::shared_ptr<const message<T>> pMsg, lane l = lane::realtime) {
+
+				if (m_bDetached) return false;
+
 				// asio post inject work into asio context
-				asio::post(m_asioContext, [this, msg]() {
-					bool bWritingMessage = !m_qMessagesOut.empty();
+				asio::post(m_asioContext, [this, pSelf = this->shared_from_this(), pMsg, l]() {
+					trace_zone zone("enqueue", "msg", uint64_t(pMsg->header.id));
+					uint32_t nSeq = ++m_nSeqOut;
+					m_ringReplay.Push(nSeq, pMsg, uint8_t(l));
+					QueueFrame(l, { MakeHeader(*pMsg, nSeq), pMsg });
+				});
+				return true;
+			}
 
-					m_qMessagesOut.push_back(msg);
+			// Framework traffic rather than a game message - never replayed, and handed to
+			// the owner's queue with its control code intact
+			bool SendControl(const message<T>& msg, control_code control, lane l = lane::realtime) {
 
-					if (!bWritingMessage) {	// This is done to prevent asio from firing while it already is reading a header, thereby creating an desychronization
-						WriteHeader();
+				if (m_bDetached) return false;
 
-					}
+				CountStat(stat::allocations);
+				auto pMsg = std::make_shared<const message<T>>(msg);
+				asio::post(m_asioContext, [this, pSelf = this->shared_from_this(), pMsg, l, control]() {
+					// Cluster frames carry game messages between nodes, so they are sequenced
+					// like them - but links have no sessions, so they are never replayed
+					uint32_t nSeq = control == control_code::cluster ? ++m_nSeqOut : 0;
+					QueueFrame(l, { MakeHeader(*pMsg, nSeq, control), pMsg });
 				});
 				return true;
 			}
 
+		protected:
+			// Client side, once there is something to talk to the server over
+			void Connected() {
+				m_bConnecting = false;
+
+				// If we have an old session, nothing else goes out until the
+				// server has told us how much of it survived
+				m_bAwaitingHello = HasSession();
+
+				// Always the first thing the server hears from us
+				message<T> msg;
+				msg << m_nSessionToken << m_seqIn.LastContiguous();
+				auto pMsg = std::make_shared<const message<T>>(std::move(msg));
+				m_qMessagesOut.push_front(lane::critical, { MakeHeader(*pMsg, 0, control_code::session_open), pMsg });
+				CountStat(stat::queued_out);
+				WriteFrame();
+
+				ReadHeader();
+				StartTimeSync();
+			}
+
+			static int64_t SteadyNow() {
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			// Both ends ask, whichever way round the connection was made. The first few
+			// samples come quickly so there is a decent estimate soon after connecting.
+			void StartTimeSync() {
+				if (!m_syncPolicy.bEnabled || m_bDetached) return;
+				m_nSyncSent = 0;
+				SendTimeSync();
+			}
+
+			void SendTimeSync() {
+				if (!IsConnected()) return;
+
+				// While a resume is being sorted out the queue gets thrown away, so there is
+				// no point putting a stamp in it
+				if (!m_bAwaitingHello) {
+					message<T> msg;
+					msg << SteadyNow() << uint8_t(0);
+					auto pMsg = std::make_shared<const message<T>>(std::move(msg));
+					QueueFrame(lane::critical, { MakeHeader(*pMsg, 0, control_code::time_sync), pMsg });
+					m_nSyncSent++;
+				}
+
+				m_timerSync.expires_after(m_nSyncSent < m_syncPolicy.nBurst ? m_syncPolicy.burstInterval : m_syncPolicy.interval);
+				m_timerSync.async_wait([this, pSelf = this->shared_from_this(), nEpoch = m_nEpoch](std::error_code ec) {
+					if (!ec && nEpoch == m_nEpoch) SendTimeSync();
+				});
+			}
+
+			// A request is t0 then 0, an answer t0, t1, t2 then 1 (popped in reverse)
+			void HandleTimeSync() {
+				int64_t nNow = SteadyNow();
+				uint8_t nKind = 0;
+				if (m_msgTemporaryIn.body.size() < sizeof(nKind) + sizeof(int64_t)) return;
+				m_msgTemporaryIn >> nKind;
+
+				if (nKind == 0) {
+					int64_t t0 = 0;
+					m_msgTemporaryIn >> t0;
+
+					// One answer waiting to go out is plenty - if the peer asks faster than
+					// it reads, the extra requests go unanswered rather than piling up
+					if (m_bSyncAnswerQueued) return;
+					m_bSyncAnswerQueued = true;
+
+					message<T> msg;
+					msg << t0 << nNow << SteadyNow() << uint8_t(1);
+					auto pMsg = std::make_shared<const message<T>>(std::move(msg));
+					QueueFrame(lane::critical, { MakeHeader(*pMsg, 0, control_code::time_sync), pMsg });
+				}
+				else if (m_msgTemporaryIn.body.size() == 3 * sizeof(int64_t)) {
+					int64_t t0 = 0, t1 = 0, t2 = 0;
+					m_msgTemporaryIn >> t2 >> t1 >> t0;
+
+					int64_t nRtt = m_clock.Sample(t0, t1, t2, nNow);
+					if (nRtt < 0) return;
+					FoldRoundTrip(nRtt);
+					m_nClockOffset.store(m_clock.Offset(), std::memory_order_relaxed);
+					m_nJitter.store(m_clock.Jitter(), std::memory_order_relaxed);
+					m_nSyncSamples.store(m_clock.Samples(), std::memory_order_relaxed);
+				}
+			}
+
+			static message_header<T> MakeHeader(const message<T>& msg, uint32_t nSeq, control_code control = control_code::none) {
+				message_header<T> header = msg.header;
+				header.size = uint32_t(msg.body.size());
+				header.seq = nSeq;
+				header.control = control;
+				return header;
+			}
+
+			void QueueFrame(lane l, outbound_frame<T> frame) {
+				// A dropped session keeps its messages in the replay ring, there is no point
+				// queueing them for a socket that is gone
+				if (!IsConnected() && !m_bConnecting) return;
+
+				m_qMessagesOut.push_back(l, std::move(frame));
+				CountStat(stat::queued_out);
+
+				// This is done to prevent asio from firing while it already is writing a header, thereby creating an desychronization
+				if (!m_bWriting && !m_bConnecting && !m_bAwaitingHello) {
+					WriteFrame();
+				}
+			}
+
+			void SendSessionHello(bool bResumed) {
+				message<T> msg;
+				msg << m_nSessionToken << id << m_seqIn.LastContiguous() << uint8_t(bResumed ? 1 : 0);
+				auto pMsg = std::make_shared<const message<T>>(std::move(msg));
+				QueueFrame(lane::critical, { MakeHeader(*pMsg, 0, control_code::session_hello), pMsg });
+			}
+
 		protected:
 			// Each connection has a unique socket to a remote
 			asio::ip::tcp::socket m_socket;
 
+			// When set, carries the bytes instead of m_socket (which then stays closed)
+			std::unique_ptr<byte_transport> m_pTransport;
+
 			// This context will be shared by the entire asio instance
 			// context handles the underlying implementation of sockets on the host machine
 			asio::io_context& m_asioContext;
 
-			// Sent to the remote side
-			tsqueue<message<T>> m_qMessagesOut;
+			// Sent to the remote side - only ever touched from the asio thread
+			outbound_lanes<T> m_qMessagesOut;
+			bool m_bWriting = false;
 			message<T> m_msgTemporaryIn;
 
+			// Large messages arriving in fragments are built up here, one per stream
+			struct inbound_stream {
+				message<T> msg;				// header is the whole message's
+				uint32_t nReceived = 0;
+				const stream_handler<T>* pHandler = nullptr;
+				bool bOpen = false;
+				bool bSkip = false;			// streamed, but we already have it
+			};
+			inbound_stream m_streamsIn[size_t(lane::count)];
+			fragment_info m_fragmentInfoIn;
+			size_t m_nReassemblyBytes = 0;
+			bool m_bReassembled = false;		// m_msgTemporaryIn came from m_streamsIn
+
+			std::shared_ptr<const stream_table<T>> m_pStreams;
+			std::shared_ptr<rpc_caller<T>> m_pRpc;
+			std::vector<uint8_t> m_vStreamBuffer;
+			static constexpr size_t StreamReadSize = 64 * 1024;
+
 			// Received from the remote side
 			// It is a reference as the "owner" of this connection is to provide a queue?
 			tsqueue<owned_message<T>>& m_qMessagesIn;
@@ -237,6 +1220,61 @@ namespace olc {
 			owner m_nOwnerType = owner::server;
 			uint32_t id = 0;
 
+			// Session state. Sequence numbers count ordinary messages in each direction,
+			// the ring keeps what we sent until the other side acknowledges it.
+			uint64_t m_nSessionToken = 0;
+			uint32_t m_nSeqOut = 0;
+			sequence_tracker m_seqIn;
+			replay_ring<T> m_ringReplay;
+
+			// Bumped whenever the socket is swapped out underneath us
+			uint32_t m_nEpoch = 0;
+
+			bool m_bDetached = false;
+			bool m_bClusterLink = false;
+			traffic_recorder<T>* m_pRecorder = nullptr;
+
+			// Admission control. m_nQueuedIn counts our messages in the shared incoming
+			// queue and is the only part the Update thread touches.
+			admission_policy m_admission;
+			latency_profile m_latency;
+			std::shared_ptr<uring_loop> m_pUring;
+			token_bucket m_bucketMessages;
+			token_bucket m_bucketBytes;
+			asio::steady_timer m_timerRead;
+			bool m_bReadParked = false;
+			std::atomic<int64_t> m_nQueuedIn = 0;
+			std::atomic<bool> m_bQueuePaused = false;
+
+			net_stats* m_pStats = nullptr;
+			std::chrono::steady_clock::time_point m_tpWriteStart;
+			std::chrono::steady_clock::time_point m_tpReadStart;		// only kept when tracing
+			bool m_bCloseCounted = false;
+
+			// Round trip estimate - the frame being timed (0 for none) and the result
+			uint32_t m_nTimedSeq = 0;
+			std::chrono::steady_clock::time_point m_tpTimedSend;
+			std::atomic<int64_t> m_nSmoothedRtt = 0;
+			std::atomic<int64_t> m_nRttVariation = 0;
+			std::atomic<uint64_t> m_nBytesWritten = 0;
+
+			// Time sync - the estimator lives on the asio thread, the results are copied
+			// out for everyone else
+			time_sync_policy m_syncPolicy;
+			clock_estimator m_clock;
+			asio::steady_timer m_timerSync;
+			size_t m_nSyncSent = 0;
+			bool m_bSyncAnswerQueued = false;
+			std::atomic<int64_t> m_nClockOffset = 0;
+			std::atomic<int64_t> m_nJitter = 0;
+			std::atomic<uint64_t> m_nSyncSamples = 0;
+			mutable std::atomic<int64_t> m_nPeerTimeFloor = std::numeric_limits<int64_t>::min();
+
+			std::atomic<bool> m_bConnecting = false;
+			bool m_bAwaitingSession = false;
+			bool m_bAwaitingHello = false;
+			std::atomic<bool> m_bResumePending = false;
+
 		};
 
 
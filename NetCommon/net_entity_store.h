@@ -0,0 +1,397 @@
+#pragma once
+#include "net_common.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OLC_NET_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need to be told a function may use AVX2 even when the rest of the
+// build doesn't, MSVC lets any function use any intrinsic
+#if defined(OLC_NET_X86) && (defined(__GNUC__) || defined(__clang__))
+#define OLC_NET_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define OLC_NET_TARGET_AVX2
+#endif
+
+/*
+	Entity store - game state for servers built on this framework, so every
+	CustomServer doesn't have to hand roll its own player list.
+
+	Components live in structure-of-arrays columns: all the x positions together,
+	all the y positions together, and so on. Entities are packed densely at the
+	front of every column, removing one swaps the last entity into its slot, and
+	handles (index + generation) stay valid no matter how things move around.
+
+	Position and velocity are built in, because the integration step runs over
+	them every tick with SIMD. Anything else can be added as a column of its own.
+
+	A dirty bitset per dense slot records which entities changed since the last
+	ClearDirty(), so networking code only has to serialise those.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		// std::allocator with a stronger alignment, so SIMD loads can be aligned ones
+		template <typename T, size_t Align>
+		struct aligned_allocator {
+			using value_type = T;
+
+			template <typename U>
+			struct rebind {
+				using other = aligned_allocator<U, Align>;
+			};
+
+			aligned_allocator() = default;
+			template <typename U>
+			aligned_allocator(const aligned_allocator<U, Align>&) {}
+
+			T* allocate(size_t n) {
+				return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+			}
+
+			void deallocate(T* p, size_t) {
+				::operator delete(p, std::align_val_t(Align));
+			}
+
+			template <typename U>
+			bool operator==(const aligned_allocator<U, Align>&) const { return true; }
+			template <typename U>
+			bool operator!=(const aligned_allocator<U, Align>&) const { return false; }
+		};
+
+		using float_column = std::vector<float, aligned_allocator<float, 32>>;
+
+
+		struct entity_handle {
+			uint32_t index = 0xFFFFFFFF;
+			uint32_t generation = 0;
+
+			bool operator==(const entity_handle& other) const {
+				return index == other.index && generation == other.generation;
+			}
+			bool operator!=(const entity_handle& other) const {
+				return !(*this == other);
+			}
+		};
+
+
+		// One bit per dense slot
+		class dirty_bitset {
+
+		public:
+			void resize(size_t nBits) {
+				m_vWords.resize((nBits + 63) / 64, 0);
+			}
+
+			void set(size_t i) {
+				m_vWords[i >> 6] |= uint64_t(1) << (i & 63);
+			}
+
+			void reset(size_t i) {
+				m_vWords[i >> 6] &= ~(uint64_t(1) << (i & 63));
+			}
+
+			bool test(size_t i) const {
+				return (m_vWords[i >> 6] >> (i & 63)) & 1;
+			}
+
+			// ORs in up to 64 bits starting at a multiple of their width
+			void merge(size_t i, uint64_t nBits) {
+				m_vWords[i >> 6] |= nBits << (i & 63);
+			}
+
+			void clear() {
+				std::fill(m_vWords.begin(), m_vWords.end(), 0);
+			}
+
+			// Calls f(i) for every set bit, skipping empty words 64 at a time
+			template <typename F>
+			void for_each(F&& f) const {
+				for (size_t w = 0; w < m_vWords.size(); w++) {
+					uint64_t nWord = m_vWords[w];
+					while (nWord) {
+						f(w * 64 + CountTrailingZeros(nWord));
+						nWord &= nWord - 1;
+					}
+				}
+			}
+
+		private:
+			static size_t CountTrailingZeros(uint64_t n) {
+#ifdef _MSC_VER
+				unsigned long i;
+				_BitScanForward64(&i, n);
+				return i;
+#else
+				return size_t(__builtin_ctzll(n));
+#endif
+			}
+
+		private:
+			std::vector<uint64_t> m_vWords;
+		};
+
+
+		class entity_store {
+
+		public:
+			// Dense columns - entity i of the store is slot i in every one of them
+			float_column px, py, pz;
+			float_column vx, vy, vz;
+
+		public:
+			entity_store() = default;
+			entity_store(const entity_store&) = delete;
+
+			size_t size() const {
+				return m_vDenseToIndex.size();
+			}
+
+			entity_handle Create(float x = 0.0f, float y = 0.0f, float z = 0.0f) {
+				uint32_t index;
+				if (!m_vFree.empty()) {
+					index = m_vFree.back();
+					m_vFree.pop_back();
+				}
+				else {
+					index = uint32_t(m_vSparse.size());
+					m_vSparse.push_back(0);
+					m_vGeneration.push_back(0);
+				}
+
+				uint32_t nDense = uint32_t(size());
+				m_vSparse[index] = nDense;
+				m_vDenseToIndex.push_back(index);
+
+				px.push_back(x); py.push_back(y); pz.push_back(z);
+				vx.push_back(0.0f); vy.push_back(0.0f); vz.push_back(0.0f);
+				for (auto& col : m_vColumns) {
+					if (col) col->push_default();
+				}
+
+				m_dirty.resize(size());
+				m_dirty.set(nDense);	// new entities always need sending
+
+				return { index, m_vGeneration[index] };
+			}
+
+			// Swaps the last entity into the removed one's slot, so the columns stay packed
+			bool Destroy(entity_handle h) {
+				if (!Alive(h)) return false;
+
+				uint32_t nDense = m_vSparse[h.index];
+				uint32_t nLast = uint32_t(size() - 1);
+
+				if (nDense != nLast) {
+					uint32_t nMovedIndex = m_vDenseToIndex[nLast];
+					m_vDenseToIndex[nDense] = nMovedIndex;
+					m_vSparse[nMovedIndex] = nDense;
+
+					px[nDense] = px[nLast]; py[nDense] = py[nLast]; pz[nDense] = pz[nLast];
+					vx[nDense] = vx[nLast]; vy[nDense] = vy[nLast]; vz[nDense] = vz[nLast];
+
+					if (m_dirty.test(nLast)) m_dirty.set(nDense);
+					else m_dirty.reset(nDense);
+				}
+
+				for (auto& col : m_vColumns) {
+					if (col) col->swap_remove(nDense);
+				}
+
+				m_dirty.reset(nLast);
+				m_vDenseToIndex.pop_back();
+				px.pop_back(); py.pop_back(); pz.pop_back();
+				vx.pop_back(); vy.pop_back(); vz.pop_back();
+
+				// Bumping the generation invalidates every handle still pointing here
+				m_vGeneration[h.index]++;
+				m_vFree.push_back(h.index);
+				m_vDestroyed.push_back(h);
+				return true;
+			}
+
+			bool Alive(entity_handle h) const {
+				return h.index < m_vSparse.size() && m_vGeneration[h.index] == h.generation;
+			}
+
+			// Slot of a live entity in the dense columns. Only valid until the next Destroy().
+			size_t Dense(entity_handle h) const {
+				return m_vSparse[h.index];
+			}
+
+			entity_handle Handle(size_t nDense) const {
+				uint32_t index = m_vDenseToIndex[nDense];
+				return { index, m_vGeneration[index] };
+			}
+
+			// An extra column of any type, kept packed alongside the built in ones.
+			// Returned by reference, indexed the same way as px, py...
+			template <typename C>
+			std::vector<C>& Column() {
+				size_t nId = ColumnId<C>();
+				if (nId >= m_vColumns.size()) m_vColumns.resize(nId + 1);
+				if (!m_vColumns[nId]) {
+					auto col = std::make_unique<column<C>>();
+					col->data.resize(size());
+					m_vColumns[nId] = std::move(col);
+				}
+				return static_cast<column<C>*>(m_vColumns[nId].get())->data;
+			}
+
+			void MarkDirty(entity_handle h) {
+				if (Alive(h)) m_dirty.set(m_vSparse[h.index]);
+			}
+
+			// f(dense slot) for every entity changed since ClearDirty()
+			template <typename F>
+			void ForEachDirty(F&& f) const {
+				m_dirty.for_each(f);
+			}
+
+			// Entities destroyed since ClearDirty(), so clients can be told to remove them
+			const std::vector<entity_handle>& Destroyed() const {
+				return m_vDestroyed;
+			}
+
+			// Call once everything dirty has been sent
+			void ClearDirty() {
+				m_dirty.clear();
+				m_vDestroyed.clear();
+			}
+
+			// p += v * dt for every entity, marking everything that moved as dirty
+			void Integrate(float dt) {
+				size_t n = size();
+				size_t i = 0;
+
+#ifdef OLC_NET_X86
+				if (HasAVX2()) {
+					i = IntegrateAVX2(dt, n);
+				}
+				else {
+					i = IntegrateSSE(dt, n);
+				}
+#endif
+				IntegrateScalar(dt, i, n);
+			}
+
+		private:
+			struct column_base {
+				virtual ~column_base() = default;
+				virtual void push_default() = 0;
+				virtual void swap_remove(size_t i) = 0;
+			};
+
+			template <typename C>
+			struct column : public column_base {
+				std::vector<C> data;
+
+				void push_default() override {
+					data.emplace_back();
+				}
+
+				void swap_remove(size_t i) override {
+					if (i + 1 != data.size()) data[i] = std::move(data.back());
+					data.pop_back();
+				}
+			};
+
+			static size_t NextColumnId() {
+				static std::atomic<size_t> nIds = 0;
+				return nIds++;
+			}
+
+			template <typename C>
+			static size_t ColumnId() {
+				static const size_t nId = NextColumnId();
+				return nId;
+			}
+
+			void IntegrateScalar(float dt, size_t i, size_t n) {
+				for (; i < n; i++) {
+					if (vx[i] != 0.0f || vy[i] != 0.0f || vz[i] != 0.0f) {
+						px[i] += vx[i] * dt;
+						py[i] += vy[i] * dt;
+						pz[i] += vz[i] * dt;
+						m_dirty.set(i);
+					}
+				}
+			}
+
+#ifdef OLC_NET_X86
+			static bool HasAVX2() {
+				static const bool bAVX2 = []() {
+#ifdef _MSC_VER
+					int info[4];
+					__cpuid(info, 0);
+					if (info[0] < 7) return false;
+					__cpuid(info, 1);
+					bool bOSXSave = (info[2] & (1 << 27)) != 0;
+					if (!bOSXSave || (_xgetbv(0) & 0x6) != 0x6) return false;
+					__cpuidex(info, 7, 0);
+					return (info[1] & (1 << 5)) != 0;
+#else
+					return __builtin_cpu_supports("avx2") != 0;
+#endif
+				}();
+				return bAVX2;
+			}
+
+			// Both of these return how far they got; the scalar loop finishes the tail
+			size_t IntegrateSSE(float dt, size_t n) {
+				const __m128 vdt = _mm_set1_ps(dt);
+				const __m128 zero = _mm_setzero_ps();
+				size_t i = 0;
+				for (; i + 4 <= n; i += 4) {
+					__m128 x = _mm_load_ps(&vx[i]), y = _mm_load_ps(&vy[i]), z = _mm_load_ps(&vz[i]);
+					_mm_store_ps(&px[i], _mm_add_ps(_mm_load_ps(&px[i]), _mm_mul_ps(x, vdt)));
+					_mm_store_ps(&py[i], _mm_add_ps(_mm_load_ps(&py[i]), _mm_mul_ps(y, vdt)));
+					_mm_store_ps(&pz[i], _mm_add_ps(_mm_load_ps(&pz[i]), _mm_mul_ps(z, vdt)));
+
+					__m128 moved = _mm_or_ps(_mm_or_ps(_mm_cmpneq_ps(x, zero), _mm_cmpneq_ps(y, zero)), _mm_cmpneq_ps(z, zero));
+					m_dirty.merge(i, uint64_t(_mm_movemask_ps(moved)));
+				}
+				return i;
+			}
+
+			OLC_NET_TARGET_AVX2 size_t IntegrateAVX2(float dt, size_t n) {
+				const __m256 vdt = _mm256_set1_ps(dt);
+				const __m256 zero = _mm256_setzero_ps();
+				size_t i = 0;
+				for (; i + 8 <= n; i += 8) {
+					__m256 x = _mm256_load_ps(&vx[i]), y = _mm256_load_ps(&vy[i]), z = _mm256_load_ps(&vz[i]);
+					_mm256_store_ps(&px[i], _mm256_add_ps(_mm256_load_ps(&px[i]), _mm256_mul_ps(x, vdt)));
+					_mm256_store_ps(&py[i], _mm256_add_ps(_mm256_load_ps(&py[i]), _mm256_mul_ps(y, vdt)));
+					_mm256_store_ps(&pz[i], _mm256_add_ps(_mm256_load_ps(&pz[i]), _mm256_mul_ps(z, vdt)));
+
+					__m256 moved = _mm256_or_ps(_mm256_or_ps(
+						_mm256_cmp_ps(x, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(y, zero, _CMP_NEQ_UQ)), _mm256_cmp_ps(z, zero, _CMP_NEQ_UQ));
+					m_dirty.merge(i, uint64_t(_mm256_movemask_ps(moved)));
+				}
+				_mm256_zeroupper();
+				return i;
+			}
+#endif
+
+		private:
+			// handle index -> dense slot, and back again
+			std::vector<uint32_t> m_vSparse;
+			std::vector<uint32_t> m_vDenseToIndex;
+			std::vector<uint32_t> m_vGeneration;
+			std::vector<uint32_t> m_vFree;
+
+			std::vector<std::unique_ptr<column_base>> m_vColumns;
+
+			dirty_bitset m_dirty;
+			std::vector<entity_handle> m_vDestroyed;
+		};
+
+	}
+
+}
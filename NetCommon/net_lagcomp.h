@@ -0,0 +1,262 @@
+#pragma once
+#include "net_common.h"
+#include "net_entity_store.h"
+#include <cmath>
+
+/*
+	Lag compensation - checking a shot against the world the shooter actually saw.
+
+	A client's fire command describes a world that is RTT/2 plus the client's
+	interpolation delay old by the time it reaches us. lag_history keeps the last
+	few dozen ticks of entity positions so a hit test can be run against that
+	moment instead of the present:
+
+		history.Record(nTick, entities);							// end of every tick
+
+		double dTick = history.ShotTick(nTick, client->RoundTripTime(), interp, tickLength);
+		history.Rewind(dTick, ray, fHitRadius, vHits);				// per shot
+
+	Each recorded tick is a copy of the store's dense position columns, plus a map
+	from entity index to dense slot so the same entity can be found in the next
+	tick. Rewinding between two ticks interpolates, and the shot query only
+	interpolates the few entities whose bounding sphere could reach the ray - the
+	broad phase is one branch free pass over a contiguous column, cheap enough to
+	run hundreds of times a tick.
+
+	Entities that only appear in the later of the two ticks (spawned in between)
+	are not rewound, there is nowhere to rewind them from.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		// An entity's position at the rewound moment
+		struct rewound_entity {
+			entity_handle handle;
+			float x, y, z;
+			float fAlong;		// distance along the ray to the closest approach, shot queries only
+		};
+
+		// A shot from (ox, oy, oz) along the unit vector (dx, dy, dz)
+		struct shot_ray {
+			float ox, oy, oz;
+			float dx, dy, dz;
+			float fLength;
+		};
+
+
+		class lag_history {
+
+		public:
+			lag_history(size_t nTicks = 64) : m_vFrames(nTicks) {
+			}
+
+			// Copies the positions of every entity in the store as they are at nTick.
+			// Ticks are expected one after the other - a gap just means nothing can be
+			// rewound across it.
+			void Record(uint32_t nTick, const entity_store& store) {
+				frame& f = m_vFrames[nTick % m_vFrames.size()];
+				size_t n = store.size();
+
+				f.nTick = nTick;
+				f.bValid = true;
+				f.px.assign(store.px.begin(), store.px.end());
+				f.py.assign(store.py.begin(), store.py.end());
+				f.pz.assign(store.pz.begin(), store.pz.end());
+				f.vHandles.resize(n);
+				for (size_t i = 0; i < n; i++) {
+					entity_handle h = store.Handle(i);
+					f.vHandles[i] = h;
+					if (h.index >= f.vDenseOfIndex.size()) f.vDenseOfIndex.resize(h.index + 1);
+					f.vDenseOfIndex[h.index] = uint32_t(i);
+				}
+
+				// How far anything moved since the previous tick, which bounds how far an
+				// entity can be from its earlier position at any moment in between
+				f.fMaxStep = 0.0f;
+				const frame* pPrev = Find(nTick - 1);
+				if (pPrev) {
+					float fMaxStep2 = 0.0f;
+					for (size_t i = 0; i < n; i++) {
+						size_t j = pPrev->Lookup(f.vHandles[i]);
+						if (j == npos) continue;
+						float ex = f.px[i] - pPrev->px[j], ey = f.py[i] - pPrev->py[j], ez = f.pz[i] - pPrev->pz[j];
+						fMaxStep2 = std::max(fMaxStep2, ex * ex + ey * ey + ez * ez);
+					}
+					f.fMaxStep = std::sqrt(fMaxStep2);
+				}
+
+				if (!m_bAny || int32_t(nTick - m_nNewest) > 0) m_nNewest = nTick;
+				m_bAny = true;
+			}
+
+			bool Has(uint32_t nTick) const {
+				return Find(nTick) != nullptr;
+			}
+
+			uint32_t Newest() const {
+				return m_nNewest;
+			}
+
+			// Oldest tick that can still be rewound to, walking back from the newest
+			uint32_t Oldest() const {
+				uint32_t nTick = m_nNewest;
+				while (Has(nTick - 1) && m_nNewest - (nTick - 1) < m_vFrames.size()) nTick--;
+				return nTick;
+			}
+
+			// The (fractional) tick a client was looking at when it fired: half a round trip
+			// plus its interpolation delay behind nNow. Never further back than nMaxTicks,
+			// so a client can't claim an absurd ping to shoot at where people used to be.
+			double ShotTick(uint32_t nNow, std::chrono::nanoseconds rtt, std::chrono::nanoseconds interp,
+				std::chrono::nanoseconds tickLength, uint32_t nMaxTicks = 0xFFFFFFFF) const {
+				double dBack = (double(rtt.count()) / 2.0 + double(interp.count())) / double(tickLength.count());
+				dBack = std::min(dBack, double(std::min<uint64_t>(nMaxTicks, nNow - Oldest())));
+				return double(nNow) - std::max(dBack, 0.0);
+			}
+
+			// One entity, interpolated between the two ticks either side of dTick
+			bool Rewind(double dTick, entity_handle h, float& x, float& y, float& z) const {
+				const frame* pA;
+				const frame* pB;
+				float t;
+				if (!Bracket(dTick, pA, pB, t)) return false;
+
+				size_t i = pA->Lookup(h);
+				if (i == npos) return false;
+				Interpolate(*pA, i, pB, t, x, y, z);
+				return true;
+			}
+
+			// The whole world at dTick
+			size_t Rewind(double dTick, std::vector<rewound_entity>& vOut) const {
+				vOut.clear();
+				const frame* pA;
+				const frame* pB;
+				float t;
+				if (!Bracket(dTick, pA, pB, t)) return 0;
+
+				vOut.resize(pA->vHandles.size());
+				for (size_t i = 0; i < vOut.size(); i++) {
+					auto& e = vOut[i];
+					e.handle = pA->vHandles[i];
+					e.fAlong = 0.0f;
+					Interpolate(*pA, i, pB, t, e.x, e.y, e.z);
+				}
+				return vOut.size();
+			}
+
+			// Only the entities whose sphere of fRadius the ray passes through at dTick,
+			// nearest first - the candidates for an exact hit test
+			size_t Rewind(double dTick, const shot_ray& ray, float fRadius, std::vector<rewound_entity>& vOut) {
+				vOut.clear();
+				const frame* pA;
+				const frame* pB;
+				float t;
+				if (!Bracket(dTick, pA, pB, t)) return 0;
+
+				// Broad phase against the earlier tick, with the sphere grown by as far as
+				// anything could have moved towards the later one
+				const frame& a = *pA;
+				size_t n = a.vHandles.size();
+				float fReach = fRadius + (pB ? pB->fMaxStep * t : 0.0f);
+				float fReach2 = fReach * fReach;
+
+				m_vCandidates.resize(n);
+				uint32_t* pCandidates = m_vCandidates.data();
+				size_t nCandidates = 0;
+				const float* px = a.px.data();
+				const float* py = a.py.data();
+				const float* pz = a.pz.data();
+				for (size_t i = 0; i < n; i++) {
+					float rx = px[i] - ray.ox, ry = py[i] - ray.oy, rz = pz[i] - ray.oz;
+					float s = std::min(std::max(rx * ray.dx + ry * ray.dy + rz * ray.dz, 0.0f), ray.fLength);
+					float cx = rx - ray.dx * s, cy = ry - ray.dy * s, cz = rz - ray.dz * s;
+					pCandidates[nCandidates] = uint32_t(i);
+					nCandidates += (cx * cx + cy * cy + cz * cz <= fReach2) ? 1 : 0;
+				}
+
+				// Narrow phase - rewind just those, and test again properly
+				float fRadius2 = fRadius * fRadius;
+				for (size_t k = 0; k < nCandidates; k++) {
+					size_t i = pCandidates[k];
+					rewound_entity e;
+					e.handle = a.vHandles[i];
+					Interpolate(a, i, pB, t, e.x, e.y, e.z);
+
+					float rx = e.x - ray.ox, ry = e.y - ray.oy, rz = e.z - ray.oz;
+					float s = std::min(std::max(rx * ray.dx + ry * ray.dy + rz * ray.dz, 0.0f), ray.fLength);
+					float cx = rx - ray.dx * s, cy = ry - ray.dy * s, cz = rz - ray.dz * s;
+					if (cx * cx + cy * cy + cz * cz > fRadius2) continue;
+
+					e.fAlong = s;
+					vOut.push_back(e);
+				}
+
+				std::sort(vOut.begin(), vOut.end(), [](const rewound_entity& l, const rewound_entity& r) { return l.fAlong < r.fAlong; });
+				return vOut.size();
+			}
+
+		private:
+			static constexpr size_t npos = size_t(-1);
+
+			struct frame {
+				uint32_t nTick = 0;
+				bool bValid = false;
+				float_column px, py, pz;
+				std::vector<entity_handle> vHandles;
+				std::vector<uint32_t> vDenseOfIndex;	// stale entries are caught by the handle check
+				float fMaxStep = 0.0f;
+
+				size_t Lookup(entity_handle h) const {
+					if (h.index >= vDenseOfIndex.size()) return npos;
+					size_t i = vDenseOfIndex[h.index];
+					return i < vHandles.size() && vHandles[i] == h ? i : npos;
+				}
+			};
+
+			const frame* Find(uint32_t nTick) const {
+				const frame& f = m_vFrames[nTick % m_vFrames.size()];
+				return f.bValid && f.nTick == nTick ? &f : nullptr;
+			}
+
+			// The recorded ticks either side of dTick, and how far between them it is. pB
+			// is null when dTick falls exactly on a tick or the next one isn't there.
+			bool Bracket(double dTick, const frame*& pA, const frame*& pB, float& t) const {
+				if (!m_bAny || dTick < 0.0) return false;
+				double dFloor = std::floor(dTick);
+				pA = Find(uint32_t(dFloor));
+				if (!pA) return false;
+
+				t = float(dTick - dFloor);
+				pB = t > 0.0f ? Find(pA->nTick + 1) : nullptr;
+				if (!pB) t = 0.0f;
+				return true;
+			}
+
+			static void Interpolate(const frame& a, size_t i, const frame* pB, float t, float& x, float& y, float& z) {
+				x = a.px[i];
+				y = a.py[i];
+				z = a.pz[i];
+				if (!pB) return;
+
+				size_t j = pB->Lookup(a.vHandles[i]);
+				if (j == npos) return;
+				x += (pB->px[j] - x) * t;
+				y += (pB->py[j] - y) * t;
+				z += (pB->pz[j] - z) * t;
+			}
+
+		private:
+			std::vector<frame> m_vFrames;
+			uint32_t m_nNewest = 0;
+			bool m_bAny = false;
+
+			// Scratch for the shot query's broad phase
+			std::vector<uint32_t> m_vCandidates;
+		};
+
+	}
+
+}
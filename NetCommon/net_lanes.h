@@ -0,0 +1,263 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+
+/*
+	Outbound lanes - instead of one FIFO per connection, outgoing messages are
+	sorted into lanes by how urgent they are. A big guild roster on the bulk lane
+	should never hold up a combat update on the realtime lane.
+
+	Strict lanes (critical) always go first. The rest share the socket by weight
+	using deficit round robin, and messages bigger than a chunk are cut into
+	fragment frames, so nothing waits behind more than one chunk of them - not even
+	a big message on the realtime lane holds up the next small one for long.
+
+	Each lane has at most one message part way out, so the lane doubles as the
+	stream key the receiver sorts fragments by. A fragment_begin frame carrying
+	the total size (and the control code, if it is framework traffic) goes first,
+	which lets the receiver check the size against its limits and allocate once
+	before any of the body arrives.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		enum class lane : uint8_t {
+			critical = 0,	// framework traffic and anything that must jump the queue
+			realtime,		// the default - gameplay updates
+			bulk,			// large, latency tolerant transfers
+
+			count
+		};
+
+		struct lane_config {
+			// Strict lanes are always served before any weighted lane
+			bool bStrict = false;
+			// Share of the socket relative to the other weighted lanes, in chunks per round,
+			// at least 1
+			uint32_t nWeight = 1;
+			// Messages bigger than a chunk are split up on this lane
+			bool bChunked = true;
+		};
+
+		struct lane_policy {
+			lane_config lanes[size_t(lane::count)] = {
+				{ true,  1, true },		// critical
+				{ false, 4, true },		// realtime
+				{ false, 1, true }		// bulk
+			};
+
+			// Largest body a single fragment frame carries, at least 1
+			uint32_t nChunkSize = 16 * 1024;
+		};
+
+
+		// A frame waiting to be written. The message itself is shared so the replay
+		// ring can hold on to it without another copy, the header is our own since
+		// it carries this connection's sequence numbers.
+		template <typename T>
+		struct outbound_frame {
+			message_header<T> header;
+			std::shared_ptr<const message<T>> msg;
+		};
+
+
+		template <typename T>
+		class outbound_lanes {
+
+		public:
+			// What actually goes on the wire next - a whole message, or one chunk of one
+			struct wire_frame {
+				message_header<T> header;
+				const uint8_t* pBody = nullptr;
+			};
+
+		public:
+			outbound_lanes() = default;
+
+			void SetPolicy(const lane_policy& policy) {
+				m_policy = policy;
+
+				// A weighted lane that never earns anything, or chunks of nothing, would
+				// have Select() going round forever
+				m_policy.nChunkSize = std::max<uint32_t>(m_policy.nChunkSize, 1);
+				for (auto& config : m_policy.lanes) config.nWeight = std::max<uint32_t>(config.nWeight, 1);
+			}
+
+			void push_back(lane l, outbound_frame<T> frame) {
+				m_nBytes.fetch_add(sizeof(message_header<T>) + frame.header.size, std::memory_order_relaxed);
+				m_lanes[size_t(l)].deqFrames.push_back(std::move(frame));
+			}
+
+			// Jumps the queue on its lane, but never in front of a half sent message
+			void push_front(lane l, outbound_frame<T> frame) {
+				m_nBytes.fetch_add(sizeof(message_header<T>) + frame.header.size, std::memory_order_relaxed);
+				auto& ln = m_lanes[size_t(l)];
+				if (ln.nOffset > 0 || ln.bAnnounced || (m_bSelected && m_nSelected == size_t(l))) {
+					ln.deqFrames.insert(ln.deqFrames.begin() + 1, std::move(frame));
+				}
+				else {
+					ln.deqFrames.push_front(std::move(frame));
+				}
+			}
+
+			bool empty() const {
+				for (auto& ln : m_lanes) {
+					if (!ln.deqFrames.empty()) return false;
+				}
+				return true;
+			}
+
+			size_t count() const {
+				size_t n = 0;
+				for (auto& ln : m_lanes) n += ln.deqFrames.size();
+				return n;
+			}
+
+			// Bytes still to go out, one header per message plus bodies. Unlike everything
+			// else here it may be read from any thread.
+			size_t bytes() const {
+				return m_nBytes.load(std::memory_order_relaxed);
+			}
+
+			// The frame to write next. Stays the same until Complete() is called, so the
+			// header and body pointers are stable for the duration of the async write.
+			wire_frame& front() {
+				if (!m_bSelected) Select();
+				return m_wire;
+			}
+
+			// The frame from front() has been written
+			void Complete() {
+				auto& ln = m_lanes[m_nSelected];
+
+				if (m_wire.header.control == control_code::fragment_begin) {
+					// Overhead of its own, not part of what bytes() counts
+					ln.bAnnounced = true;
+				}
+				else if (m_wire.header.control == control_code::fragment) {
+					ln.nOffset += m_wire.header.size;
+					m_nBytes.fetch_sub(m_wire.header.size, std::memory_order_relaxed);
+				}
+				else {
+					ln.nOffset = 0;
+					ln.bAnnounced = false;
+					ln.deqFrames.pop_front();
+					m_nBytes.fetch_sub(sizeof(message_header<T>) + m_wire.header.size, std::memory_order_relaxed);
+				}
+
+				m_bSelected = false;
+			}
+
+			void clear() {
+				for (auto& ln : m_lanes) {
+					ln.deqFrames.clear();
+					ln.nOffset = 0;
+					ln.bAnnounced = false;
+					ln.nDeficit = 0;
+				}
+				m_bSelected = false;
+				m_nBytes = 0;
+			}
+
+		private:
+			struct lane_state {
+				std::deque<outbound_frame<T>> deqFrames;
+				uint32_t nOffset = 0;		// how much of the front message's body has gone out as fragments
+				bool bAnnounced = false;	// its fragment_begin has gone out
+				fragment_info info;			// body of the fragment_begin frame
+				size_t nDeficit = 0;		// bytes this lane may still send in the current round
+			};
+
+			bool IsChunked(size_t l, const outbound_frame<T>& frame) const {
+				return m_policy.lanes[l].bChunked && frame.header.size > m_policy.nChunkSize;
+			}
+
+			// Bytes the next frame from this lane will put on the wire
+			size_t NextCost(size_t l) const {
+				auto& ln = m_lanes[l];
+				auto& frame = ln.deqFrames.front();
+				if (!IsChunked(l, frame)) return sizeof(message_header<T>) + frame.header.size;
+				if (!ln.bAnnounced) return sizeof(message_header<T>) + sizeof(fragment_info);
+				return sizeof(message_header<T>) + std::min<size_t>(m_policy.nChunkSize, frame.header.size - ln.nOffset);
+			}
+
+			void Select() {
+				size_t l = size_t(lane::count);
+
+				// Strict lanes in order of declaration
+				for (size_t i = 0; i < size_t(lane::count) && l == size_t(lane::count); i++) {
+					if (m_policy.lanes[i].bStrict && !m_lanes[i].deqFrames.empty()) l = i;
+				}
+
+				// Otherwise deficit round robin over the weighted lanes. Each lane earns
+				// nWeight chunks worth of bytes per visit and keeps the turn while it can
+				// afford its next frame. The caller guarantees something is queued.
+				while (l == size_t(lane::count)) {
+					auto& ln = m_lanes[m_nTurn];
+					if (!m_policy.lanes[m_nTurn].bStrict && !ln.deqFrames.empty()) {
+						if (!m_bTurnCharged) {
+							ln.nDeficit += size_t(m_policy.lanes[m_nTurn].nWeight) * m_policy.nChunkSize;
+							m_bTurnCharged = true;
+						}
+
+						size_t nCost = NextCost(m_nTurn);
+						if (nCost <= ln.nDeficit) {
+							ln.nDeficit -= nCost;
+							l = m_nTurn;
+							break;
+						}
+					}
+					else {
+						// an idle lane doesn't get to save up
+						ln.nDeficit = 0;
+					}
+
+					m_nTurn = (m_nTurn + 1) % size_t(lane::count);
+					m_bTurnCharged = false;
+				}
+
+				auto& ln = m_lanes[l];
+				auto& frame = ln.deqFrames.front();
+
+				m_wire.header = frame.header;
+				m_wire.pBody = frame.msg->body.data();
+
+				if (IsChunked(l, frame) && !ln.bAnnounced) {
+					ln.info.nTotal = frame.header.size;
+					ln.info.control = frame.header.control;
+					m_wire.header.size = sizeof(fragment_info);
+					m_wire.header.control = control_code::fragment_begin;
+					m_wire.header.stream = uint8_t(l);
+					m_wire.pBody = reinterpret_cast<const uint8_t*>(&ln.info);
+				}
+				else if (IsChunked(l, frame)) {
+					uint32_t nLen = std::min(m_policy.nChunkSize, frame.header.size - ln.nOffset);
+					m_wire.header.size = nLen;
+					m_wire.header.control = (ln.nOffset + nLen == frame.header.size) ? control_code::fragment_end : control_code::fragment;
+					m_wire.header.stream = uint8_t(l);
+					m_wire.pBody += ln.nOffset;
+				}
+
+				m_nSelected = l;
+				m_bSelected = true;
+			}
+
+		private:
+			lane_policy m_policy;
+			lane_state m_lanes[size_t(lane::count)];
+
+			size_t m_nTurn = 0;
+			bool m_bTurnCharged = false;
+
+			wire_frame m_wire;
+			size_t m_nSelected = 0;
+			bool m_bSelected = false;
+
+			std::atomic<size_t> m_nBytes = 0;
+		};
+
+	}
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "net_common.h"
+#include "net_log.h"
+#include "net_trace.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
+
+/*
+	Low latency mode, for servers where the tail of the latency distribution
+	matters more than the CPU it costs to shorten it. Off by default - everything
+	below trades a whole core (or two) for shaving off wake-ups and scheduling.
+
+		nIoCore / nUpdateCore	pin the asio thread, and whichever thread calls Update(),
+								to a core each, so they keep their caches and never wait
+								behind something else the scheduler put there
+		bSpin					poll() the io_context in a loop instead of sleeping in
+								run() - no wake-up latency, but the core is always busy
+		bNoDelay				TCP_NODELAY. Without it a header and body written one after
+								the other can sit behind a delayed ACK for tens of ms.
+		nBusyPollMicros			SO_BUSY_POLL (Linux) - a blocking receive polls the
+								device queue for this long before sleeping. Raising it
+								above net.core.busy_poll needs CAP_NET_ADMIN.
+
+	Give the pinned cores to the server alone (isolcpus or a cpuset) or pinning just
+	moves the contention somewhere else. Spinning on a machine with fewer cores than
+	spinning threads makes everything slower, not faster.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		struct latency_profile {
+			int nIoCore = -1;			// -1 leaves it to the OS
+			int nUpdateCore = -1;
+			bool bSpin = false;
+			bool bNoDelay = false;
+			int nBusyPollMicros = 0;
+
+			// The settings an arena shard would start from
+			static latency_profile LowLatency(int nIoCore, int nUpdateCore) {
+				latency_profile p;
+				p.nIoCore = nIoCore;
+				p.nUpdateCore = nUpdateCore;
+				p.bSpin = true;
+				p.bNoDelay = true;
+				p.nBusyPollMicros = 50;
+				return p;
+			}
+		};
+
+
+		inline bool PinThisThread(int nCore) {
+			if (nCore < 0) return true;
+
+#if defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(nCore, &set);
+			bool bPinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+			bool bPinned = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << nCore) != 0;
+#else
+			bool bPinned = false;
+#endif
+			if (!bPinned) LogWarn("[LATENCY] Could not pin thread to core {}", nCore);
+			return bPinned;
+		}
+
+		inline void ApplySocketOptions(asio::ip::tcp::socket& socket, const latency_profile& profile) {
+			asio::error_code ec;
+			if (profile.bNoDelay) {
+				socket.set_option(asio::ip::tcp::no_delay(true), ec);
+				if (ec) LogWarn("[LATENCY] TCP_NODELAY failed: {}", ec.message());
+			}
+
+#ifdef __linux__
+			if (profile.nBusyPollMicros > 0) {
+				int nMicros = profile.nBusyPollMicros;
+				if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &nMicros, sizeof(nMicros)) != 0) {
+					LogDebug("[LATENCY] SO_BUSY_POLL not available: {}", std::strerror(errno));
+				}
+			}
+#endif
+		}
+
+		// The body of an asio thread. Returns when the context is stopped or runs out of
+		// work, exactly like run() - poll() stops the context itself once nothing is left.
+		inline void RunContext(asio::io_context& context, const latency_profile& profile) {
+			PinThisThread(profile.nIoCore);
+			TraceThreadName("net_io");
+
+			if (!profile.bSpin) {
+				context.run();
+				return;
+			}
+
+			while (!context.stopped()) {
+				context.poll();
+			}
+		}
+
+	}
+
+}
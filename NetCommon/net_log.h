@@ -0,0 +1,512 @@
+#pragma once
+#include "net_common.h"
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+/*
+	Logging that is cheap enough for the I/O thread. A call such as
+
+		LogWarn("[{}] Read Header Fail: {}", id, ec);
+
+	only copies the format string's address and the raw arguments into a fixed size
+	record in a ring belonging to the calling thread - no formatting, no locks, no
+	allocation. A background thread picks the records up, turns them into text and
+	writes them out.
+
+	- Levels below OLC_NET_LOG_LEVEL are compiled out entirely. Define it before
+	  including any of this to change it (0 trace, 1 debug, 2 info, 3 warn, 4 error,
+	  5 nothing). SetLevel() filters further at runtime.
+	- Each call site may log at most SetRateLimit() times a second per thread, the
+	  rest are counted and the count is reported with the next one that gets through.
+	  A connect storm produces a handful of lines, not a few thousand.
+	- A full ring drops the record and counts it. The I/O thread never waits for
+	  the log.
+
+	Format strings must be string literals - only their address is kept. "{}" is
+	replaced by the next argument. Integers, floats, bools, enums, strings (up to
+	MaxText bytes in total, the rest is cut off), std::error_code and tcp endpoints
+	can be logged.
+*/
+
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL 2
+#endif
+
+namespace olc {
+
+	namespace net {
+
+		enum class log_level : uint8_t {
+			trace,
+			debug,
+			info,
+			warn,
+			error,
+			off
+		};
+
+		inline const char* to_string(log_level l) {
+			switch (l) {
+			case log_level::trace:	return "TRACE";
+			case log_level::debug:	return "DEBUG";
+			case log_level::info:	return "INFO";
+			case log_level::warn:	return "WARN";
+			case log_level::error:	return "ERROR";
+			default:				return "";
+			}
+		}
+
+
+		// One argument as it was at the call site, turned into text later
+		struct log_arg {
+			enum class kind : uint8_t { sint, uint, real, boolean, text, error, endpoint4 };
+
+			kind k;
+			union {
+				int64_t i;
+				uint64_t u;
+				double d;
+				struct { uint16_t nOffset, nLength; } s;					// into log_record::text
+				struct { int nValue; const std::error_category* pCategory; } e;
+			};
+		};
+
+		struct log_record {
+			static constexpr size_t MaxArgs = 6;
+			static constexpr size_t MaxText = 96;
+
+			std::chrono::steady_clock::time_point tp;
+			const char* sFormat;
+			log_level level;
+			uint8_t nArgs;
+			uint16_t nText;
+			uint32_t nSuppressed;		// from the same call site since the last one
+			log_arg args[MaxArgs];
+			char text[MaxText];
+		};
+
+
+		// Single producer (the owning thread), single consumer (whoever holds the
+		// logger's drain lock)
+		class log_ring {
+
+		public:
+			static constexpr size_t Capacity = 1024;
+
+			bool Push(const log_record& r) {
+				size_t nWrite = m_nWrite.load(std::memory_order_relaxed);
+				if (nWrite - m_nRead.load(std::memory_order_acquire) == Capacity) {
+					m_nDropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				m_records[nWrite % Capacity] = r;
+				m_nWrite.store(nWrite + 1, std::memory_order_release);
+				return true;
+			}
+
+			template <typename F>
+			size_t Drain(F&& f) {
+				size_t nRead = m_nRead.load(std::memory_order_relaxed);
+				size_t nWrite = m_nWrite.load(std::memory_order_acquire);
+				for (size_t i = nRead; i < nWrite; i++) f(m_records[i % Capacity]);
+				m_nRead.store(nWrite, std::memory_order_release);
+				return nWrite - nRead;
+			}
+
+			uint64_t TakeDropped() {
+				return m_nDropped.exchange(0, std::memory_order_relaxed);
+			}
+
+			std::atomic<bool> bAbandoned = false;	// its thread has exited
+
+		private:
+			alignas(64) std::atomic<size_t> m_nWrite = 0;
+			alignas(64) std::atomic<size_t> m_nRead = 0;
+			std::atomic<uint64_t> m_nDropped = 0;
+			log_record m_records[Capacity];
+		};
+
+
+		class net_log {
+
+		public:
+			static net_log& Get() {
+				static net_log log;
+				return log;
+			}
+
+			~net_log() {
+				{
+					std::scoped_lock lock(m_muxWake);
+					m_bStop = true;
+				}
+				m_cvWake.notify_one();
+				if (m_thread.joinable()) m_thread.join();
+				Flush();
+				if (m_pFile && m_bOwnFile) std::fclose(m_pFile);
+			}
+
+			// Anything below this is ignored (on top of OLC_NET_LOG_LEVEL)
+			void SetLevel(log_level l) {
+				m_level = l;
+			}
+
+			bool Enabled(log_level l) const {
+				return l >= m_level.load(std::memory_order_relaxed);
+			}
+
+			// Most lines one call site can log per second on one thread, 0 for no limit
+			void SetRateLimit(uint32_t nPerSecond) {
+				m_nRateLimit = nPerSecond;
+			}
+
+			uint32_t RateLimit() const {
+				return m_nRateLimit.load(std::memory_order_relaxed);
+			}
+
+			// Where the lines go, stdout to begin with
+			void SetOutput(std::FILE* pFile) {
+				std::scoped_lock lock(m_muxDrain);
+				if (m_pFile && m_bOwnFile) std::fclose(m_pFile);
+				m_pFile = pFile;
+				m_bOwnFile = false;
+			}
+
+			bool SetOutputFile(const std::string& sPath) {
+				std::FILE* pFile = std::fopen(sPath.c_str(), "a");
+				if (!pFile) return false;
+				std::scoped_lock lock(m_muxDrain);
+				if (m_pFile && m_bOwnFile) std::fclose(m_pFile);
+				m_pFile = pFile;
+				m_bOwnFile = true;
+				return true;
+			}
+
+			// Prefix each line with seconds since start and the level
+			void SetTimestamps(bool bTimestamps) {
+				m_bTimestamps = bTimestamps;
+			}
+
+			// Records lost to full rings since the start
+			uint64_t Dropped() const {
+				return m_nDroppedTotal;
+			}
+
+			void Push(const log_record& r) {
+				Local().Push(r);
+				if (!m_bStarted.load(std::memory_order_relaxed)) Start();
+			}
+
+			// Writes out everything logged so far. Blocks, so not for the I/O thread.
+			void Flush() {
+				std::scoped_lock lock(m_muxDrain);
+				Drain();
+			}
+
+			// Whether an error can be logged as just its category and value. The category
+			// has to still be there when the line is written, which at exit it might not
+			// be - so the first time each one turns up, a flush is registered to run at
+			// exit. The category was made before that, so it is destroyed after it. False
+			// once that flush has run, or if there are too many categories to keep track of.
+			bool KeepCategory(const std::error_category& category) {
+				if (m_bExiting.load(std::memory_order_relaxed)) return false;
+				for (auto& slot : m_aCategories) {
+					const std::error_category* p = slot.load(std::memory_order_acquire);
+					if (p == nullptr && slot.compare_exchange_strong(p, &category)) {
+						std::atexit([]() { Get().ExitFlush(); });
+						return true;
+					}
+					if (p == &category) return true;
+				}
+				return false;
+			}
+
+		private:
+			net_log() : m_tpStart(std::chrono::steady_clock::now()) {
+			}
+
+			void ExitFlush() {
+				m_bExiting = true;
+				Flush();
+			}
+
+			// The calling thread's ring, made on first use. The logger keeps it after the
+			// thread exits until whatever was left in it has been written.
+			log_ring& Local() {
+				struct holder {
+					std::shared_ptr<log_ring> p;
+					~holder() { if (p) p->bAbandoned = true; }
+				};
+				thread_local holder h;
+				if (!h.p) {
+					h.p = std::make_shared<log_ring>();
+					std::scoped_lock lock(m_muxRings);
+					m_vRings.push_back(h.p);
+				}
+				return *h.p;
+			}
+
+			void Start() {
+				std::scoped_lock lock(m_muxWake);
+				if (m_bStarted || m_bStop) return;
+				m_bStarted = true;
+				m_thread = std::thread([this]() {
+					std::unique_lock lock(m_muxWake);
+					while (!m_bStop) {
+						lock.unlock();
+						Flush();
+						lock.lock();
+						m_cvWake.wait_for(lock, std::chrono::milliseconds(10));
+					}
+				});
+			}
+
+			// m_muxDrain held
+			void Drain() {
+				std::vector<std::shared_ptr<log_ring>> vRings;
+				{
+					std::scoped_lock lock(m_muxRings);
+					vRings = m_vRings;
+				}
+
+				m_vPending.clear();
+				uint64_t nDropped = 0;
+				for (auto& pRing : vRings) {
+					bool bAbandoned = pRing->bAbandoned;
+					pRing->Drain([this](const log_record& r) { m_vPending.push_back(r); });
+					nDropped += pRing->TakeDropped();
+
+					if (bAbandoned) {
+						std::scoped_lock lock(m_muxRings);
+						m_vRings.erase(std::remove(m_vRings.begin(), m_vRings.end(), pRing), m_vRings.end());
+					}
+				}
+
+				// Rings are in order on their own, this puts the threads back together
+				std::stable_sort(m_vPending.begin(), m_vPending.end(),
+					[](const log_record& a, const log_record& b) { return a.tp < b.tp; });
+
+				if (!m_pFile) m_pFile = stdout;
+				for (auto& r : m_vPending) {
+					Format(r, m_sLine);
+					std::fwrite(m_sLine.data(), 1, m_sLine.size(), m_pFile);
+				}
+				if (nDropped > 0) {
+					m_nDroppedTotal += nDropped;
+					std::fprintf(m_pFile, "[LOG] %llu lines dropped, the log could not keep up\n", (unsigned long long)nDropped);
+				}
+				if (!m_vPending.empty() || nDropped > 0) std::fflush(m_pFile);
+			}
+
+			void Format(const log_record& r, std::string& s) {
+				s.clear();
+				if (m_bTimestamps) {
+					char sPrefix[32];
+					double dSeconds = std::chrono::duration<double>(r.tp - m_tpStart).count();
+					std::snprintf(sPrefix, sizeof(sPrefix), "%10.6f %-5s ", dSeconds, to_string(r.level));
+					s += sPrefix;
+				}
+
+				size_t nArg = 0;
+				for (const char* p = r.sFormat; *p; p++) {
+					if (p[0] == '{' && p[1] == '}') {
+						if (nArg < r.nArgs) AppendArg(r, r.args[nArg++], s);
+						p++;
+					}
+					else {
+						s += *p;
+					}
+				}
+
+				if (r.nSuppressed > 0) s += " (+" + std::to_string(r.nSuppressed) + " similar suppressed)";
+				s += '\n';
+			}
+
+			static void AppendArg(const log_record& r, const log_arg& a, std::string& s) {
+				switch (a.k) {
+				case log_arg::kind::sint:		s += std::to_string(a.i); break;
+				case log_arg::kind::uint:		s += std::to_string(a.u); break;
+				case log_arg::kind::real: {
+					char sNumber[32];
+					std::snprintf(sNumber, sizeof(sNumber), "%g", a.d);
+					s += sNumber;
+				}
+				break;
+				case log_arg::kind::boolean:	s += a.u ? "true" : "false"; break;
+				case log_arg::kind::text:		s.append(r.text + a.s.nOffset, a.s.nLength); break;
+				case log_arg::kind::error:		s += a.e.pCategory->message(a.e.nValue); break;
+				case log_arg::kind::endpoint4:
+					s += std::to_string((a.u >> 40) & 0xFF) + "." + std::to_string((a.u >> 32) & 0xFF) + "." +
+						std::to_string((a.u >> 24) & 0xFF) + "." + std::to_string((a.u >> 16) & 0xFF) + ":" +
+						std::to_string(a.u & 0xFFFF);
+					break;
+				}
+			}
+
+		private:
+			std::chrono::steady_clock::time_point m_tpStart;
+			std::atomic<log_level> m_level = log_level::trace;
+			std::atomic<uint32_t> m_nRateLimit = 20;
+			std::atomic<bool> m_bTimestamps = false;
+			std::atomic<uint64_t> m_nDroppedTotal = 0;
+
+			std::array<std::atomic<const std::error_category*>, 16> m_aCategories{};
+			std::atomic<bool> m_bExiting = false;
+
+			std::mutex m_muxRings;
+			std::vector<std::shared_ptr<log_ring>> m_vRings;
+
+			// Only one drain at a time, the background thread or a Flush()
+			std::mutex m_muxDrain;
+			std::vector<log_record> m_vPending;
+			std::string m_sLine;
+			std::FILE* m_pFile = nullptr;
+			bool m_bOwnFile = false;
+
+			std::mutex m_muxWake;
+			std::condition_variable m_cvWake;
+			std::atomic<bool> m_bStarted = false;
+			bool m_bStop = false;
+			std::thread m_thread;
+		};
+
+
+		namespace detail {
+
+			// Copies one argument into the record, however it needs storing
+			inline void LogText(log_record& r, log_arg& a, std::string_view sv) {
+				size_t n = std::min(sv.size(), log_record::MaxText - r.nText);
+				std::memcpy(r.text + r.nText, sv.data(), n);
+				a.k = log_arg::kind::text;
+				a.s.nOffset = r.nText;
+				a.s.nLength = uint16_t(n);
+				r.nText = uint16_t(r.nText + n);
+			}
+
+			template <typename A>
+			void LogCapture(log_record& r, const A& value) {
+				if (r.nArgs == log_record::MaxArgs) return;
+				log_arg& a = r.args[r.nArgs++];
+
+				if constexpr (std::is_same_v<A, bool>) {
+					a.k = log_arg::kind::boolean;
+					a.u = value ? 1 : 0;
+				}
+				else if constexpr (std::is_enum_v<A>) {
+					a.k = log_arg::kind::sint;
+					a.i = int64_t(value);
+				}
+				else if constexpr (std::is_integral_v<A> && std::is_signed_v<A>) {
+					a.k = log_arg::kind::sint;
+					a.i = value;
+				}
+				else if constexpr (std::is_integral_v<A>) {
+					a.k = log_arg::kind::uint;
+					a.u = value;
+				}
+				else if constexpr (std::is_floating_point_v<A>) {
+					a.k = log_arg::kind::real;
+					a.d = value;
+				}
+				else if constexpr (std::is_convertible_v<const A&, std::string_view>) {
+					LogText(r, a, std::string_view(value));
+				}
+				else if constexpr (std::is_same_v<A, std::error_code>) {
+					if (net_log::Get().KeepCategory(value.category())) {
+						a.k = log_arg::kind::error;
+						a.e.nValue = value.value();
+						a.e.pCategory = &value.category();
+					}
+					else {
+						// Too late to trust the category will be around, so the text now
+						LogText(r, a, value.message());
+					}
+				}
+				else if constexpr (std::is_same_v<A, asio::ip::tcp::endpoint>) {
+					if (value.address().is_v4()) {
+						a.k = log_arg::kind::endpoint4;
+						a.u = (uint64_t(value.address().to_v4().to_uint()) << 16) | value.port();
+					}
+					else {
+						LogText(r, a, value.address().to_string() + ":" + std::to_string(value.port()));
+					}
+				}
+				else {
+					static_assert(sizeof(A) == 0, "type can't be logged");
+				}
+			}
+
+			// Per call site, per thread. Returns false if this one should be suppressed,
+			// otherwise how many were suppressed before it.
+			inline bool LogAllow(const char* sFormat, std::chrono::steady_clock::time_point tp, uint32_t& nSuppressed) {
+				uint32_t nLimit = net_log::Get().RateLimit();
+				if (nLimit == 0) {
+					nSuppressed = 0;
+					return true;
+				}
+
+				struct site {
+					std::chrono::steady_clock::time_point tpWindow;
+					uint32_t nCount = 0;
+					uint32_t nSuppressed = 0;
+				};
+				thread_local std::unordered_map<const char*, site> mapSites;
+
+				site& s = mapSites[sFormat];
+				if (tp - s.tpWindow >= std::chrono::seconds(1)) {
+					s.tpWindow = tp;
+					s.nCount = 0;
+				}
+				if (s.nCount >= nLimit) {
+					s.nSuppressed++;
+					return false;
+				}
+				s.nCount++;
+				nSuppressed = s.nSuppressed;
+				s.nSuppressed = 0;
+				return true;
+			}
+
+			template <log_level L, size_t N, typename... Args>
+			void Log(const char (&sFormat)[N], const Args&... args) {
+				if constexpr (int(L) >= OLC_NET_LOG_LEVEL) {
+					static_assert(sizeof...(Args) <= log_record::MaxArgs, "too many arguments to log");
+
+					net_log& log = net_log::Get();
+					if (!log.Enabled(L)) return;
+
+					log_record r;
+					r.tp = std::chrono::steady_clock::now();
+					if (!LogAllow(sFormat, r.tp, r.nSuppressed)) return;
+
+					r.sFormat = sFormat;
+					r.level = L;
+					r.nArgs = 0;
+					r.nText = 0;
+					(LogCapture(r, args), ...);
+					log.Push(r);
+				}
+			}
+
+		}
+
+		template <size_t N, typename... Args>
+		void LogTrace(const char (&sFormat)[N], const Args&... args) { detail::Log<log_level::trace>(sFormat, args...); }
+
+		template <size_t N, typename... Args>
+		void LogDebug(const char (&sFormat)[N], const Args&... args) { detail::Log<log_level::debug>(sFormat, args...); }
+
+		template <size_t N, typename... Args>
+		void LogInfo(const char (&sFormat)[N], const Args&... args) { detail::Log<log_level::info>(sFormat, args...); }
+
+		template <size_t N, typename... Args>
+		void LogWarn(const char (&sFormat)[N], const Args&... args) { detail::Log<log_level::warn>(sFormat, args...); }
+
+		template <size_t N, typename... Args>
+		void LogError(const char (&sFormat)[N], const Args&... args) { detail::Log<log_level::error>(sFormat, args...); }
+
+	}
+
+}
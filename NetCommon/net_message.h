@@ -10,6 +10,30 @@ namespace olc {
 			Mesage Header is sent at start of all messages. The template allows us
 			to use enum class to ensure that all messages are valid at compile time.
 		*/
+		/*
+			Control codes mark frames that belong to the framework rather than the
+			user. A header with control == none is an ordinary message and goes to
+			OnMessage, anything else is consumed by the connection / server itself.
+		*/
+		enum class control_code : uint8_t {
+			none = 0,
+			session_open,		// client -> server: token (0 = new session) + last sequence received
+			session_hello,		// server -> client: token, id, last sequence received, resumed flag
+			fragment,			// a chunk of a larger message, more to follow
+			fragment_end,		// the last chunk - the message is complete
+			cluster,			// server <-> server traffic inside a cluster, see net_cluster.h
+			time_sync,			// clock sample request or answer, see net_timesync.h
+			fragment_begin		// a larger message is on its way: its total size, chunks follow
+		};
+
+		// What an ordinary message is to the RPC layer, see net_rpc.h
+		enum class rpc_kind : uint8_t {
+			none = 0,
+			request,			// body ends with the call id
+			reply,				// body ends with the call id of the request it answers
+			error				// body is an rpc_status, then the call id
+		};
+
 		template <typename T>
 		struct message_header {
 			T id{};
@@ -17,13 +41,36 @@ namespace olc {
 			// Uint32 is always 32 bits 
 			// not in series, but things to think about is dif between x86 and Arm architecture because the byte ordering is different
 			uint32_t size = 0;
+
+			// Per-direction sequence number of this message (0 for control frames) and
+			// the highest sequence number the sender has received from us so far. These
+			// let a dropped session resume by replaying only what the other side missed.
+			uint32_t seq = 0;
+			uint32_t ack = 0;
+
+			control_code control = control_code::none;
+
+			// Which of the sender's streams a fragment belongs to (its lane), so chunks of
+			// messages on different lanes can arrive interleaved
+			uint8_t stream = 0;
+
+			rpc_kind rpc = rpc_kind::none;
+			uint8_t reserved = 0;
+		};
+
+		// Body of a fragment_begin frame
+		struct fragment_info {
+			uint32_t nTotal = 0;						// body size of the whole message
+			control_code control = control_code::none;	// what it is once put back together
+			uint8_t padding[3] = {};
 		};
 
 		template <typename T>
 		struct message {
 
 			message_header<T> header{};
-			std::vector<uint64_t> body;
+			// Raw bytes of the body - header.size is always body.size()
+			std::vector<uint8_t> body;
 
 
 			// Returns size of entire packet in bytes
@@ -58,7 +105,7 @@ namespace olc {
 				std::memcpy(msg.body.data() + i, &data, sizeof(DataType));
 
 				// recalculate the message size
-				msg.header.size = msg.size();
+				msg.header.size = uint32_t(msg.body.size());
 
 				return msg;
 
@@ -77,7 +124,8 @@ namespace olc {
 
 				static_assert(std::is_standard_layout<DataType>::value, "Data is too complex to be copied");
 
-				size_t i = msg.body.size();
+				// Cache the location towards the end of the vector where the pulled data starts
+				size_t i = msg.body.size() - sizeof(DataType);
 
 				// Take from end, treat it like a stack
 				std::memcpy(&data, msg.body.data() + i, sizeof(DataType));
@@ -85,7 +133,7 @@ namespace olc {
 				// Shrink the vector remove read bytes 
 				msg.body.resize(i);
 
-				msg.header.size = msg.size();
+				msg.header.size = uint32_t(msg.body.size());
 
 				return msg;
 			}
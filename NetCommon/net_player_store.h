@@ -0,0 +1,704 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+#include "net_log.h"
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <list>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+	Persistent player state that never makes the Update thread wait for a disk.
+
+		player_store store;
+		store.Open("players.db");
+
+		store.Put(nPlayer, msgState);		// OnClientDisconnect, every few minutes... returns at once
+		store.Get(nPlayer, msgState);		// from memory if it is there, otherwise one read
+
+	Put() only swaps the new value into a map of dirty records. A background thread
+	takes the whole map every flushInterval (sooner if nFlushBytes have piled up),
+	appends it to the log in one write and makes it durable with one fsync, however
+	many players were in it - a player saved ten times in between is written once.
+	Records go from there into a cache of recently used ones, so the state of anyone
+	online is normally served from memory.
+
+	On disk it is an append-only log:
+
+		store_file_header
+		record, record, record ...		each store_record_header + value
+
+	with a CRC on every record. Open() reads the log front to back to rebuild the
+	index (key -> where its latest value is); a crash part way through an append
+	leaves a torn record at the end, which fails its CRC and is cut off. Once most of
+	the log is old values the background thread writes the live ones to a new file
+	and swaps it in, which keeps both the file and the next recovery small.
+
+	Everything but Open() and Close() can be called from any thread.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		struct store_file_header {
+			char magic[8] = { 'O', 'L', 'C', 'S', 'T', 'O', 'R', '1' };
+		};
+
+		struct store_record_header {
+			static constexpr uint32_t Magic = 0x52505453;		// "STPR"
+			static constexpr uint32_t Erased = 1;
+
+			uint32_t nMagic = Magic;
+			uint32_t nCrc = 0;			// over everything after this field, value included
+			uint64_t nKey = 0;
+			uint32_t nSize = 0;			// of the value that follows
+			uint32_t nFlags = 0;
+		};
+
+		// CRC-32 (the zlib one), eight bytes at a time - recovery runs at the speed of
+		// this, so it is worth the bigger table
+		inline uint32_t crc32(const void* pData, size_t nBytes, uint32_t nCrc = 0) {
+			static const auto table = []() {
+				std::array<std::array<uint32_t, 256>, 8> t{};
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t c = i;
+					for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					t[0][i] = c;
+				}
+				for (uint32_t i = 0; i < 256; i++) {
+					for (int k = 1; k < 8; k++) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+				}
+				return t;
+			}();
+
+			auto p = static_cast<const uint8_t*>(pData);
+			nCrc = ~nCrc;
+			for (; nBytes >= 8; nBytes -= 8, p += 8) {
+				uint32_t a = nCrc ^ (uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24);
+				nCrc = table[7][a & 0xFF] ^ table[6][(a >> 8) & 0xFF] ^ table[5][(a >> 16) & 0xFF] ^ table[4][a >> 24] ^
+					table[3][p[4]] ^ table[2][p[5]] ^ table[1][p[6]] ^ table[0][p[7]];
+			}
+			for (; nBytes > 0; nBytes--, p++) nCrc = table[0][(nCrc ^ *p) & 0xFF] ^ (nCrc >> 8);
+			return ~nCrc;
+		}
+
+		struct player_store_options {
+			std::chrono::milliseconds flushInterval = std::chrono::milliseconds(100);	// longest a Put() waits to be written
+			size_t nFlushBytes = 4 * 1024 * 1024;		// write sooner once this much is dirty
+			size_t nCacheBytes = 64 * 1024 * 1024;		// clean values kept in memory
+			double dCompactRatio = 0.5;					// compact when this much of the log is dead...
+			size_t nCompactMinBytes = 64 * 1024 * 1024;	// ...and the log is at least this big
+		};
+
+		struct player_store_stats {
+			size_t nRecords = 0;			// live keys
+			uint64_t nLogBytes = 0;
+			uint64_t nLiveBytes = 0;		// the part of the log holding latest values
+			size_t nDirty = 0;				// waiting to be written
+			size_t nCached = 0;
+			uint64_t nFlushes = 0;			// batches written, one fsync each
+			uint64_t nRecordsWritten = 0;
+			uint64_t nCompactions = 0;
+			uint64_t nHits = 0;				// Get()s served from memory
+			uint64_t nMisses = 0;			// ...and from disk
+			size_t nRecovered = 0;			// records read back by Open()
+			double dRecoverySeconds = 0.0;
+			bool bTornTail = false;			// Open() found and cut off a partial record
+		};
+
+
+		class player_store {
+
+		public:
+			using key = uint64_t;
+			using value = std::shared_ptr<const std::vector<uint8_t>>;
+
+			player_store() = default;
+			player_store(const player_store&) = delete;
+
+			~player_store() {
+				Close();
+			}
+
+			// Opens the log at sPath, creating it if it isn't there, and rebuilds the index
+			// from it. Takes as long as reading the file once.
+			bool Open(const std::string& sPath, const player_store_options& options = {}) {
+				Close();
+				m_sPath = sPath;
+				m_options = options;
+				m_stats = {};
+
+				auto tpStart = std::chrono::steady_clock::now();
+				if (!Recover()) return false;
+				m_stats.dRecoverySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpStart).count();
+				if (!OpenFiles()) return false;
+
+				LogInfo("[STORE] {} opened: {} players, {} records read in {}s{}", sPath, m_mapIndex.size(),
+					m_stats.nRecovered, m_stats.dRecoverySeconds, m_stats.bTornTail ? ", torn record at the end cut off" : "");
+
+				m_bStop = false;
+				m_thread = std::thread([this]() { WriterThread(); });
+				return true;
+			}
+
+			// Writes out everything still dirty and closes the log
+			void Close() {
+				if (!m_thread.joinable()) return;
+				{
+					std::scoped_lock lock(m_mux);
+					m_bStop = true;
+				}
+				m_cvWork.notify_one();
+				m_thread.join();
+				CloseFiles();
+
+				m_mapIndex.clear();
+				m_mapDirty.clear();
+				m_mapCache.clear();
+				m_lstLru.clear();
+				m_nCacheBytes = 0;
+			}
+
+			// Saves v as key's state. Only copies it into memory - the write happens later.
+			void Put(key k, std::vector<uint8_t> v) {
+				Stage(k, std::make_shared<const std::vector<uint8_t>>(std::move(v)));
+			}
+
+			void Put(key k, const void* pData, size_t nBytes) {
+				auto p = static_cast<const uint8_t*>(pData);
+				Put(k, std::vector<uint8_t>(p, p + nBytes));
+			}
+
+			template <typename T>
+			void Put(key k, const message<T>& msg) {
+				Put(k, msg.body.data(), msg.body.size());
+			}
+
+			void Erase(key k) {
+				Stage(k, nullptr);
+			}
+
+			// The latest value for k, whether or not it has reached the disk yet. Reads the
+			// log if k isn't in memory - Prefetch() first where that matters.
+			bool Get(key k, std::vector<uint8_t>& vOut) {
+				value v = Find(k);
+				if (!v) return false;
+				vOut = *v;
+				return true;
+			}
+
+			template <typename T>
+			bool Get(key k, message<T>& msg) {
+				if (!Get(k, msg.body)) return false;
+				msg.header.size = uint32_t(msg.body.size());
+				return true;
+			}
+
+			// Shared and read only - no copy
+			value Find(key k) {
+				{
+					std::scoped_lock lock(m_mux);
+					if (auto* p = FindInMemory(k)) {
+						m_stats.nHits++;
+						return *p;
+					}
+					if (m_mapIndex.find(k) == m_mapIndex.end()) return nullptr;
+					m_stats.nMisses++;
+				}
+				return Load(k);
+			}
+
+			bool Contains(key k) {
+				std::scoped_lock lock(m_mux);
+				auto itDirty = m_mapDirty.find(k);
+				if (itDirty != m_mapDirty.end()) return itDirty->second != nullptr;
+				auto itFlushing = m_mapFlushing.find(k);
+				if (itFlushing != m_mapFlushing.end()) return itFlushing->second != nullptr;
+				return m_mapIndex.count(k) > 0;
+			}
+
+			// Has the background thread pull k into memory, e.g. as a player logs in, so a
+			// Get() a little later doesn't touch the disk
+			void Prefetch(key k) {
+				{
+					std::scoped_lock lock(m_mux);
+					if (FindInMemory(k) || m_mapIndex.find(k) == m_mapIndex.end()) return;
+					m_vPrefetch.push_back(k);
+				}
+				m_cvWork.notify_one();
+			}
+
+			// Blocks until everything Put() so far is on disk. Not for the Update thread.
+			void Flush() {
+				std::unique_lock lock(m_mux);
+				uint64_t nWanted = m_nStaged;
+				m_bFlushNow = true;
+				m_cvWork.notify_one();
+				m_cvDurable.wait(lock, [&]() { return m_nDurable >= nWanted || !m_thread.joinable(); });
+			}
+
+			player_store_stats Stats() {
+				std::scoped_lock lock(m_mux);
+				player_store_stats s = m_stats;
+				s.nRecords = m_mapIndex.size();
+				s.nLogBytes = m_nLogBytes;
+				s.nLiveBytes = m_nLiveBytes;
+				s.nDirty = m_mapDirty.size() + m_mapFlushing.size();
+				s.nCached = m_mapCache.size();
+				return s;
+			}
+
+		private:
+			struct index_entry {
+				uint64_t nOffset = 0;		// of the value, just past its record header
+				uint32_t nSize = 0;
+			};
+
+			struct cache_entry {
+				value v;
+				std::list<key>::iterator itLru;
+			};
+
+			void Stage(key k, value v) {
+				size_t nBytes = v ? v->size() : 0;
+				{
+					std::scoped_lock lock(m_mux);
+					auto& slot = m_mapDirty[k];
+					if (slot) m_nDirtyBytes -= slot->size();		// a value not yet written is simply replaced
+					m_nDirtyBytes += nBytes;
+					slot = std::move(v);
+					m_nStaged++;
+					if (m_nDirtyBytes < m_options.nFlushBytes) return;
+					m_bFlushNow = true;
+				}
+				m_cvWork.notify_one();
+			}
+
+			// m_mux held. Dirty first, then being written, then cached. An erased key is
+			// found too, as null, so it doesn't fall through to the disk.
+			const value* FindInMemory(key k) {
+				static const value erased;
+				auto itDirty = m_mapDirty.find(k);
+				if (itDirty != m_mapDirty.end()) return itDirty->second ? &itDirty->second : &erased;
+				auto itFlushing = m_mapFlushing.find(k);
+				if (itFlushing != m_mapFlushing.end()) return itFlushing->second ? &itFlushing->second : &erased;
+				auto itCache = m_mapCache.find(k);
+				if (itCache != m_mapCache.end()) {
+					m_lstLru.splice(m_lstLru.begin(), m_lstLru, itCache->second.itLru);
+					return &itCache->second.v;
+				}
+				return nullptr;
+			}
+
+			// Reads k's latest value from the log into the cache
+			value Load(key k) {
+				std::scoped_lock lockFile(m_muxFile);
+				for (;;) {
+					index_entry e;
+					{
+						std::scoped_lock lock(m_mux);
+						auto it = m_mapIndex.find(k);
+						if (it == m_mapIndex.end()) return nullptr;
+						e = it->second;
+					}
+
+					auto v = std::make_shared<std::vector<uint8_t>>(e.nSize);
+					if (!ReadAt(m_pRead, e.nOffset, v->data(), e.nSize)) {
+						LogError("[STORE] Read of {} failed", k);
+						return nullptr;
+					}
+
+					std::scoped_lock lock(m_mux);
+					// Something newer may have been put while we read, that one wins
+					if (auto* p = FindInMemory(k)) return *p;
+
+					// Or a batch may have been written since, erasing k or moving it on to
+					// a newer record - caching what we read would bring the old one back
+					auto it = m_mapIndex.find(k);
+					if (it == m_mapIndex.end()) return nullptr;
+					if (it->second.nOffset != e.nOffset) continue;
+
+					Cache(k, v);
+					return v;
+				}
+			}
+
+			// m_mux held
+			void Cache(key k, value v) {
+				if (!v || v->size() > m_options.nCacheBytes) return;
+				auto it = m_mapCache.find(k);
+				if (it != m_mapCache.end()) {
+					m_nCacheBytes -= it->second.v->size();
+					it->second.v = std::move(v);
+					m_lstLru.splice(m_lstLru.begin(), m_lstLru, it->second.itLru);
+					m_nCacheBytes += it->second.v->size();
+				}
+				else {
+					m_lstLru.push_front(k);
+					m_nCacheBytes += v->size();
+					m_mapCache[k] = { std::move(v), m_lstLru.begin() };
+				}
+
+				while (m_nCacheBytes > m_options.nCacheBytes && !m_lstLru.empty()) {
+					auto itOld = m_mapCache.find(m_lstLru.back());
+					m_nCacheBytes -= itOld->second.v->size();
+					m_mapCache.erase(itOld);
+					m_lstLru.pop_back();
+				}
+			}
+
+			void Uncache(key k) {
+				auto it = m_mapCache.find(k);
+				if (it == m_mapCache.end()) return;
+				m_nCacheBytes -= it->second.v->size();
+				m_lstLru.erase(it->second.itLru);
+				m_mapCache.erase(it);
+			}
+
+			void WriterThread() {
+				std::unique_lock lock(m_mux);
+				while (true) {
+					m_cvWork.wait_for(lock, m_options.flushInterval, [&]() { return m_bStop || m_bFlushNow || !m_vPrefetch.empty(); });
+
+					std::vector<key> vPrefetch;
+					vPrefetch.swap(m_vPrefetch);
+					if (!vPrefetch.empty()) {
+						lock.unlock();
+						for (key k : vPrefetch) Load(k);
+						lock.lock();
+					}
+
+					if (m_mapDirty.empty()) {
+						m_nDurable = m_nStaged;
+					}
+					else if (!WriteBatch(lock) && m_bStop) {
+						LogError("[STORE] Giving up on {} unwritten records", m_mapDirty.size());
+						m_mapDirty.clear();
+						m_nDurable = m_nStaged;
+					}
+					m_bFlushNow = false;
+					m_cvDurable.notify_all();
+
+					if (m_bStop && m_mapDirty.empty()) break;
+
+					if (m_nLogBytes >= m_options.nCompactMinBytes &&
+						double(m_nLogBytes - m_nLiveBytes) >= m_options.dCompactRatio * double(m_nLogBytes)) {
+						lock.unlock();
+						Compact();
+						lock.lock();
+					}
+				}
+			}
+
+			// Takes the dirty map, appends it in one write and one fsync, then moves it into
+			// the index and the cache. Called with m_mux held, which it lets go of for the I/O.
+			bool WriteBatch(std::unique_lock<std::mutex>& lock) {
+				m_mapFlushing.swap(m_mapDirty);
+				m_nDirtyBytes = 0;
+				uint64_t nStaged = m_nStaged;
+				uint64_t nBase = m_nLogBytes;
+				lock.unlock();
+
+				m_vBatch.clear();
+				std::vector<std::pair<key, index_entry>> vPlaced;
+				vPlaced.reserve(m_mapFlushing.size());
+				for (auto& [k, v] : m_mapFlushing) {
+					store_record_header h;
+					h.nKey = k;
+					h.nSize = v ? uint32_t(v->size()) : 0;
+					h.nFlags = v ? 0 : store_record_header::Erased;
+					size_t nAt = m_vBatch.size();
+					m_vBatch.resize(nAt + sizeof(h) + h.nSize);
+					if (h.nSize) std::memcpy(m_vBatch.data() + nAt + sizeof(h), v->data(), h.nSize);
+					std::memcpy(m_vBatch.data() + nAt, &h, sizeof(h));
+					h.nCrc = RecordCrc(m_vBatch.data() + nAt);
+					std::memcpy(m_vBatch.data() + nAt, &h, sizeof(h));
+					vPlaced.push_back({ k, { nBase + nAt + sizeof(h), h.nSize } });
+				}
+
+				bool bWritten = std::fwrite(m_vBatch.data(), 1, m_vBatch.size(), m_pAppend) == m_vBatch.size() &&
+					std::fflush(m_pAppend) == 0 && SyncFile(m_pAppend);
+
+				lock.lock();
+				if (!bWritten) {
+					// Put it all back unless something newer has arrived, cut off whatever
+					// part did make it out, and have another go next time
+					LogError("[STORE] Write of {} records failed: {}", m_mapFlushing.size(), std::strerror(errno));
+					for (auto& [k, v] : m_mapFlushing) {
+						if (m_mapDirty.try_emplace(k, std::move(v)).second && m_mapDirty[k]) m_nDirtyBytes += m_mapDirty[k]->size();
+					}
+					m_mapFlushing.clear();
+					lock.unlock();
+					{
+						std::scoped_lock lockFile(m_muxFile);
+						CloseFiles();
+						std::error_code ec;
+						std::filesystem::resize_file(m_sPath, nBase, ec);
+						OpenFiles();
+					}
+					lock.lock();
+					return false;
+				}
+
+				for (auto& [k, e] : vPlaced) {
+					auto itOld = m_mapIndex.find(k);
+					if (itOld != m_mapIndex.end()) {
+						m_nLiveBytes -= sizeof(store_record_header) + itOld->second.nSize;
+						m_mapIndex.erase(itOld);
+					}
+					auto& v = m_mapFlushing[k];
+					if (v) {
+						m_mapIndex[k] = e;
+						m_nLiveBytes += sizeof(store_record_header) + e.nSize;
+						Cache(k, std::move(v));
+					}
+					else {
+						Uncache(k);
+					}
+				}
+
+				m_nLogBytes = nBase + m_vBatch.size();
+				m_stats.nFlushes++;
+				m_stats.nRecordsWritten += vPlaced.size();
+				m_mapFlushing.clear();
+				m_nDurable = nStaged;
+				return true;
+			}
+
+			// Writes the live records to a new file and swaps it in. Runs on the writer
+			// thread, so nothing is appended meanwhile - Get()s carry on against the old file.
+			void Compact() {
+				std::vector<std::pair<key, index_entry>> vLive;
+				{
+					std::scoped_lock lock(m_mux);
+					vLive.assign(m_mapIndex.begin(), m_mapIndex.end());
+				}
+				std::sort(vLive.begin(), vLive.end(), [](const auto& a, const auto& b) { return a.second.nOffset < b.second.nOffset; });
+
+				std::string sTemp = m_sPath + ".compact";
+				std::FILE* pOld = std::fopen(m_sPath.c_str(), "rb");
+				std::FILE* pNew = std::fopen(sTemp.c_str(), "wb");
+				bool bOk = pOld && pNew;
+
+				store_file_header fh;
+				uint64_t nOffset = sizeof(fh);
+				bOk = bOk && std::fwrite(&fh, sizeof(fh), 1, pNew) == 1;
+
+				std::vector<uint8_t> vRecord;
+				for (auto& [k, e] : vLive) {
+					if (!bOk) break;
+					vRecord.resize(sizeof(store_record_header) + e.nSize);
+					bOk = ReadAt(pOld, e.nOffset - sizeof(store_record_header), vRecord.data(), vRecord.size()) &&
+						std::fwrite(vRecord.data(), 1, vRecord.size(), pNew) == vRecord.size();
+					e.nOffset = nOffset + sizeof(store_record_header);
+					nOffset += vRecord.size();
+				}
+				bOk = bOk && std::fflush(pNew) == 0 && SyncFile(pNew);
+				if (pOld) std::fclose(pOld);
+				if (pNew) std::fclose(pNew);
+
+				if (!bOk) {
+					LogError("[STORE] Compaction failed: {}", std::strerror(errno));
+					std::error_code ec;
+					std::filesystem::remove(sTemp, ec);
+					return;
+				}
+
+				std::scoped_lock lockFile(m_muxFile);
+				CloseFiles();
+				std::error_code ec;
+				std::filesystem::rename(sTemp, m_sPath, ec);
+				if (ec) LogError("[STORE] Could not replace {}: {}", m_sPath, ec.message());
+				else SyncDirectory();
+				OpenFiles();
+
+				if (!ec) {
+					std::scoped_lock lock(m_mux);
+					uint64_t nBefore = m_nLogBytes;
+					for (auto& [k, e] : vLive) m_mapIndex[k] = e;
+					m_nLogBytes = nOffset;
+					m_nLiveBytes = nOffset - sizeof(fh);
+					m_stats.nCompactions++;
+					LogInfo("[STORE] Compacted {} from {} to {} bytes", m_sPath, nBefore, nOffset);
+				}
+			}
+
+			// Reads the whole log, keeping the last record for each key. Stops at the first
+			// record that doesn't check out and cuts the file off there.
+			bool Recover() {
+				m_mapIndex.clear();
+				m_nLiveBytes = 0;
+
+				std::error_code ec;
+				if (!std::filesystem::exists(m_sPath, ec)) {
+					std::FILE* pFile = std::fopen(m_sPath.c_str(), "wb");
+					if (!pFile) {
+						LogError("[STORE] Could not create {}: {}", m_sPath, std::strerror(errno));
+						return false;
+					}
+					store_file_header fh;
+					bool bOk = std::fwrite(&fh, sizeof(fh), 1, pFile) == 1 && std::fflush(pFile) == 0 && SyncFile(pFile);
+					std::fclose(pFile);
+					m_nLogBytes = sizeof(fh);
+					return bOk;
+				}
+
+				std::FILE* pFile = std::fopen(m_sPath.c_str(), "rb");
+				if (!pFile) {
+					LogError("[STORE] Could not open {}: {}", m_sPath, std::strerror(errno));
+					return false;
+				}
+				std::vector<char> vBuffer(1 << 20);
+				std::setvbuf(pFile, vBuffer.data(), _IOFBF, vBuffer.size());
+
+				uint64_t nFileBytes = std::filesystem::file_size(m_sPath, ec);
+				store_file_header fh, expected;
+				if (std::fread(&fh, sizeof(fh), 1, pFile) != 1 || std::memcmp(fh.magic, expected.magic, sizeof(fh.magic)) != 0) {
+					std::fclose(pFile);
+					LogError("[STORE] {} is not a player store", m_sPath);
+					return false;
+				}
+
+				uint64_t nOffset = sizeof(fh);
+				std::vector<uint8_t> vRecord;
+				while (nOffset < nFileBytes) {
+					store_record_header h;
+					if (nFileBytes - nOffset < sizeof(h) || std::fread(&h, sizeof(h), 1, pFile) != 1) break;
+					if (h.nMagic != store_record_header::Magic || h.nSize > nFileBytes - nOffset - sizeof(h)) break;
+
+					vRecord.resize(sizeof(h) + h.nSize);
+					std::memcpy(vRecord.data(), &h, sizeof(h));
+					if (h.nSize && std::fread(vRecord.data() + sizeof(h), 1, h.nSize, pFile) != h.nSize) break;
+					if (RecordCrc(vRecord.data()) != h.nCrc) break;
+
+					auto it = m_mapIndex.find(h.nKey);
+					if (it != m_mapIndex.end()) {
+						m_nLiveBytes -= sizeof(h) + it->second.nSize;
+						m_mapIndex.erase(it);
+					}
+					if (!(h.nFlags & store_record_header::Erased)) {
+						m_mapIndex[h.nKey] = { nOffset + sizeof(h), h.nSize };
+						m_nLiveBytes += sizeof(h) + h.nSize;
+					}
+					nOffset += sizeof(h) + h.nSize;
+					m_stats.nRecovered++;
+				}
+				std::fclose(pFile);
+
+				if (nOffset < nFileBytes) {
+					// Whatever was being appended when we went down, which was never acknowledged
+					m_stats.bTornTail = true;
+					std::filesystem::resize_file(m_sPath, nOffset, ec);
+					if (ec) {
+						LogError("[STORE] Could not cut off the end of {}: {}", m_sPath, ec.message());
+						return false;
+					}
+				}
+				m_nLogBytes = nOffset;
+				return true;
+			}
+
+			bool OpenFiles() {
+				m_pAppend = std::fopen(m_sPath.c_str(), "ab");
+				m_pRead = std::fopen(m_sPath.c_str(), "rb");
+				if (!m_pAppend || !m_pRead) {
+					LogError("[STORE] Could not open {}: {}", m_sPath, std::strerror(errno));
+					CloseFiles();
+					return false;
+				}
+				return true;
+			}
+
+			void CloseFiles() {
+				if (m_pAppend) std::fclose(m_pAppend);
+				if (m_pRead) std::fclose(m_pRead);
+				m_pAppend = nullptr;
+				m_pRead = nullptr;
+			}
+
+			static bool ReadAt(std::FILE* pFile, uint64_t nOffset, void* pData, size_t nBytes) {
+				if (!pFile) return false;
+#ifdef _WIN32
+				if (_fseeki64(pFile, int64_t(nOffset), SEEK_SET) != 0) return false;
+#else
+				if (fseeko(pFile, off_t(nOffset), SEEK_SET) != 0) return false;
+#endif
+				return nBytes == 0 || std::fread(pData, 1, nBytes, pFile) == nBytes;
+			}
+
+			static bool SyncFile(std::FILE* pFile) {
+#ifdef _WIN32
+				return _commit(_fileno(pFile)) == 0;
+#elif defined(__linux__)
+				return fdatasync(fileno(pFile)) == 0;
+#else
+				return fsync(fileno(pFile)) == 0;
+#endif
+			}
+
+			// So the rename after a compaction survives a power cut too
+			void SyncDirectory() {
+#ifndef _WIN32
+				auto dir = std::filesystem::path(m_sPath).parent_path();
+				int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+				if (fd >= 0) {
+					if (fsync(fd) != 0) {}
+					::close(fd);
+				}
+#endif
+			}
+
+			// pRecord points at a record header followed by its value
+			static uint32_t RecordCrc(const uint8_t* pRecord) {
+				store_record_header h;
+				std::memcpy(&h, pRecord, sizeof(h));
+				size_t nSkip = offsetof(store_record_header, nKey);
+				return crc32(pRecord + nSkip, sizeof(h) - nSkip + h.nSize);
+			}
+
+		private:
+			std::string m_sPath;
+			player_store_options m_options;
+
+			std::thread m_thread;
+			std::mutex m_mux;
+			std::condition_variable m_cvWork;
+			std::condition_variable m_cvDurable;
+			bool m_bStop = false;
+			bool m_bFlushNow = false;
+
+			// Everything from here to m_stats is under m_mux
+			std::unordered_map<key, index_entry> m_mapIndex;
+			std::unordered_map<key, value> m_mapDirty;			// null for an erase
+			std::unordered_map<key, value> m_mapFlushing;		// the batch being written
+			size_t m_nDirtyBytes = 0;
+			uint64_t m_nStaged = 0;			// Put()s and Erase()s so far
+			uint64_t m_nDurable = 0;		// how many of them are on disk
+			std::unordered_map<key, cache_entry> m_mapCache;
+			std::list<key> m_lstLru;		// most recently used first
+			size_t m_nCacheBytes = 0;
+			std::vector<key> m_vPrefetch;
+			uint64_t m_nLogBytes = 0;
+			uint64_t m_nLiveBytes = 0;
+			player_store_stats m_stats;
+
+			// The files, and the lock that keeps reads off them while they are swapped
+			std::mutex m_muxFile;
+			std::FILE* m_pAppend = nullptr;
+			std::FILE* m_pRead = nullptr;
+			std::vector<uint8_t> m_vBatch;		// writer thread only
+		};
+
+	}
+
+}
@@ -0,0 +1,485 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+	Traffic recorder - appends every inbound message to a memory mapped log, so a
+	production session can be captured and played back later (see net_replay.h).
+
+	Log layout:
+		traffic_log_header
+		record, record, record ...	each one traffic_record_header + body, padded to 8 bytes
+
+	Recording is off until Start() is called, and while it is off the cost on the
+	read path is a single relaxed atomic load.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		struct traffic_log_header {
+			char magic[8] = { 'O', 'L', 'C', 'T', 'R', 'A', 'F', '1' };
+			uint32_t nMessageHeaderSize = 0;	// sizeof(message_header<T>) of the recording build
+			uint32_t nReserved = 0;
+		};
+
+		template <typename T>
+		struct traffic_record_header {
+			uint32_t nRecordSize = 0;		// whole record including this header and padding
+			uint32_t nConnection = 0;		// connection id the message arrived on
+			int64_t nTimestamp = 0;			// nanoseconds since recording started
+			message_header<T> header;
+		};
+
+
+		// A file mapped into memory. Kept deliberately small - grow it, get at it, close it.
+		class mapped_file {
+
+		public:
+			mapped_file() = default;
+			mapped_file(const mapped_file&) = delete;
+			~mapped_file() {
+				Close();
+			}
+
+			bool Open(const std::string& sPath, size_t nSize, bool bWrite) {
+				Close();
+				m_bWrite = bWrite;
+
+#ifdef _WIN32
+				m_hFile = CreateFileA(sPath.c_str(), bWrite ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, nullptr,
+					bWrite ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (m_hFile == INVALID_HANDLE_VALUE) return false;
+
+				if (!bWrite) {
+					LARGE_INTEGER li;
+					GetFileSizeEx(m_hFile, &li);
+					nSize = size_t(li.QuadPart);
+				}
+#else
+				m_fd = ::open(sPath.c_str(), bWrite ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+				if (m_fd < 0) return false;
+
+				if (!bWrite) {
+					struct stat st;
+					fstat(m_fd, &st);
+					nSize = size_t(st.st_size);
+				}
+#endif
+				return Map(nSize);
+			}
+
+			// Changes the size of the file and maps it again. Anything pointing into the
+			// old mapping is invalid afterwards.
+			bool Resize(size_t nSize) {
+				Unmap();
+				return Map(nSize);
+			}
+
+			void Close(size_t nFinalSize = size_t(-1)) {
+				Unmap();
+#ifdef _WIN32
+				if (m_hFile != INVALID_HANDLE_VALUE) {
+					if (m_bWrite && nFinalSize != size_t(-1)) {
+						LARGE_INTEGER li;
+						li.QuadPart = LONGLONG(nFinalSize);
+						SetFilePointerEx(m_hFile, li, nullptr, FILE_BEGIN);
+						SetEndOfFile(m_hFile);
+					}
+					CloseHandle(m_hFile);
+					m_hFile = INVALID_HANDLE_VALUE;
+				}
+#else
+				if (m_fd >= 0) {
+					if (m_bWrite && nFinalSize != size_t(-1)) {
+						if (ftruncate(m_fd, off_t(nFinalSize)) != 0) {}
+					}
+					::close(m_fd);
+					m_fd = -1;
+				}
+#endif
+			}
+
+			uint8_t* data() const {
+				return m_pData;
+			}
+
+			size_t size() const {
+				return m_nSize;
+			}
+
+		private:
+			bool Map(size_t nSize) {
+				m_nSize = nSize;
+				if (nSize == 0) return true;
+
+#ifdef _WIN32
+				m_hMapping = CreateFileMappingA(m_hFile, nullptr, m_bWrite ? PAGE_READWRITE : PAGE_READONLY,
+					DWORD(uint64_t(nSize) >> 32), DWORD(nSize & 0xFFFFFFFF), nullptr);
+				if (!m_hMapping) return false;
+				m_pData = (uint8_t*)MapViewOfFile(m_hMapping, m_bWrite ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, nSize);
+#else
+				if (m_bWrite && ftruncate(m_fd, off_t(nSize)) != 0) return false;
+				void* p = mmap(nullptr, nSize, m_bWrite ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_fd, 0);
+				m_pData = p == MAP_FAILED ? nullptr : (uint8_t*)p;
+#endif
+				return m_pData != nullptr;
+			}
+
+			void Unmap() {
+				if (m_pData) {
+#ifdef _WIN32
+					UnmapViewOfFile(m_pData);
+					CloseHandle(m_hMapping);
+					m_hMapping = nullptr;
+#else
+					munmap(m_pData, m_nSize);
+#endif
+					m_pData = nullptr;
+				}
+			}
+
+		private:
+			friend class mapped_window;
+
+#ifdef _WIN32
+			HANDLE m_hFile = INVALID_HANDLE_VALUE;
+			HANDLE m_hMapping = nullptr;
+#else
+			int m_fd = -1;
+#endif
+			uint8_t* m_pData = nullptr;
+			size_t m_nSize = 0;
+			bool m_bWrite = false;
+		};
+
+
+		// One stretch of a file opened for writing, mapped on its own and growing the
+		// file to cover it. The offset has to be a multiple of Granularity.
+		class mapped_window {
+
+		public:
+			// Allocation granularity on Windows, a whole number of pages elsewhere
+			static constexpr size_t Granularity = 64 * 1024;
+
+		public:
+			mapped_window() = default;
+			mapped_window(const mapped_window&) = delete;
+			~mapped_window() {
+				Unmap();
+			}
+
+			mapped_window& operator=(mapped_window&& other) noexcept {
+				Unmap();
+				std::swap(m_pData, other.m_pData);
+				std::swap(m_nOffset, other.m_nOffset);
+				std::swap(m_nSize, other.m_nSize);
+				return *this;
+			}
+
+			bool Map(const mapped_file& file, size_t nOffset, size_t nSize) {
+				Unmap();
+#ifdef _WIN32
+				uint64_t nEnd = uint64_t(nOffset) + nSize;
+				HANDLE hMapping = CreateFileMappingA(file.m_hFile, nullptr, PAGE_READWRITE, DWORD(nEnd >> 32), DWORD(nEnd & 0xFFFFFFFF), nullptr);
+				if (!hMapping) return false;
+				m_pData = (uint8_t*)MapViewOfFile(hMapping, FILE_MAP_WRITE, DWORD(uint64_t(nOffset) >> 32), DWORD(nOffset & 0xFFFFFFFF), nSize);
+				CloseHandle(hMapping);	// the view keeps it alive
+#else
+				if (ftruncate(file.m_fd, off_t(nOffset + nSize)) != 0) return false;
+				void* p = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, file.m_fd, off_t(nOffset));
+				m_pData = p == MAP_FAILED ? nullptr : (uint8_t*)p;
+#endif
+				if (!m_pData) return false;
+				m_nOffset = nOffset;
+				m_nSize = nSize;
+				return true;
+			}
+
+			void Unmap() {
+				if (!m_pData) return;
+#ifdef _WIN32
+				UnmapViewOfFile(m_pData);
+#else
+				munmap(m_pData, m_nSize);
+#endif
+				m_pData = nullptr;
+				m_nOffset = 0;
+				m_nSize = 0;
+			}
+
+			uint8_t* data() const {
+				return m_pData;
+			}
+
+			size_t offset() const {
+				return m_nOffset;
+			}
+
+			// One past the last byte of the file it covers
+			size_t end() const {
+				return m_nOffset + m_nSize;
+			}
+
+		private:
+			uint8_t* m_pData = nullptr;
+			size_t m_nOffset = 0;
+			size_t m_nSize = 0;
+		};
+
+
+		template <typename T>
+		class traffic_recorder {
+
+		public:
+			traffic_recorder() = default;
+			traffic_recorder(const traffic_recorder<T>&) = delete;
+
+			~traffic_recorder() {
+				Stop();
+			}
+
+			// Starts a new log at sPath, replacing anything already there. The file is
+			// written through a window of nGrowBytes mapped into memory - the next one is
+			// mapped ahead of time on a background thread, which also unmaps each one once
+			// it is full, so recording never stops to do either.
+			bool Start(const std::string& sPath, size_t nGrowBytes = 256 * 1024 * 1024) {
+				std::scoped_lock lock(muxAppend);
+				StopLocked();
+
+				size_t nGranularity = mapped_window::Granularity;
+				m_nGrowBytes = std::max((nGrowBytes + nGranularity - 1) / nGranularity, size_t(1)) * nGranularity;
+				if (!m_file.Open(sPath, 0, true) || !m_window.Map(m_file, 0, m_nGrowBytes)) {
+					m_file.Close();
+					return false;
+				}
+
+				traffic_log_header header;
+				header.nMessageHeaderSize = sizeof(message_header<T>);
+				std::memcpy(m_window.data(), &header, sizeof(header));
+				m_nWritten = sizeof(header);
+
+				m_bNextReady = false;
+				m_bFailed = false;
+				m_bStopMapper = false;
+				m_threadMapper = std::thread([this]() { Mapper(); });
+
+				m_tpStart = std::chrono::steady_clock::now();
+				m_bActive.store(true, std::memory_order_release);
+				return true;
+			}
+
+			// Finishes the log, trimming the file down to what was actually written
+			void Stop() {
+				std::scoped_lock lock(muxAppend);
+				StopLocked();
+			}
+
+			bool IsRecording() const {
+				return m_bActive.load(std::memory_order_relaxed);
+			}
+
+			// Called from the asio thread as each complete message arrives
+			void Record(uint32_t nConnection, const message<T>& msg) {
+				if (!m_bActive.load(std::memory_order_relaxed)) return;
+
+				auto tpNow = std::chrono::steady_clock::now();
+				size_t nBody = msg.body.size();
+				size_t nRecord = (sizeof(traffic_record_header<T>) + nBody + 7) & ~size_t(7);
+
+				traffic_record_header<T> rec;
+				rec.nRecordSize = uint32_t(nRecord);
+				rec.nConnection = nConnection;
+				rec.nTimestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(tpNow - m_tpStart).count();
+				rec.header = msg.header;
+				rec.header.size = uint32_t(nBody);
+
+				std::scoped_lock lock(muxAppend);
+				if (!m_bActive.load(std::memory_order_relaxed)) return;
+
+				// The padding is already zero, as the file grew
+				if (m_nWritten + nRecord <= m_window.end()) {
+					uint8_t* p = m_window.data() + (m_nWritten - m_window.offset());
+					std::memcpy(p, &rec, sizeof(rec));
+					if (nBody > 0) std::memcpy(p + sizeof(rec), msg.body.data(), nBody);
+				}
+				else {
+					size_t nPos = m_nWritten;
+					if (!Append(nPos, &rec, sizeof(rec)) || !Append(nPos, msg.body.data(), nBody)) {
+						m_bActive = false;
+						return;
+					}
+				}
+				m_nWritten += nRecord;
+			}
+
+		private:
+			// muxAppend held. The slow way, for a record running into the next window.
+			bool Append(size_t& nPos, const void* pData, size_t nBytes) {
+				auto p = static_cast<const uint8_t*>(pData);
+				while (nBytes > 0) {
+					if (nPos == m_window.end() && !NextWindow()) return false;
+					size_t n = std::min(nBytes, m_window.end() - nPos);
+					std::memcpy(m_window.data() + (nPos - m_window.offset()), p, n);
+					nPos += n;
+					p += n;
+					nBytes -= n;
+				}
+				return true;
+			}
+
+			// muxAppend held. Swaps in the window the mapper has ready and gives it the
+			// full one to unmap. Only waits if traffic has outrun the mapper.
+			bool NextWindow() {
+				std::unique_lock lock(m_muxMapper);
+				m_cvMapper.wait(lock, [this]() { return m_bNextReady || m_bFailed; });
+				if (!m_bNextReady) return false;
+
+				m_windowRetired = std::move(m_window);
+				m_window = std::move(m_windowNext);
+				m_bNextReady = false;
+				m_cvMapper.notify_all();
+				return true;
+			}
+
+			void Mapper() {
+				std::unique_lock lock(m_muxMapper);
+				while (!m_bStopMapper) {
+					if (!m_bNextReady && !m_bFailed) {
+						mapped_window retired;
+						retired = std::move(m_windowRetired);
+						size_t nOffset = m_window.end();
+						lock.unlock();
+
+						// The full window goes first, there is no sense in having three
+						retired.Unmap();
+						mapped_window next;
+						bool bMapped = next.Map(m_file, nOffset, m_nGrowBytes);
+						if (bMapped) {
+							// Take the page faults here rather than on the asio thread - the
+							// file is all zeroes there so far, writing one changes nothing
+							for (size_t i = 0; i < m_nGrowBytes; i += 4096) {
+								reinterpret_cast<volatile uint8_t*>(next.data())[i] = 0;
+							}
+						}
+						lock.lock();
+
+						if (bMapped) m_windowNext = std::move(next);
+						m_bNextReady = bMapped;
+						m_bFailed = !bMapped;
+						m_cvMapper.notify_all();
+						continue;
+					}
+					m_cvMapper.wait(lock);
+				}
+			}
+
+			void StopLocked() {
+				m_bActive = false;
+				if (m_threadMapper.joinable()) {
+					{
+						std::scoped_lock lock(m_muxMapper);
+						m_bStopMapper = true;
+					}
+					m_cvMapper.notify_all();
+					m_threadMapper.join();
+				}
+
+				m_window.Unmap();
+				m_windowNext.Unmap();
+				m_windowRetired.Unmap();
+				m_file.Close(m_nWritten);
+			}
+
+		private:
+			std::mutex muxAppend;
+			std::atomic<bool> m_bActive = false;
+			mapped_file m_file;
+			mapped_window m_window;			// what Record() writes into
+			size_t m_nWritten = 0;
+			size_t m_nGrowBytes = 0;
+			std::chrono::steady_clock::time_point m_tpStart;
+
+			// The mapper thread's side, the next window and the last full one
+			std::thread m_threadMapper;
+			std::mutex m_muxMapper;
+			std::condition_variable m_cvMapper;
+			mapped_window m_windowNext;
+			mapped_window m_windowRetired;
+			bool m_bNextReady = false;
+			bool m_bFailed = false;
+			bool m_bStopMapper = false;
+		};
+
+
+		// Walks a log written by traffic_recorder, front to back, without copying
+		template <typename T>
+		class traffic_log_reader {
+
+		public:
+			struct record {
+				int64_t nTimestamp = 0;
+				uint32_t nConnection = 0;
+				message_header<T> header;
+				const uint8_t* pBody = nullptr;
+			};
+
+		public:
+			bool Open(const std::string& sPath) {
+				if (!m_file.Open(sPath, 0, false)) return false;
+				if (m_file.size() < sizeof(traffic_log_header)) return false;
+
+				traffic_log_header header;
+				std::memcpy(&header, m_file.data(), sizeof(header));
+				if (std::memcmp(header.magic, traffic_log_header().magic, sizeof(header.magic)) != 0) return false;
+
+				// A log from a build with a different header layout can't be read safely
+				if (header.nMessageHeaderSize != sizeof(message_header<T>)) return false;
+
+				m_nOffset = sizeof(header);
+				return true;
+			}
+
+			bool Next(record& r) {
+				if (m_nOffset + sizeof(traffic_record_header<T>) > m_file.size()) return false;
+
+				traffic_record_header<T> rec;
+				std::memcpy(&rec, m_file.data() + m_nOffset, sizeof(rec));
+				if (rec.nRecordSize < sizeof(rec) || m_nOffset + rec.nRecordSize > m_file.size()) return false;
+
+				// The body has to fit inside its own record, or whoever reads it runs off
+				// into the next one - or past the end of the file
+				if (rec.header.size > rec.nRecordSize - sizeof(rec)) return false;
+
+				r.nTimestamp = rec.nTimestamp;
+				r.nConnection = rec.nConnection;
+				r.header = rec.header;
+				r.pBody = m_file.data() + m_nOffset + sizeof(rec);
+
+				m_nOffset += rec.nRecordSize;
+				return true;
+			}
+
+			void Rewind() {
+				m_nOffset = sizeof(traffic_log_header);
+			}
+
+		private:
+			mapped_file m_file;
+			size_t m_nOffset = 0;
+		};
+
+	}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+#include "net_connection.h"
+#include "net_server.h"
+#include "net_recorder.h"
+
+/*
+	Feeds a log captured by traffic_recorder back into a server_interface, as if
+	the original clients were connected. Each recorded connection id gets its own
+	detached connection - the server sees OnClientConnect, the messages in their
+	original order and OnClientDisconnect at the end. Anything the handlers send
+	back is thrown away.
+
+	Speed 1.0 replays in real time, 10.0 ten times faster, and 0 as fast as the
+	server can take it, which is what you want for benchmarking handler changes.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		template <typename T>
+		class traffic_replayer {
+
+		public:
+			struct result {
+				size_t nMessages = 0;
+				size_t nConnections = 0;
+				size_t nBytes = 0;
+				double dSeconds = 0.0;
+			};
+
+		public:
+			traffic_replayer(server_interface<T>& server) : m_server(server) {
+			}
+
+			bool Open(const std::string& sPath) {
+				return m_log.Open(sPath);
+			}
+
+			result Run(double dSpeed = 1.0) {
+				result res;
+				m_log.Rewind();
+
+				std::unordered_map<uint32_t, std::shared_ptr<connection<T>>> mapConnections;
+				std::set<uint32_t> setDenied;
+
+				auto tpStart = std::chrono::steady_clock::now();
+				typename traffic_log_reader<T>::record rec;
+
+				while (m_log.Next(rec)) {
+					if (dSpeed > 0.0) {
+						auto tpDue = tpStart + std::chrono::nanoseconds(int64_t(double(rec.nTimestamp) / dSpeed));
+						if (std::chrono::steady_clock::now() < tpDue) {
+							// Let the server catch up on everything that was due before this one
+							m_server.Update();
+							std::this_thread::sleep_until(tpDue);
+						}
+					}
+
+					auto& client = mapConnections[rec.nConnection];
+					if (!client && !setDenied.count(rec.nConnection)) {
+						client = m_server.CreateDetachedConnection(rec.nConnection);
+						if (!m_server.OnClientConnect(client)) {
+							// the server turned it down, so it would never have got these messages
+							setDenied.insert(rec.nConnection);
+							client.reset();
+						}
+						res.nConnections++;
+					}
+
+					if (client) {
+						message<T> msg;
+						msg.header = rec.header;
+						msg.body.assign(rec.pBody, rec.pBody + rec.header.size);
+						m_server.m_qMessagesIn.push_back({ client, std::move(msg) });
+					}
+
+					res.nMessages++;
+					res.nBytes += rec.header.size;
+
+					// Don't let the queue balloon when running flat out
+					if (dSpeed <= 0.0 && m_server.m_qMessagesIn.count() >= 1024) {
+						m_server.Update();
+					}
+				}
+
+				m_server.Update();
+				for (auto& [id, client] : mapConnections) {
+					if (client) m_server.ClientGone(client);
+				}
+
+				res.dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpStart).count();
+				return res;
+			}
+
+		private:
+			server_interface<T>& m_server;
+			traffic_log_reader<T> m_log;
+		};
+
+	}
+
+}
@@ -0,0 +1,355 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+#include "net_lanes.h"
+#include <future>
+
+/*
+	RPC - request and reply over an ordinary connection, matched up for you.
+
+	A call is a normal message with header.rpc set and a call id on the end of its
+	body, so it is sequenced, replayed after a resume, rate limited and fragmented
+	like anything else. The reply carries the same id back and is matched to its
+	call on the asio thread, so nobody has to pump Incoming() to get it:
+
+		auto fInventory = client.Call(msgInventory);		// all three go out at once
+		auto fFriends = client.Call(msgFriends);
+		auto fMail = client.Call(msgMail);
+		message<MsgTypes> inventory = fInventory.get();		// throws rpc_error if it failed
+
+	Nothing waits for one reply before the next call goes out, so twenty queries
+	at login cost one round trip rather than twenty.
+
+	On the server, a handler per message id answers through an rpc_responder,
+	which can be kept and answered later from any thread:
+
+		server.SetRpcHandler(MsgTypes::Inventory, [&](auto client, message<MsgTypes>& request, rpc_responder<MsgTypes> reply) {
+			pool.Run([=]() mutable { reply.Send(LoadInventory(...)); });
+		});
+
+	Timeouts for every outstanding call share one timer and a timer wheel, rather
+	than a timer each - the timer only runs while something is outstanding.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		template <typename T>
+		class connection;
+
+
+		enum class rpc_status : uint8_t {
+			ok = 0,
+			timeout,			// no reply in time
+			disconnected,		// the client was disconnected with the call outstanding
+			no_handler,			// the server has no handler for this message id
+			abandoned,			// the handler dropped its responder without answering
+			failed				// the handler answered with Fail()
+		};
+
+		inline const char* to_string(rpc_status s) {
+			switch (s) {
+			case rpc_status::ok:			return "ok";
+			case rpc_status::timeout:		return "timeout";
+			case rpc_status::disconnected:	return "disconnected";
+			case rpc_status::no_handler:	return "no_handler";
+			case rpc_status::abandoned:		return "abandoned";
+			case rpc_status::failed:		return "failed";
+			}
+			return "unknown";
+		}
+
+		// What a Call() future throws when the call didn't get a reply
+		class rpc_error : public std::runtime_error {
+
+		public:
+			rpc_error(rpc_status status) : std::runtime_error(std::string("rpc ") + to_string(status)), m_status(status) {
+			}
+
+			rpc_status Status() const {
+				return m_status;
+			}
+
+		private:
+			rpc_status m_status;
+		};
+
+
+		// Deadlines rounded to a tick and hashed into slots by it. Adding one is a
+		// push_back, and each tick only looks at one slot. Keys aren't removed when
+		// their call completes - whoever expires them checks they are still wanted.
+		class timer_wheel {
+
+		public:
+			timer_wheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10), size_t nSlots = 256)
+				: m_tick(std::max(tick, std::chrono::milliseconds(1))), m_vSlots(std::max<size_t>(nSlots, 1)) {
+			}
+
+			void Schedule(uint64_t nKey, std::chrono::steady_clock::time_point tpDeadline) {
+				uint64_t nTick = TickOf(tpDeadline);
+				if (nTick <= m_nLastTick) nTick = m_nLastTick + 1;
+				m_vSlots[nTick % m_vSlots.size()].push_back({ nTick, nKey });
+				m_nEntries++;
+			}
+
+			// Hands every key whose deadline has passed to f(key)
+			template <typename F>
+			void Expire(std::chrono::steady_clock::time_point tpNow, F&& f) {
+				uint64_t nNow = TickOf(tpNow);
+				if (nNow <= m_nLastTick) return;
+
+				// Once round the wheel visits every slot, however long it has been
+				uint64_t nFrom = std::max(m_nLastTick + 1, nNow >= m_vSlots.size() ? nNow - m_vSlots.size() + 1 : 0);
+				m_nLastTick = nNow;
+
+				for (uint64_t t = nFrom; t <= nNow; t++) {
+					auto& vSlot = m_vSlots[t % m_vSlots.size()];
+					size_t nKeep = 0;
+					for (size_t i = 0; i < vSlot.size(); i++) {
+						if (vSlot[i].nTick <= nNow) {
+							m_nEntries--;
+							f(vSlot[i].nKey);
+						}
+						else {
+							vSlot[nKeep++] = vSlot[i];		// comes round again on a later lap
+						}
+					}
+					vSlot.resize(nKeep);
+				}
+			}
+
+			bool empty() const {
+				return m_nEntries == 0;
+			}
+
+			std::chrono::milliseconds Tick() const {
+				return m_tick;
+			}
+
+		private:
+			struct entry {
+				uint64_t nTick;
+				uint64_t nKey;
+			};
+
+			uint64_t TickOf(std::chrono::steady_clock::time_point tp) const {
+				auto d = tp.time_since_epoch();
+				return uint64_t(std::max<int64_t>((d + m_tick - std::chrono::nanoseconds(1)) / m_tick, 0));
+			}
+
+		private:
+			std::chrono::milliseconds m_tick;
+			std::vector<std::vector<entry>> m_vSlots;
+			uint64_t m_nLastTick = 0;
+			size_t m_nEntries = 0;
+		};
+
+
+		// The calling side: hands out call ids, holds on to what to do with each reply
+		// and times them out. Replies come in on the asio thread, Call() from anywhere.
+		template <typename T>
+		class rpc_caller : public std::enable_shared_from_this<rpc_caller<T>> {
+
+		public:
+			using callback = std::function<void(rpc_status, message<T>&)>;
+
+			rpc_caller(asio::io_context& context, std::chrono::milliseconds tick = std::chrono::milliseconds(10))
+				: m_context(context), m_timer(context), m_wheel(tick) {
+			}
+
+			// Stamps msg as a call, to be sent by the caller straight after. fnDone runs
+			// exactly once, with the reply or why there wasn't one - on the asio thread,
+			// unless FailAll() gets to it first.
+			void Prepare(message<T>& msg, std::chrono::milliseconds timeout, callback fnDone) {
+				uint32_t nCall;
+				{
+					std::scoped_lock lock(m_mux);
+					do { nCall = ++m_nNextCall; } while (nCall == 0 || m_mapPending.count(nCall));
+					m_mapPending[nCall] = std::move(fnDone);
+				}
+
+				msg << nCall;
+				msg.header.rpc = rpc_kind::request;
+
+				// The wheel belongs to the asio thread. Handlers only hold on weakly - the
+				// client may own the context too, and we have to go before it does.
+				auto tpDeadline = std::chrono::steady_clock::now() + timeout;
+				asio::post(m_context, [wSelf = this->weak_from_this(), nCall, tpDeadline]() {
+					auto pSelf = wSelf.lock();
+					if (!pSelf) return;
+					pSelf->m_wheel.Schedule(nCall, tpDeadline);
+					pSelf->Arm();
+				});
+			}
+
+			// A reply or error has arrived. Asio thread only.
+			void Complete(message<T>& msg) {
+				uint32_t nCall = 0;
+				if (msg.body.size() < sizeof(nCall)) return;
+				msg >> nCall;
+
+				callback fnDone = Take(nCall);
+				if (!fnDone) return;
+
+				rpc_status status = rpc_status::ok;
+				if (msg.header.rpc == rpc_kind::error) {
+					// An error too short to say what went wrong still ends the call
+					if (msg.body.size() >= sizeof(status)) msg >> status;
+					if (status == rpc_status::ok) status = rpc_status::failed;
+				}
+				msg.header.rpc = rpc_kind::none;
+				msg.header.size = uint32_t(msg.body.size());
+
+				fnDone(status, msg);
+			}
+
+			// Fails everything outstanding, e.g. because we are going away
+			void FailAll(rpc_status status) {
+				std::unordered_map<uint32_t, callback> mapPending;
+				{
+					std::scoped_lock lock(m_mux);
+					mapPending.swap(m_mapPending);
+				}
+				message<T> msgNone;
+				for (auto& [nCall, fnDone] : mapPending) fnDone(status, msgNone);
+			}
+
+			size_t Outstanding() const {
+				std::scoped_lock lock(m_mux);
+				return m_mapPending.size();
+			}
+
+		private:
+			callback Take(uint32_t nCall) {
+				std::scoped_lock lock(m_mux);
+				auto it = m_mapPending.find(nCall);
+				if (it == m_mapPending.end()) return nullptr;
+				callback fnDone = std::move(it->second);
+				m_mapPending.erase(it);
+				return fnDone;
+			}
+
+			// One tick at a time, only while the wheel has something in it
+			void Arm() {
+				if (m_bTicking || m_wheel.empty()) return;
+				m_bTicking = true;
+				m_timer.expires_after(m_wheel.Tick());
+				m_timer.async_wait([wSelf = this->weak_from_this()](std::error_code ec) {
+					auto pSelf = wSelf.lock();
+					if (!pSelf) return;
+					pSelf->m_bTicking = false;
+					if (ec) return;
+
+					message<T> msgNone;
+					pSelf->m_wheel.Expire(std::chrono::steady_clock::now(), [&](uint64_t nCall) {
+						callback fnDone = pSelf->Take(uint32_t(nCall));
+						if (fnDone) fnDone(rpc_status::timeout, msgNone);
+					});
+					pSelf->Arm();
+				});
+			}
+
+		private:
+			asio::io_context& m_context;
+
+			mutable std::mutex m_mux;
+			std::unordered_map<uint32_t, callback> m_mapPending;
+			uint32_t m_nNextCall = 0;
+
+			// Asio thread only
+			asio::steady_timer m_timer;
+			timer_wheel m_wheel;
+			bool m_bTicking = false;
+		};
+
+
+		// The answering side of one call. Copies share the call, and the first Send()
+		// or Fail() from any of them answers it; if the last copy goes without either,
+		// the caller is told it was abandoned rather than left to time out.
+		template <typename T>
+		class rpc_responder {
+
+		public:
+			rpc_responder() = default;
+
+			rpc_responder(std::shared_ptr<connection<T>> client, T id, uint32_t nCall)
+				: m_pState(std::make_shared<state>()) {
+				m_pState->client = client;
+				m_pState->id = id;
+				m_pState->nCall = nCall;
+			}
+
+			// Any thread. False if the call was already answered.
+			bool Send(message<T> msg, lane l = lane::realtime) {
+				if (!m_pState || m_pState->bAnswered.exchange(true)) return false;
+				msg << m_pState->nCall;
+				msg.header.rpc = rpc_kind::reply;
+				return m_pState->Deliver(msg, l);
+			}
+
+			bool Fail(rpc_status status = rpc_status::failed) {
+				if (!m_pState || m_pState->bAnswered.exchange(true)) return false;
+				return m_pState->Error(status);
+			}
+
+			bool Answered() const {
+				return !m_pState || m_pState->bAnswered;
+			}
+
+		private:
+			struct state {
+				std::weak_ptr<connection<T>> client;
+				T id{};
+				uint32_t nCall = 0;
+				std::atomic<bool> bAnswered = false;
+
+				~state() {
+					if (!bAnswered.exchange(true)) Error(rpc_status::abandoned);
+				}
+
+				bool Error(rpc_status status) {
+					message<T> msg;
+					msg.header.id = id;
+					msg << status << nCall;
+					msg.header.rpc = rpc_kind::error;
+					return Deliver(msg, lane::realtime);
+				}
+
+				bool Deliver(const message<T>& msg, lane l) {
+					auto pClient = client.lock();
+					if (!pClient || (!pClient->IsConnected() && !pClient->HasSession())) return false;
+					return pClient->Send(msg, l);
+				}
+			};
+
+			std::shared_ptr<state> m_pState;
+		};
+
+
+		template <typename T>
+		using rpc_handler = std::function<void(std::shared_ptr<connection<T>>, message<T>&, rpc_responder<T>)>;
+
+		// Handlers by message id, like stream_table. Only used from the Update() thread.
+		template <typename T>
+		class rpc_table {
+
+		public:
+			void Set(T id, rpc_handler<T> handler) {
+				size_t i = size_t(id);
+				if (i >= m_vHandlers.size()) m_vHandlers.resize(i + 1);
+				m_vHandlers[i] = std::move(handler);
+			}
+
+			const rpc_handler<T>* Find(T id) const {
+				size_t i = size_t(id);
+				return i < m_vHandlers.size() && m_vHandlers[i] ? &m_vHandlers[i] : nullptr;
+			}
+
+		private:
+			std::vector<rpc_handler<T>> m_vHandlers;
+		};
+
+	}
+
+}
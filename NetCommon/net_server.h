@@ -3,6 +3,20 @@
 #include "./net_threadsafe_queue.h"
 #include "./net_message.h"
 #include "./net_connection.h"
+#include "./net_session.h"
+#include "./net_lanes.h"
+#include "./net_recorder.h"
+#include "./net_stats.h"
+#include "./net_topics.h"
+#include "./net_admission.h"
+#include "./net_shm.h"
+#include "./net_log.h"
+#include "./net_latency.h"
+#include "./net_uring.h"
+#include "./net_trace.h"
+#include "./net_timesync.h"
+#include "./net_stream.h"
+#include "./net_rpc.h"
 
 #include <algorithm>
 
@@ -28,28 +42,40 @@ namespace olc {
 
 			virtual ~server_interface() {
 				Stop();
+
+				// Connections hold sockets that belong to m_asioContext, which is declared
+				// (and therefore destroyed) after these containers - let go of them first
+				m_topics.Clear();
+				m_mapSessions.clear();
+				m_deqPending.clear();
+				m_deqConnections.clear();
+				while (!m_qMessagesIn.empty()) m_qMessagesIn.pop_front();
 			};
 
 			bool Start() {
 			
 				try {
 
+					if (m_backend == socket_backend::uring && !m_pUring) {
+						m_pUring = uring_loop::Create(m_asioContext, m_uringOptions);
+					}
+
 					// Get Connection first
 					WaitForClientConnection();
 
 					// Create thread
 					// If did the other way around, this thread could close. We wait for client connection first so we can issue some work first
 					m_threadContext = std::thread([this]() {
-						m_asioContext.run();
+						RunContext(m_asioContext, m_latency);
 					});
 				
 				}
 				catch (std::exception& e) {
-					std::cerr << "[SERVER] Exception: " << e.what() << "\n";
+					LogError("[SERVER] Exception: {}", e.what());
 					return false;
 				}
 
-				std::cout << "[SERVER] Started!\n";
+				LogInfo("[SERVER] Started!");
 				return true;
 			
 			};
@@ -62,10 +88,120 @@ namespace olc {
 					m_threadContext.join();
 				}
 
-				std::cout << "[SERVER] Stopped!\n";
+				// A transport hangs on to its pending handlers, and through them its
+				// connection, until it is closed - so close them all and let that run
+				for (auto& conn : m_deqConnections) {
+					if (conn) conn->Disconnect();
+				}
+				m_asioContext.restart();
+				m_asioContext.poll();
+
+				if (m_pUring) m_pUring->Shutdown();
+
+				LogInfo("[SERVER] Stopped!");
 				return true;
 			};
 
+			// Lets dropped clients reconnect into their old connection within policy.window,
+			// receiving only the messages they missed. Call before Start().
+			void EnableSessions(const session_policy& policy = {}) {
+				m_sessionPolicy = policy;
+				m_bSessions = true;
+			}
+
+			// Weights and chunking of the outbound lanes for every connection accepted
+			// from now on
+			void SetLanePolicy(const lane_policy& policy) {
+				m_lanePolicy = policy;
+			}
+
+			// Pinning, spinning and socket options, see net_latency.h. Call before Start().
+			void SetLatencyProfile(const latency_profile& profile) {
+				m_latency = profile;
+			}
+
+			// Socket I/O through asio's reactor or io_uring, see net_uring.h. Call before
+			// Start() - if io_uring turns out not to be available it stays on asio.
+			void SetSocketBackend(socket_backend backend, const uring_options& options = {}) {
+				m_backend = backend;
+				m_uringOptions = options;
+			}
+
+			// How hard io_uring is working, all zeroes when it isn't in use
+			uring_stats GetUringStats() const {
+				return m_pUring ? m_pUring->Stats() : uring_stats{};
+			}
+
+			// Size limits, rate limits and queue share for every connection accepted from
+			// now on, see net_admission.h
+			void SetAdmissionPolicy(const admission_policy& policy) {
+				m_admissionPolicy = policy;
+			}
+
+			// Messages with this id are handed to handler a piece at a time as they arrive,
+			// on the asio thread, instead of whole to OnMessage - see net_stream.h. For
+			// connections accepted from now on.
+			void SetStreamHandler(T id, stream_handler<T> handler) {
+				auto pStreams = m_pStreams ? std::make_shared<stream_table<T>>(*m_pStreams) : std::make_shared<stream_table<T>>();
+				pStreams->Set(id, std::move(handler));
+				m_pStreams = std::move(pStreams);
+			}
+
+			// Calls with this id go to handler instead of OnMessage, on the Update() thread.
+			// It answers through the responder, there or later from anywhere - see net_rpc.h
+			void SetRpcHandler(T id, rpc_handler<T> handler) {
+				m_rpc.Set(id, std::move(handler));
+			}
+
+			// How often every connection accepted from now on samples its client's clock
+			// and round trip time, see net_timesync.h
+			void SetTimeSyncPolicy(const time_sync_policy& policy) {
+				m_syncPolicy = policy;
+			}
+
+			// Captures every inbound message to a log that net_replay.h can play back.
+			// Can be switched on and off while the server is running.
+			bool StartRecording(const std::string& sPath) {
+				return m_recorder.Start(sPath);
+			}
+
+			void StopRecording() {
+				m_recorder.Stop();
+			}
+
+			// A connection with no socket, standing in for a client that isn't really
+			// there - used by replays
+			std::shared_ptr<connection<T>> CreateDetachedConnection(uint32_t uid) {
+				auto conn = std::make_shared<connection<T>>(
+					connection<T>::owner::server, m_asioContext, asio::ip::tcp::socket(m_asioContext), m_qMessagesIn);
+				conn->Detach(uid);
+				conn->SetStats(&m_stats);
+				return conn;
+			}
+
+			// Adds up the live counters into a snapshot, callable from any thread
+			stats_snapshot GetStats() {
+				stats_snapshot snap = m_stats.Snapshot();
+				snap.queuedIn = m_qMessagesIn.count();
+				return snap;
+			}
+
+			// Serves GetStats() as plain text to anything that connects to this port on
+			// localhost, e.g. "nc 127.0.0.1 <port>". Call before Start().
+			bool StartAdminEndpoint(uint16_t port) {
+				try {
+					m_asioAdminAcceptor = std::make_unique<asio::ip::tcp::acceptor>(m_asioContext,
+						asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), port));
+				}
+				catch (std::exception& e) {
+					LogError("[SERVER] Admin Endpoint Exception: {}", e.what());
+					return false;
+				}
+
+				WaitForAdminConnection();
+				return true;
+			}
+
 			// ASYNC - Instruct asio to wait for connection
 			void WaitForClientConnection() {
 
@@ -74,8 +210,16 @@ namespace olc {
 				// I assume it will tie the asioContext to the server and use the Context to handle the socket implementation?
 				m_asioAcceptor.async_accept(
 					[this](std::error_code ec, asio::ip::tcp::socket socket) {
+						trace_zone zone("accept");
 						if (!ec) {
-							std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << "\n";
+							LogInfo("[SERVER] New Connection: {}", socket.remote_endpoint());
+							ApplySocketOptions(socket, m_latency);
+							m_stats.Add(stat::connections_accepted);
+
+							// With io_uring the loop takes the socket over and the connection gets
+							// an empty one, as with shared memory
+							std::unique_ptr<byte_transport> pTransport;
+							if (m_pUring) pTransport = m_pUring->Adopt(socket);
 
 							std::shared_ptr<connection<T>> newconn = std::make_shared<connection<T>>(
 								connection<T>::owner::server,		// idk?
@@ -83,24 +227,11 @@ namespace olc {
 								std::move(socket),					// std move binds an r value, from this async func it allows the socket variable to persist in memory i think
 								m_qMessagesIn						// The message queue will be shared across instances of connections. Just for incoming mesages. Didnt realize that was the set up. this wil lbe thread safe though
 							);
-
-							 // Give the user server a chance to deny connection ... i dont know why the user would deny it
-							if (OnClientConnect(newconn)) {
-
-								this->m_deqConnections.push_back(std::move(newconn));	// again, usage of move to bind the R value and allow it to exist once scope ends.
-
-								
-								this->m_deqConnections.back()->ConnectToClient(nIDCounter++); // connects to client and passes in it's id
-
-								std::cout << "[" << this->m_deqConnections.back()->GetID() << "] Connection Approved";
-							}
-							else {
-								std::cout << "[-----] Connection Denied\n";
-							}
-
+							if (pTransport) newconn->SetTransport(std::move(pTransport));
+							AddNewConnection(newconn);
 						}
 						else {
-							std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
+							LogWarn("[SERVER] New Connection Error: {}", ec);
 						}
 
 						// Prime the asio context with more work - again let's just wait for another connection
@@ -110,8 +241,57 @@ namespace olc {
 			};
 
 
+			// However it got here, a new connection is configured and then either approved or
+			// parked until it says which session it belongs to
+			void AddNewConnection(std::shared_ptr<connection<T>> newconn) {
+				newconn->SetLanePolicy(m_lanePolicy);
+				newconn->SetAdmissionPolicy(m_admissionPolicy);
+				newconn->SetTimeSyncPolicy(m_syncPolicy);
+				newconn->SetStreamHandlers(m_pStreams);
+				newconn->SetRecorder(&m_recorder);
+				newconn->SetStats(&m_stats);
+
+				if (m_bSessions) {
+					// We don't know yet whether this is a new player or an old one coming
+					// back, so park it until its session_open arrives in Update()
+					{
+						std::scoped_lock lock(m_muxPending);
+						m_deqPending.push_back(newconn);
+					}
+					newconn->AwaitSession();
+				}
+				 // Give the user server a chance to deny connection ... i dont know why the user would deny it
+				else if (OnClientConnect(newconn)) {
+
+					this->m_deqConnections.push_back(std::move(newconn));	// again, usage of move to bind the R value and allow it to exist once scope ends.
+
+					
+					this->m_deqConnections.back()->ConnectToClient(nIDCounter++); // connects to client and passes in it's id
+
+					LogInfo("[{}] Connection Approved", this->m_deqConnections.back()->GetID());
+					m_stats.Add(stat::connections_active);
+					OnClientApproved(this->m_deqConnections.back());
+				}
+				else {
+					LogInfo("[-----] Connection Denied");
+					m_stats.Disconnected(disconnect_reason::denied);
+				}
+			}
+
+#ifdef __linux__
+			// Also accept clients on this machine over shared memory (see net_shm.h) under
+			// sName, e.g. "/olc-game". A client attaching takes the segment for itself and
+			// a fresh one is put up under the same name for the next.
+			bool AcceptSharedMemory(const std::string& sName, size_t nRingBytes = 4 * 1024 * 1024) {
+				m_sShmName = sName;
+				m_nShmRingBytes = nRingBytes;
+				m_pShmTimer = std::make_unique<asio::steady_timer>(m_asioContext);
+				return OfferSharedMemory();
+			}
+#endif
+
 			// How do we send messages to clients? 
-			void MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg) {
+			void MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg, lane l = lane::realtime) {
 				
 				
 				/* 
@@ -119,53 +299,58 @@ namespace olc {
 					It's only after attempting to communicate with the client, that we know if they
 					disconnected DUE to the lack of response.
 				*/
-				if (client && client->IsConnected()) {
-					client->Send(msg);
+				if (client && (client->IsConnected() || client->HasSession())) {
+					// a dropped client with a session buffers this until it resumes or expires
+					client->Send(msg, l);
 				}
 				else {
-					OnClientDisconnect(client);
-					client.reset();	// delets client
+					ClientGone(client);
+					m_stats.Add(stat::connections_active, -1);
 					this->m_deqConnections.erase(
 						std::remove(
 							this->m_deqConnections.begin(),
 							this->m_deqConnections.end(),
 							client
 						),
-						this->m_deqConnections.erase()
+						this->m_deqConnections.end()
 					);
+					client.reset();	// delets client
 				}
 
 
 			};
 
 			// send message to all clients
-			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr) {
+			void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr, lane l = lane::realtime) {
+				trace_zone zone("broadcast", "clients", m_deqConnections.size());
 
 				bool bInvalidClientExists = false;
 
 				for (auto& client : this->m_deqConnections) {
 					// Check if client is connected...
 
-					if (client && client->IsConnected()) {
-						// ..it is!
+					if (client && (client->IsConnected() || client->HasSession())) {
+						// ..it is! (or it is coming back, see MessageClient)
 						if (client != pIgnoreClient) {
-							client->Send(msg);
+							client->Send(msg, l);
 						}
 					}
 					else {
-						OnClientDisconnect(client);
+						ClientGone(client);
+						m_stats.Add(stat::connections_active, -1);
 						client.reset();
 						bInvalidClientExists = true;
 					}
 				}
 
-				if (bInvalidClientExists == false) {
+				if (bInvalidClientExists) {
 
 					// std::deque::erase removes the "removed" elements
 					// first parameter == begin, last parameter == last. Only 2 parameters
 
 					this->m_deqConnections.erase(
-						std::remove(this->m_deqConnections.begin(), this->m_deqConnections.end(), nullptr)	// first pos, last pos, value to be removed
+						std::remove(this->m_deqConnections.begin(), this->m_deqConnections.end(), nullptr),	// first pos, last pos, value to be removed
+						this->m_deqConnections.end()
 					);
 
 
@@ -173,17 +358,89 @@ namespace olc {
 			};
 
 
+			// Topics are groups of clients that can be messaged together. Only call these
+			// from the thread running Update(), e.g. inside OnMessage.
+			bool Subscribe(std::shared_ptr<connection<T>> client, topic_id topic) {
+				return client && m_topics.Subscribe(client, topic);
+			}
+
+			bool Unsubscribe(std::shared_ptr<connection<T>> client, topic_id topic) {
+				return client && m_topics.Unsubscribe(client.get(), topic);
+			}
+
+			size_t SubscriberCount(topic_id topic) const {
+				return m_topics.Members(topic).size();
+			}
+
+			// Sends msg to every member of a topic. The message is built once and shared
+			// by all of them, however many there are.
+			void Publish(topic_id topic, const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr, lane l = lane::realtime) {
+				trace_zone zone("publish", "topic", uint64_t(topic));
+				auto pMsg = std::make_shared<const message<T>>(msg);
+				m_stats.Add(stat::allocations);
+
+				std::vector<std::shared_ptr<connection<T>>> vGone;
+				for (auto& client : m_topics.Members(topic)) {
+					if (client->IsConnected() || client->HasSession()) {
+						if (client != pIgnoreClient) {
+							client->Send(pMsg, l);
+						}
+					}
+					else {
+						vGone.push_back(client);
+					}
+				}
+
+				// Dealt with afterwards, as dropping them changes the member list
+				for (auto& client : vGone) {
+					ClientGone(client);
+					m_stats.Add(stat::connections_active, -1);
+					m_deqConnections.erase(std::remove(m_deqConnections.begin(), m_deqConnections.end(), client), m_deqConnections.end());
+				}
+			}
+
 			// This will process the messages in the queue through the OnMessage function
 			void Update(size_t nMaxMessages = -1) {	// size_t is unsigned, so setting it to -1 sets it to MAXIMUM VALUE lol 
+				// Whichever thread runs the game loop gets pinned the first time round
+				if (!m_bUpdatePinned) {
+					m_bUpdatePinned = true;
+					PinThisThread(m_latency.nUpdateCore);
+					TraceThreadName("update");
+				}
+				trace_zone zone("update", "messages");
+
 				size_t nMessageCount = 0;
 				while (nMessageCount < nMaxMessages && !m_qMessagesIn.empty()) {
 					auto msg = m_qMessagesIn.pop_front();
 
-					OnMessage(msg.remote, msg.msg);	// msg.remote is the shared ptr to the specific client
+					// Lets a client that hit its share of the queue start sending again
+					if (msg.remote && (msg.msg.header.control == control_code::none || msg.msg.header.control == control_code::cluster)) {
+						msg.remote->MessageConsumed();
+					}
+
+					if (msg.msg.header.control == control_code::session_open) {
+						OnSessionOpen(msg.remote, msg.msg);
+					}
+					else if (msg.msg.header.control == control_code::none && msg.msg.header.rpc == rpc_kind::request) {
+						trace_zone zoneMessage("on_rpc", "msg", uint64_t(msg.msg.header.id));
+						HandleRpc(msg.remote, msg.msg);
+					}
+					else {
+						trace_zone zoneMessage("on_message", "msg", uint64_t(msg.msg.header.id));
+						OnMessage(msg.remote, msg.msg);	// msg.remote is the shared ptr to the specific client
+					}
 
 					nMessageCount++;
 
 				}
+
+				if (m_bSessions) {
+					SweepSessions();
+				}
+
+				OnUpdate();
+				zone.Arg(nMessageCount);
+				if (nMessageCount == 0) zone.DropBelow(std::chrono::microseconds(100));
 			}
 
 		protected:
@@ -193,6 +450,16 @@ namespace olc {
 				return false;
 			};
 
+			// Called once an approved client has its id, on the same thread as OnClientConnect
+			virtual void OnClientApproved(std::shared_ptr<connection<T>> client) {
+
+			};
+
+			// Called at the end of every Update(), on the same thread
+			virtual void OnUpdate() {
+
+			};
+
 			// Called when a client appears to have disconnected 
 			virtual void OnClientDisconnect(std::shared_ptr<connection<T>> client) {
 
@@ -208,6 +475,178 @@ namespace olc {
 
 			};
 
+		private:
+			void HandleRpc(std::shared_ptr<connection<T>> client, message<T>& msg) {
+				uint32_t nCall = 0;
+				if (!client || msg.body.size() < sizeof(nCall)) return;
+				msg >> nCall;
+				msg.header.rpc = rpc_kind::none;
+				msg.header.size = uint32_t(msg.body.size());
+
+				rpc_responder<T> responder(client, msg.header.id, nCall);
+				if (auto pHandler = m_rpc.Find(msg.header.id)) {
+					(*pHandler)(client, msg, std::move(responder));
+				}
+				else {
+					responder.Fail(rpc_status::no_handler);
+				}
+			}
+
+			// ASYNC - Each admin connection gets one stats dump, then is closed
+			void WaitForAdminConnection() {
+				m_asioAdminAcceptor->async_accept(
+					[this](std::error_code ec, asio::ip::tcp::socket socket) {
+						if (!ec) {
+							auto pSocket = std::make_shared<asio::ip::tcp::socket>(std::move(socket));
+							auto pText = std::make_shared<std::string>(GetStats().ToString());
+							asio::async_write(*pSocket, asio::buffer(*pText),
+								[pSocket, pText](std::error_code ec, std::size_t length) {
+									asio::error_code ecClose;
+									pSocket->close(ecClose);
+								});
+						}
+
+						if (m_asioAdminAcceptor->is_open()) {
+							WaitForAdminConnection();
+						}
+					});
+			}
+
+			// Every client the server lets go of passes through here, so it
+			// can be tidied out of the topics before the game hears about it
+			void ClientGone(std::shared_ptr<connection<T>> client) {
+				if (client) m_topics.UnsubscribeAll(client.get());
+				OnClientDisconnect(client);
+			}
+
+			// Replays drive the protected handlers and the incoming queue directly
+			template <typename> friend class traffic_replayer;
+
+			// A pending connection has told us who it is. Either it is coming back for a
+			// session we still hold, or it goes through OnClientConnect like any new client.
+			void OnSessionOpen(std::shared_ptr<connection<T>> client, message<T>& msg) {
+				uint64_t nToken = 0;
+				uint32_t nLastReceived = 0;
+
+				{
+					std::scoped_lock lock(m_muxPending);
+					m_deqPending.erase(std::remove(m_deqPending.begin(), m_deqPending.end(), client), m_deqPending.end());
+				}
+
+				if (msg.body.size() != sizeof(nLastReceived) + sizeof(nToken)) {
+					LogWarn("[-----] Malformed Session Open: {} bytes", msg.body.size());
+					client->Disconnect(disconnect_reason::policy_violation);
+					return;
+				}
+				msg >> nLastReceived >> nToken;
+
+				auto it = nToken != 0 ? m_mapSessions.find(nToken) : m_mapSessions.end();
+				if (it != m_mapSessions.end() && it->second->CanResumeFrom(nLastReceived)) {
+					m_mapParked.erase(nToken);
+					it->second->ResumeSession(client, nLastReceived);
+					LogInfo("[{}] Session Resumed", it->second->GetID());
+					return;
+				}
+
+				if (OnClientConnect(client)) {
+					uint64_t nNewToken = 0;
+					while (nNewToken == 0 || m_mapSessions.count(nNewToken)) nNewToken = NewSessionToken();
+
+					m_deqConnections.push_back(client);
+					m_mapSessions[nNewToken] = client;
+					client->StartSession(nIDCounter++, nNewToken, m_sessionPolicy);
+
+					LogInfo("[{}] Connection Approved", client->GetID());
+					m_stats.Add(stat::connections_active);
+					OnClientApproved(client);
+				}
+				else {
+					LogInfo("[-----] Connection Denied");
+					client->Disconnect(disconnect_reason::denied);
+				}
+			}
+
+			// Dropped sessions get policy.window to come back, after that the client is
+			// gone for good and the game finally hears about it through OnClientDisconnect
+			void SweepSessions() {
+				auto tpNow = std::chrono::steady_clock::now();
+				if (tpNow - m_tpLastSweep < std::chrono::milliseconds(100)) return;
+				m_tpLastSweep = tpNow;
+
+				{
+					// connections that dropped before even saying hello
+					std::scoped_lock lock(m_muxPending);
+					m_deqPending.erase(std::remove_if(m_deqPending.begin(), m_deqPending.end(),
+						[](const std::shared_ptr<connection<T>>& c) { return !c->IsConnected(); }), m_deqPending.end());
+				}
+
+				for (auto it = m_mapSessions.begin(); it != m_mapSessions.end(); ) {
+					auto client = it->second;
+					if (client->IsConnected() || client->ResumePending()) {
+						m_mapParked.erase(it->first);
+						++it;
+						continue;
+					}
+
+					auto parked = m_mapParked.try_emplace(it->first, tpNow + m_sessionPolicy.window).first;
+					if (tpNow < parked->second) {
+						++it;
+						continue;
+					}
+
+					LogInfo("[{}] Session Expired", client->GetID());
+					m_mapParked.erase(parked);
+					it = m_mapSessions.erase(it);
+
+					client->EndSession();
+					m_stats.Disconnected(disconnect_reason::session_expired);
+					ClientGone(client);
+					m_stats.Add(stat::connections_active, -1);
+					m_deqConnections.erase(std::remove(m_deqConnections.begin(), m_deqConnections.end(), client), m_deqConnections.end());
+				}
+			}
+
+#ifdef __linux__
+			bool OfferSharedMemory() {
+				m_pShmOffered = shm_transport::CreateSegment(m_sShmName, m_nShmRingBytes);
+				if (!m_pShmOffered) {
+					LogError("[SERVER] Shared Memory Error: {}", std::strerror(errno));
+					return false;
+				}
+				WaitForSharedMemoryClient();
+				return true;
+			}
+
+			// There is nothing to wait on for an attach, so look every few milliseconds
+			void WaitForSharedMemoryClient() {
+				m_pShmTimer->expires_after(std::chrono::milliseconds(5));
+				m_pShmTimer->async_wait([this](std::error_code ec) {
+					if (ec) return;
+
+					if (m_pShmOffered->Header()->nAttached.load() == 0) {
+						WaitForSharedMemoryClient();
+						return;
+					}
+
+					LogInfo("[SERVER] New Connection: shm:{}", m_sShmName);
+					m_stats.Add(stat::connections_accepted);
+
+					// Take the name off this one so the next offer can have it
+					m_pShmOffered->Unlink();
+					std::shared_ptr<connection<T>> newconn = std::make_shared<connection<T>>(
+						connection<T>::owner::server,
+						m_asioContext,
+						asio::ip::tcp::socket(m_asioContext),
+						m_qMessagesIn
+					);
+					newconn->SetTransport(std::make_unique<shm_transport>(m_asioContext, std::move(m_pShmOffered), true));
+					AddNewConnection(newconn);
+
+					OfferSharedMemory();
+				});
+			}
+#endif
+
 			protected: 
 
 			tsqueue<owned_message<T>> m_qMessagesIn;
@@ -221,11 +660,48 @@ namespace olc {
 			// We need sockets of the connected client, they need a context
 			asio::ip::tcp::acceptor m_asioAcceptor;
 
+			// Optional localhost stats endpoint, see StartAdminEndpoint
+			std::unique_ptr<asio::ip::tcp::acceptor> m_asioAdminAcceptor;
+
+#ifdef __linux__
+			// Optional shared memory "acceptor", see AcceptSharedMemory
+			std::string m_sShmName;
+			size_t m_nShmRingBytes = 0;
+			std::unique_ptr<shm_segment> m_pShmOffered;
+			std::unique_ptr<asio::steady_timer> m_pShmTimer;
+#endif
+
 			// Clients will be identified in the wider system via an ID. Needs to be unique
 			// Purpose: 1. consistent ID to be used to inform client of their own id, as well as other client's ids in network
 			// Purpose: 2. We COULD use IP and port address, but we should hide this from other clients. Also, it's much simpler.
 			uint32_t nIDCounter = 10000;
 
+			lane_policy m_lanePolicy;
+			admission_policy m_admissionPolicy;
+			time_sync_policy m_syncPolicy;
+			std::shared_ptr<const stream_table<T>> m_pStreams;
+			rpc_table<T> m_rpc;
+			latency_profile m_latency;
+			bool m_bUpdatePinned = false;
+			socket_backend m_backend = socket_backend::asio;
+			uring_options m_uringOptions;
+			std::shared_ptr<uring_loop> m_pUring;
+			traffic_recorder<T> m_recorder;
+			net_stats m_stats;
+
+			// Resumable sessions (see EnableSessions). Everything but the pending list is
+			// only touched from the thread calling Update().
+			bool m_bSessions = false;
+			session_policy m_sessionPolicy;
+			std::mutex m_muxPending;
+			std::deque<std::shared_ptr<connection<T>>> m_deqPending;
+			std::unordered_map<uint64_t, std::shared_ptr<connection<T>>> m_mapSessions;
+			std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> m_mapParked;
+			std::chrono::steady_clock::time_point m_tpLastSweep;
+
+			// Publish / subscribe groups, Update thread only
+			topic_registry<T> m_topics;
+
 
 		
 
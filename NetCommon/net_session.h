@@ -0,0 +1,253 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#elif defined(__linux__)
+#include <sys/random.h>
+#endif
+
+/*
+	Session support - lets a dropped connection pick up where it left off.
+
+	Every ordinary message a connection sends gets a sequence number, and a copy
+	of it is kept in a bounded replay ring. The other side piggybacks the highest
+	sequence number it has received in every header it sends (header.ack), which
+	lets us throw away what is already delivered. If the socket drops, the client
+	reconnects with its session token and last received sequence number, and we
+	replay only the messages it never saw instead of a full world resync.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		// A session token is all a client needs to take a session over, so it comes
+		// straight from the OS's cryptographic generator - one of ours could be
+		// predicted from the tokens it has already handed out
+		inline uint64_t NewSessionToken() {
+			uint64_t nToken = 0;
+#ifdef _WIN32
+			if (BCryptGenRandom(nullptr, reinterpret_cast<PUCHAR>(&nToken), sizeof(nToken), BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0) return nToken;
+#elif defined(__linux__)
+			if (getrandom(&nToken, sizeof(nToken), 0) == ssize_t(sizeof(nToken))) return nToken;
+#endif
+			std::random_device rd;
+			return (uint64_t(rd()) << 32) | rd();
+		}
+
+		template <typename T>
+		class replay_ring {
+
+		public:
+			struct entry {
+				uint32_t seq = 0;
+				std::shared_ptr<const message<T>> msg;
+				uint8_t nLane = 0;	// outbound lane it was sent on, so a replay keeps its priority
+			};
+
+		public:
+			replay_ring(size_t nMaxMessages = 0, size_t nMaxBytes = 0)
+				: m_nMaxMessages(nMaxMessages), m_nMaxBytes(nMaxBytes) {
+			}
+
+			// A ring with no capacity is switched off - nothing is kept and nothing can be resumed
+			void SetCapacity(size_t nMaxMessages, size_t nMaxBytes) {
+				std::scoped_lock lock(muxRing);
+				m_nMaxMessages = nMaxMessages;
+				m_nMaxBytes = nMaxBytes;
+				Trim();
+			}
+
+			bool Enabled() {
+				std::scoped_lock lock(muxRing);
+				return m_nMaxMessages > 0;
+			}
+
+			// Remember an outbound message. Sequence numbers must be pushed in order.
+			void Push(uint32_t seq, std::shared_ptr<const message<T>> msg, uint8_t nLane = 0) {
+				std::scoped_lock lock(muxRing);
+				m_nLastPushed = seq;
+				if (m_nMaxMessages == 0) return;
+
+				m_nBytes += msg->body.size();
+				m_deqEntries.push_back({ seq, std::move(msg), nLane });
+				Trim();
+			}
+
+			// The other side has everything up to and including seq, so forget it
+			void Acknowledge(uint32_t seq) {
+				std::scoped_lock lock(muxRing);
+				while (!m_deqEntries.empty() && m_deqEntries.front().seq <= seq) {
+					m_nBytes -= m_deqEntries.front().msg->body.size();
+					m_deqEntries.pop_front();
+				}
+			}
+
+			// Can we bring a peer that last received nLastReceived fully up to date?
+			// Only if every message after it is still in the ring.
+			bool CanResumeFrom(uint32_t nLastReceived) {
+				std::scoped_lock lock(muxRing);
+				if (nLastReceived > m_nLastPushed) return false;	// peer claims things we never sent
+				if (nLastReceived == m_nLastPushed) return true;	// nothing missing
+				return !m_deqEntries.empty() && m_deqEntries.front().seq <= nLastReceived + 1;
+			}
+
+			// Copies out everything the peer is missing, oldest first
+			std::vector<entry> CollectAfter(uint32_t nLastReceived) {
+				std::scoped_lock lock(muxRing);
+				std::vector<entry> vMissing;
+				for (auto& e : m_deqEntries) {
+					if (e.seq > nLastReceived) vMissing.push_back(e);
+				}
+				return vMissing;
+			}
+
+			// Takes over everything another ring was holding, used when a client swaps
+			// its connection object for a new one while keeping the session
+			void Adopt(replay_ring<T>& other) {
+				std::scoped_lock lock(muxRing, other.muxRing);
+				m_deqEntries = std::move(other.m_deqEntries);
+				m_nMaxMessages = other.m_nMaxMessages;
+				m_nMaxBytes = other.m_nMaxBytes;
+				m_nBytes = other.m_nBytes;
+				m_nLastPushed = other.m_nLastPushed;
+				other.m_deqEntries.clear();
+				other.m_nBytes = 0;
+			}
+
+			void Clear() {
+				std::scoped_lock lock(muxRing);
+				m_deqEntries.clear();
+				m_nBytes = 0;
+				m_nLastPushed = 0;
+			}
+
+			size_t count() {
+				std::scoped_lock lock(muxRing);
+				return m_deqEntries.size();
+			}
+
+		private:
+			// Oldest entries fall off the end once we are over budget, which simply
+			// means a peer that was gone for too long can no longer resume
+			void Trim() {
+				while (!m_deqEntries.empty() &&
+					(m_deqEntries.size() > m_nMaxMessages || (m_nMaxBytes > 0 && m_nBytes > m_nMaxBytes))) {
+					m_nBytes -= m_deqEntries.front().msg->body.size();
+					m_deqEntries.pop_front();
+				}
+			}
+
+		private:
+			// Pushed from the asio thread, but queried from the server's Update thread
+			// when a client tries to resume, so it is guarded like tsqueue
+			std::mutex muxRing;
+			std::deque<entry> m_deqEntries;
+			size_t m_nMaxMessages = 0;
+			size_t m_nMaxBytes = 0;
+			size_t m_nBytes = 0;
+			uint32_t m_nLastPushed = 0;
+		};
+
+
+		/*
+			Keeps track of which sequence numbers have arrived. Messages on different
+			outbound lanes overtake each other, so they do not arrive in sequence order.
+			What we acknowledge is the highest number below which nothing is missing,
+			and anything at or below it (or already seen above it) is a duplicate from
+			a replay and gets dropped.
+
+			How far ahead of that a message may be is bounded by the window, otherwise a
+			peer could skip numbers and have us hold on to every one it sent.
+
+			A big message on a bulk lane can take a while to put back together, and the
+			other lanes carry on past it meanwhile. So once its first fragment is in it
+			is Open()ed - the window moves on as if it had arrived, but it stays missing
+			(not Seen, and not acknowledged) until Accept() is called for it at the end.
+		*/
+		class sequence_tracker {
+
+		public:
+			static constexpr uint32_t nMinWindow = 4096;
+
+			// Returns false if we have already had this one, or it is outside the window
+			bool Accept(uint32_t seq) {
+				if (m_setOpen.erase(seq)) return true;
+				if (seq <= m_nContiguous || m_setAhead.count(seq) || TooFarAhead(seq)) return false;
+
+				m_setAhead.insert(seq);
+				Advance();
+				return true;
+			}
+
+			// The first fragment of a message is in, the rest is still to come
+			void Open(uint32_t seq) {
+				if (Seen(seq) || m_setOpen.count(seq) || TooFarAhead(seq)) return;
+				m_setOpen.insert(seq);
+				m_setAhead.insert(seq);
+				Advance();
+			}
+
+			// Whether Accept() would turn this one away
+			bool Seen(uint32_t seq) const {
+				if (m_setOpen.count(seq)) return false;
+				return seq <= m_nContiguous || m_setAhead.count(seq);
+			}
+
+			// Nothing legitimate gets this far ahead - the sender would have had to keep
+			// more messages unacknowledged than it can replay. Drop whoever does it.
+			bool TooFarAhead(uint32_t seq) const {
+				return uint64_t(seq) > uint64_t(m_nContiguous) + m_nWindow;
+			}
+
+			// The replay window, but never so small that lanes overtaking each other
+			// trip it when sessions are off
+			void SetWindow(size_t nMessages) {
+				m_nWindow = uint32_t(std::clamp<size_t>(nMessages, nMinWindow, UINT32_MAX));
+			}
+
+			// What we acknowledge - everything up to here has arrived in full
+			uint32_t LastContiguous() const {
+				if (m_setOpen.empty()) return m_nContiguous;
+				return std::min(m_nContiguous, *m_setOpen.begin() - 1);
+			}
+
+			void Reset() {
+				m_nContiguous = 0;
+				m_setAhead.clear();
+				m_setOpen.clear();
+			}
+
+		private:
+			void Advance() {
+				while (!m_setAhead.empty() && *m_setAhead.begin() == m_nContiguous + 1) {
+					m_nContiguous++;
+					m_setAhead.erase(m_setAhead.begin());
+				}
+			}
+
+		private:
+			uint32_t m_nContiguous = 0;		// the window starts here, open messages and all
+			uint32_t m_nWindow = nMinWindow;
+			std::set<uint32_t> m_setAhead;
+			std::set<uint32_t> m_setOpen;	// one per stream at most, unless a resume abandoned some
+		};
+
+
+		// Server wide settings for resumable sessions
+		struct session_policy {
+			// How long a dropped session is kept around waiting for its client to come back
+			std::chrono::milliseconds window = std::chrono::seconds(30);
+
+			// Bounds on the replay ring kept per connection
+			size_t nReplayMessages = 1024;
+			size_t nReplayBytes = 4 * 1024 * 1024;
+		};
+
+	}
+
+}
@@ -0,0 +1,523 @@
+#pragma once
+#include "net_common.h"
+#include "net_transport.h"
+
+/*
+	Shared memory transport, for a gateway and a game server on the same machine.
+	Instead of a loopback socket, the two processes share a POSIX shared memory
+	segment holding a pair of single producer / single consumer rings, one each
+	way. Frames are copied straight from the sender's message into the ring and
+	straight out of it into the receiver's message - no kernel buffers, no
+	syscalls while both sides are busy.
+
+	Reads and writes are done right there on the connection's io_context. Only
+	one that finds its ring empty (or full) is parked with the process's reactor
+	thread, which spins briefly, then sleeps on the futexes of every parked ring at
+	once and posts each operation back to its io_context when there is more to do.
+	The other side only pays for the wake-up syscall if someone is actually asleep.
+
+		server:	AcceptSharedMemory("/olc-game")		creates the segment
+		client:	ConnectSharedMemory("/olc-game")	attaches to it
+
+	Linux only.
+*/
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <ctime>
+#include <cerrno>
+
+namespace olc {
+
+	namespace net {
+
+		// Each index sits on its own cache line, so producer and consumer aren't
+		// fighting over one
+		struct shm_ring {
+			alignas(64) std::atomic<uint64_t> nWritten;		// total bytes ever written
+			alignas(64) std::atomic<uint64_t> nRead;		// total bytes ever read
+
+			alignas(64) std::atomic<uint32_t> nDataSignal;	// futex, bumped after every write
+			std::atomic<uint32_t> nReaderAsleep;
+			alignas(64) std::atomic<uint32_t> nSpaceSignal;	// futex, bumped after every read
+			std::atomic<uint32_t> nWriterAsleep;
+		};
+
+		struct shm_segment_header {
+			char magic[8];
+			uint32_t nRingBytes;
+			std::atomic<uint32_t> nAttached;		// a client has taken this segment
+			std::atomic<uint32_t> nClosed;			// either side has closed
+			shm_ring rings[2];						// [0] server -> client, [1] client -> server
+			// the two rings' data follows, nRingBytes each
+		};
+
+		static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+			"shared memory rings need lock free atomics");
+
+
+		// A mapped POSIX shared memory segment. Whoever created it removes the name again.
+		class shm_segment {
+
+		public:
+			static constexpr char Magic[8] = { 'O', 'L', 'C', 'S', 'H', 'M', '0', '1' };
+
+		public:
+			shm_segment() = default;
+			shm_segment(const shm_segment&) = delete;
+
+			~shm_segment() {
+				if (m_pHeader) munmap(m_pHeader, m_nMappedBytes);
+				if (m_bOwner) shm_unlink(m_sName.c_str());
+			}
+
+			// Names look like "/something", see shm_open
+			bool Create(const std::string& sName, size_t nRingBytes) {
+				shm_unlink(sName.c_str());	// left over from a crashed run
+				int fd = shm_open(sName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+				if (fd < 0) return false;
+
+				m_sName = sName;
+				m_bOwner = true;
+				m_nMappedBytes = sizeof(shm_segment_header) + 2 * nRingBytes;
+				if (ftruncate(fd, off_t(m_nMappedBytes)) != 0 || !Map(fd)) {
+					::close(fd);
+					return false;
+				}
+				::close(fd);
+
+				// ftruncate zeroed the lot, which is a valid starting state for the atomics
+				std::memcpy(m_pHeader->magic, Magic, sizeof(Magic));
+				m_pHeader->nRingBytes = uint32_t(nRingBytes);
+				return true;
+			}
+
+			bool Open(const std::string& sName) {
+				int fd = shm_open(sName.c_str(), O_RDWR, 0600);
+				if (fd < 0) return false;
+
+				struct ::stat st;
+				if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(shm_segment_header)) {
+					::close(fd);
+					return false;
+				}
+
+				m_sName = sName;
+				m_nMappedBytes = size_t(st.st_size);
+				bool bMapped = Map(fd);
+				::close(fd);
+
+				return bMapped && std::memcmp(m_pHeader->magic, Magic, sizeof(Magic)) == 0 &&
+					m_nMappedBytes == sizeof(shm_segment_header) + 2 * size_t(m_pHeader->nRingBytes);
+			}
+
+			// Takes the name away, leaving the mapping working for whoever has it already
+			void Unlink() {
+				if (m_bOwner) shm_unlink(m_sName.c_str());
+				m_bOwner = false;
+			}
+
+			shm_segment_header* Header() const {
+				return m_pHeader;
+			}
+
+			uint8_t* RingData(size_t nRing) const {
+				return reinterpret_cast<uint8_t*>(m_pHeader + 1) + nRing * m_pHeader->nRingBytes;
+			}
+
+		private:
+			bool Map(int fd) {
+				void* p = mmap(nullptr, m_nMappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				m_pHeader = p == MAP_FAILED ? nullptr : static_cast<shm_segment_header*>(p);
+				return m_pHeader != nullptr;
+			}
+
+		private:
+			std::string m_sName;
+			bool m_bOwner = false;
+			shm_segment_header* m_pHeader = nullptr;
+			size_t m_nMappedBytes = 0;
+		};
+
+
+		// A read or write that is waiting on its ring, as the reactor sees it
+		struct shm_wait {
+			std::atomic<uint32_t>* pSignal = nullptr;	// futex the other side bumps
+			std::atomic<uint32_t>* pAsleep = nullptr;	// tells the other side to bother waking it
+			std::function<bool()> fnReady;				// the ring has something for it, or is closed
+			std::function<void()> fnResume;				// hands it back to its own io_context
+		};
+
+
+		// One thread per process that sleeps on every waiting ring's futex at once
+		// (futex_waitv) and hands each operation back to its io_context as soon as
+		// its ring is ready. Transfers themselves never come through here.
+		class shm_reactor {
+
+		public:
+			static shm_reactor& Get() {
+				static shm_reactor reactor;
+				return reactor;
+			}
+
+			~shm_reactor() {
+				{
+					std::scoped_lock lock(m_mux);
+					m_bStop = true;
+					Wake();
+				}
+				if (m_thread.joinable()) m_thread.join();
+			}
+
+			void Park(shm_wait* pWait) {
+				std::scoped_lock lock(m_mux);
+				if (!m_thread.joinable()) m_thread = std::thread([this]() { Run(); });
+				m_vWaits.push_back(pWait);
+				Wake();
+			}
+
+			// Once this returns the wait's fnResume won't be called
+			void Cancel(shm_wait* pWait) {
+				std::scoped_lock lock(m_mux);
+				m_vWaits.erase(std::remove(m_vWaits.begin(), m_vWaits.end(), pWait), m_vWaits.end());
+				Wake();
+			}
+
+		private:
+			// struct futex_waitv, which older kernel headers don't have
+			struct futex_wait_entry {
+				uint64_t nValue;
+				uint64_t pAddress;
+				uint32_t nFlags;
+				uint32_t nReserved;
+			};
+
+			static constexpr uint32_t Futex32 = 0x02;
+			static constexpr uint32_t FutexPrivate = 128;
+			static constexpr size_t MaxWaits = 128;
+#ifdef SYS_futex_waitv
+			static constexpr long SysFutexWaitv = SYS_futex_waitv;
+#else
+			static constexpr long SysFutexWaitv = 449;
+#endif
+
+			// m_mux held
+			void Wake() {
+				m_nWakeup.fetch_add(1, std::memory_order_seq_cst);
+				if (m_bSleeping) syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_nWakeup), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+			}
+
+			// m_mux held. Hands back everything that is ready, true if anything was.
+			bool ResumeReady() {
+				size_t nBefore = m_vWaits.size();
+				auto itEnd = std::remove_if(m_vWaits.begin(), m_vWaits.end(), [](shm_wait* pWait) {
+					if (!pWait->fnReady()) return false;
+					pWait->fnResume();
+					return true;
+				});
+				m_vWaits.erase(itEnd, m_vWaits.end());
+				return m_vWaits.size() != nBefore;
+			}
+
+			void Run() {
+				// Pointless with one core - the other side can't run while we spin
+				static const int nSpins = std::thread::hardware_concurrency() > 1 ? 4000 : 0;
+
+				std::unique_lock lock(m_mux);
+				while (!m_bStop) {
+					if (ResumeReady()) continue;
+
+					// Spin for a little while in case the other side is about to deliver
+					bool bReady = false;
+					for (int i = 0; i < nSpins && !bReady && !m_vWaits.empty(); i++) {
+						lock.unlock();
+						CpuRelax();
+						lock.lock();
+						bReady = ResumeReady();
+					}
+					if (bReady || m_bStop) continue;
+
+					// Then sleep until one of the rings, or Park/Cancel, bumps its signal. Each
+					// ring is marked as having a sleeper before its last check, so a write that
+					// lands after the check is sure to wake us.
+					std::vector<futex_wait_entry>& vEntries = m_vEntries;
+					vEntries.clear();
+					vEntries.push_back({ m_nWakeup.load(std::memory_order_seq_cst), uint64_t(uintptr_t(&m_nWakeup)), Futex32 | FutexPrivate, 0 });
+					for (auto* pWait : m_vWaits) {
+						if (vEntries.size() == MaxWaits) break;
+						vEntries.push_back({ pWait->pSignal->load(std::memory_order_seq_cst), uint64_t(uintptr_t(pWait->pSignal)), Futex32, 0 });
+						pWait->pAsleep->store(1, std::memory_order_seq_cst);
+					}
+					bool bAll = vEntries.size() == m_vWaits.size() + 1;
+
+					if (!ResumeReady()) {
+						m_bSleeping = true;
+						lock.unlock();
+
+						// The timeout is only a backstop - unless there are more waits than
+						// one call can take, or the kernel is too old for futex_waitv, in
+						// which case the rest are simply polled
+						bool bPoll = !bAll || m_bNoWaitv;
+						struct timespec ts;
+						if (!m_bNoWaitv) {
+							clock_gettime(CLOCK_MONOTONIC, &ts);
+							ts.tv_nsec += bPoll ? 1000 * 1000 : 100 * 1000 * 1000;
+							ts.tv_sec += ts.tv_nsec / 1000000000;
+							ts.tv_nsec %= 1000000000;
+							if (syscall(SysFutexWaitv, vEntries.data(), unsigned(vEntries.size()), 0, &ts, CLOCK_MONOTONIC) < 0 && errno == ENOSYS) {
+								m_bNoWaitv = true;
+							}
+						}
+						else {
+							ts = { 0, 1000 * 1000 };
+							syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_nWakeup), FUTEX_WAIT_PRIVATE, uint32_t(vEntries[0].nValue), &ts, nullptr, 0);
+						}
+
+						lock.lock();
+						m_bSleeping = false;
+					}
+
+					// Only waits that are still here - a cancelled one's ring may be gone
+					for (auto* pWait : m_vWaits) pWait->pAsleep->store(0, std::memory_order_seq_cst);
+				}
+			}
+
+			static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+				__builtin_ia32_pause();
+#elif defined(__aarch64__)
+				asm volatile("yield");
+#endif
+			}
+
+		private:
+			std::mutex m_mux;
+			std::vector<shm_wait*> m_vWaits;
+			std::vector<futex_wait_entry> m_vEntries;
+			std::atomic<uint32_t> m_nWakeup = 0;
+			bool m_bSleeping = false;
+			bool m_bNoWaitv = false;
+			bool m_bStop = false;
+			std::thread m_thread;
+		};
+
+
+		class shm_transport : public byte_transport {
+
+		public:
+			// bServer picks which ring is ours to write
+			shm_transport(asio::io_context& context, std::unique_ptr<shm_segment> pSegment, bool bServer)
+				: m_context(context), m_pSegment(std::move(pSegment)) {
+				auto* pHeader = m_pSegment->Header();
+				m_nRingBytes = pHeader->nRingBytes;
+				m_pOut = &pHeader->rings[bServer ? 0 : 1];
+				m_pIn = &pHeader->rings[bServer ? 1 : 0];
+				m_pOutData = m_pSegment->RingData(bServer ? 0 : 1);
+				m_pInData = m_pSegment->RingData(bServer ? 1 : 0);
+
+				Prepare(m_read, true);
+				Prepare(m_write, false);
+			}
+
+			~shm_transport() override {
+				close();
+
+				// Nothing is handed back to us from here on, and anything already on its
+				// way finds us gone. Whatever was still waiting is abandoned.
+				shm_reactor::Get().Cancel(&m_read.wait);
+				shm_reactor::Get().Cancel(&m_write.wait);
+				m_pAlive.reset();
+				for (auto* pOp : { &m_read, &m_write }) {
+					if (pOp->h) asio::post(m_context, [h = std::move(pOp->h), nDone = pOp->nDone]() { h(asio::error::operation_aborted, nDone); });
+				}
+			}
+
+			// A fresh segment for one client to attach to
+			static std::unique_ptr<shm_segment> CreateSegment(const std::string& sName, size_t nRingBytes) {
+				auto pSegment = std::make_unique<shm_segment>();
+				return pSegment->Create(sName, nRingBytes) ? std::move(pSegment) : nullptr;
+			}
+
+			// Attaches to a segment the server created, unless someone else got there first
+			static std::unique_ptr<shm_segment> AttachSegment(const std::string& sName) {
+				auto pSegment = std::make_unique<shm_segment>();
+				if (!pSegment->Open(sName)) return nullptr;
+
+				uint32_t nExpected = 0;
+				if (!pSegment->Header()->nAttached.compare_exchange_strong(nExpected, 1)) return nullptr;
+				return pSegment;
+			}
+
+			void async_read(void* pData, size_t nBytes, handler h) override {
+				Start(m_read, static_cast<uint8_t*>(pData), nBytes, std::move(h));
+			}
+
+			using byte_transport::async_write;
+			void async_write(const void* pData, size_t nBytes, handler h) override {
+				Start(m_write, const_cast<uint8_t*>(static_cast<const uint8_t*>(pData)), nBytes, std::move(h));
+			}
+
+			bool is_open() const override {
+				return !m_bLocalClosed;
+			}
+
+			void close() override {
+				if (m_bLocalClosed.exchange(true)) return;
+
+				// Wake everyone up - the reactor, if it is waiting for us, and the other process
+				auto* pHeader = m_pSegment->Header();
+				pHeader->nClosed = 1;
+				for (auto* pRing : { m_pIn, m_pOut }) {
+					pRing->nDataSignal++;
+					pRing->nSpaceSignal++;
+					Wake(pRing->nDataSignal);
+					Wake(pRing->nSpaceSignal);
+				}
+			}
+
+		private:
+			// Only ever touched on the io_context, apart from wait.fnReady
+			struct operation {
+				bool bRead = false;
+				uint8_t* pData = nullptr;
+				size_t nBytes = 0;
+				size_t nDone = 0;
+				handler h;
+				shm_wait wait;
+
+				// asio can't see the reactor, so this stops run() returning while we are
+				// parked with it
+				std::optional<asio::executor_work_guard<asio::io_context::executor_type>> work;
+			};
+
+			void Prepare(operation& op, bool bRead) {
+				op.bRead = bRead;
+				op.wait.pSignal = bRead ? &m_pIn->nDataSignal : &m_pOut->nSpaceSignal;
+				op.wait.pAsleep = bRead ? &m_pIn->nReaderAsleep : &m_pOut->nWriterAsleep;
+				op.wait.fnReady = [this, bRead]() {
+					return (bRead ? Available() > 0 : Space() > 0) || m_bLocalClosed || m_pSegment->Header()->nClosed;
+				};
+				op.wait.fnResume = [this, &op, pAlive = std::weak_ptr<int>(m_pAlive)]() {
+					asio::post(m_context, [this, &op, pAlive]() {
+						if (pAlive.lock()) Continue(op);
+					});
+				};
+			}
+
+			void Start(operation& op, uint8_t* pData, size_t nBytes, handler h) {
+				op.pData = pData;
+				op.nBytes = nBytes;
+				op.nDone = 0;
+				op.h = std::move(h);
+				Continue(op);
+			}
+
+			// Copies as much as the ring allows straight away, on the caller's thread. If
+			// that isn't everything, the reactor calls us back once there is more to do.
+			void Continue(operation& op) {
+				std::error_code ec;
+				while (op.nDone < op.nBytes) {
+					size_t n = op.bRead ? ReadSome(op.pData + op.nDone, op.nBytes - op.nDone) : WriteSome(op.pData + op.nDone, op.nBytes - op.nDone);
+					op.nDone += n;
+					if (n > 0) continue;
+
+					if (m_bLocalClosed) { ec = asio::error::operation_aborted; break; }
+					if (m_pSegment->Header()->nClosed) {
+						// Whatever the other side wrote before closing can still be read
+						if (op.bRead && Available() > 0) continue;
+						ec = op.bRead ? std::error_code(asio::error::eof) : std::error_code(asio::error::broken_pipe);
+						break;
+					}
+
+					if (!op.work) op.work.emplace(m_context.get_executor());
+					shm_reactor::Get().Park(&op.wait);
+					return;
+				}
+
+				// Cleared before the handler can start the next one
+				handler h = std::move(op.h);
+				op.h = nullptr;
+				op.work.reset();
+				asio::post(m_context, [h = std::move(h), ec, nDone = op.nDone]() { h(ec, nDone); });
+			}
+
+			size_t Available() const {
+				return size_t(m_pIn->nWritten.load(std::memory_order_acquire) - m_pIn->nRead.load(std::memory_order_relaxed));
+			}
+
+			size_t Space() const {
+				return m_nRingBytes - size_t(m_pOut->nWritten.load(std::memory_order_relaxed) - m_pOut->nRead.load(std::memory_order_acquire));
+			}
+
+			size_t ReadSome(uint8_t* pData, size_t nBytes) {
+				size_t n = std::min(nBytes, Available());
+				if (n == 0) return 0;
+
+				uint64_t nPos = m_pIn->nRead.load(std::memory_order_relaxed);
+				CopyRing(pData, m_pInData, nPos, n, true);
+				m_pIn->nRead.store(nPos + n, std::memory_order_release);
+
+				m_pIn->nSpaceSignal.fetch_add(1, std::memory_order_seq_cst);
+				if (m_pIn->nWriterAsleep.load(std::memory_order_seq_cst)) Wake(m_pIn->nSpaceSignal);
+				return n;
+			}
+
+			size_t WriteSome(const uint8_t* pData, size_t nBytes) {
+				size_t n = std::min(nBytes, Space());
+				if (n == 0) return 0;
+
+				uint64_t nPos = m_pOut->nWritten.load(std::memory_order_relaxed);
+				CopyRing(const_cast<uint8_t*>(pData), m_pOutData, nPos, n, false);
+				m_pOut->nWritten.store(nPos + n, std::memory_order_release);
+
+				m_pOut->nDataSignal.fetch_add(1, std::memory_order_seq_cst);
+				if (m_pOut->nReaderAsleep.load(std::memory_order_seq_cst)) Wake(m_pOut->nDataSignal);
+				return n;
+			}
+
+			// Copies n bytes between a buffer and the ring starting at nPos, wrapping round
+			void CopyRing(uint8_t* pBuffer, uint8_t* pRing, uint64_t nPos, size_t n, bool bFromRing) {
+				size_t nOffset = size_t(nPos % m_nRingBytes);
+				size_t nFirst = std::min(n, m_nRingBytes - nOffset);
+				if (bFromRing) {
+					std::memcpy(pBuffer, pRing + nOffset, nFirst);
+					std::memcpy(pBuffer + nFirst, pRing, n - nFirst);
+				}
+				else {
+					std::memcpy(pRing + nOffset, pBuffer, nFirst);
+					std::memcpy(pRing, pBuffer + nFirst, n - nFirst);
+				}
+			}
+
+			static void Wake(std::atomic<uint32_t>& nSignal) {
+				syscall(SYS_futex, reinterpret_cast<uint32_t*>(&nSignal), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+			}
+
+		private:
+			asio::io_context& m_context;
+			std::unique_ptr<shm_segment> m_pSegment;
+			size_t m_nRingBytes = 0;
+
+			shm_ring* m_pOut = nullptr;
+			shm_ring* m_pIn = nullptr;
+			uint8_t* m_pOutData = nullptr;
+			uint8_t* m_pInData = nullptr;
+
+			operation m_read;
+			operation m_write;
+			std::shared_ptr<int> m_pAlive = std::make_shared<int>(0);
+
+			std::atomic<bool> m_bLocalClosed = false;
+		};
+
+	}
+
+}
+
+#endif
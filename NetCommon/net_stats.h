@@ -0,0 +1,235 @@
+#pragma once
+#include "net_common.h"
+
+/*
+	Runtime statistics. Counting has to be cheap enough to leave on in production,
+	so every thread that counts something gets its own block of counters and only
+	ever writes to that (relaxed, uncontended). GetStats() walks all the blocks and
+	adds them up, which is the only time anything is shared.
+
+	Gauges such as queue depths are kept the same way, as +1 / -1 deltas that may
+	happen on different threads - only their sum means anything.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		enum class disconnect_reason : uint8_t {
+			remote_closed,		// the other end closed the socket cleanly
+			read_error,
+			write_error,
+			local,				// we called Disconnect()
+			denied,				// OnClientConnect said no
+			session_expired,	// dropped and never came back within the session window
+			policy_violation,	// broke the admission policy, see net_admission.h
+
+			count
+		};
+
+		inline const char* to_string(disconnect_reason r) {
+			switch (r) {
+			case disconnect_reason::remote_closed:		return "remote_closed";
+			case disconnect_reason::read_error:			return "read_error";
+			case disconnect_reason::write_error:		return "write_error";
+			case disconnect_reason::local:				return "local";
+			case disconnect_reason::denied:				return "denied";
+			case disconnect_reason::session_expired:	return "session_expired";
+			case disconnect_reason::policy_violation:	return "policy_violation";
+			default:									return "unknown";
+			}
+		}
+
+		enum class stat : uint8_t {
+			connections_accepted,
+			connections_active,		// gauge
+			messages_in,
+			bytes_in,
+			messages_out,
+			bytes_out,
+			queued_out,				// gauge - frames waiting in outbound lanes
+			write_stalls,			// writes that took longer than net_stats::WriteStallThreshold
+			allocations,			// message buffers allocated on the send and receive paths
+			oversized_frames,		// headers over the admission size limit
+			rate_limited,			// messages that put a client over its rate limit
+			reads_paused,			// times a client hit its share of the incoming queue
+
+			count
+		};
+
+		inline const char* to_string(stat s) {
+			switch (s) {
+			case stat::connections_accepted:	return "connections_accepted";
+			case stat::connections_active:		return "connections_active";
+			case stat::messages_in:				return "messages_in";
+			case stat::bytes_in:				return "bytes_in";
+			case stat::messages_out:			return "messages_out";
+			case stat::bytes_out:				return "bytes_out";
+			case stat::queued_out:				return "queued_out";
+			case stat::write_stalls:			return "write_stalls";
+			case stat::allocations:				return "allocations";
+			case stat::oversized_frames:		return "oversized_frames";
+			case stat::rate_limited:			return "rate_limited";
+			case stat::reads_paused:			return "reads_paused";
+			default:							return "unknown";
+			}
+		}
+
+
+		// A point in time copy of everything, safe to keep and print
+		struct stats_snapshot {
+			// message ids at or past this share the last slot
+			static constexpr size_t MaxMessageIds = 64;
+
+			uint64_t counters[size_t(stat::count)] = {};
+			uint64_t disconnects[size_t(disconnect_reason::count)] = {};
+
+			uint64_t messagesInById[MaxMessageIds] = {};
+			uint64_t bytesInById[MaxMessageIds] = {};
+			uint64_t messagesOutById[MaxMessageIds] = {};
+			uint64_t bytesOutById[MaxMessageIds] = {};
+
+			uint64_t queuedIn = 0;
+
+			uint64_t operator[](stat s) const {
+				return counters[size_t(s)];
+			}
+
+			// One "name value" pair per line, easy to scrape into a dashboard
+			std::string ToString() const {
+				std::string s;
+				auto line = [&s](const std::string& sName, uint64_t n) {
+					s += sName + " " + std::to_string(n) + "\n";
+				};
+
+				for (size_t i = 0; i < size_t(stat::count); i++) line(to_string(stat(i)), counters[i]);
+				line("queued_in", queuedIn);
+
+				for (size_t i = 0; i < size_t(disconnect_reason::count); i++) {
+					line(std::string("disconnects.") + to_string(disconnect_reason(i)), disconnects[i]);
+				}
+
+				for (size_t i = 0; i < MaxMessageIds; i++) {
+					if (messagesInById[i] == 0 && messagesOutById[i] == 0) continue;
+					std::string sId = i + 1 == MaxMessageIds ? "other" : std::to_string(i);
+					line("messages_in.id" + sId, messagesInById[i]);
+					line("bytes_in.id" + sId, bytesInById[i]);
+					line("messages_out.id" + sId, messagesOutById[i]);
+					line("bytes_out.id" + sId, bytesOutById[i]);
+				}
+				return s;
+			}
+		};
+
+
+		class net_stats {
+
+		public:
+			static constexpr std::chrono::milliseconds WriteStallThreshold{ 5 };
+
+		public:
+			net_stats() : m_nInstance(NextInstance()) {
+			}
+
+			net_stats(const net_stats&) = delete;
+
+			void Add(stat s, int64_t n = 1) {
+				Bump(Local().counters[size_t(s)], n);
+			}
+
+			void Disconnected(disconnect_reason r) {
+				Bump(Local().disconnects[size_t(r)], 1);
+			}
+
+			void MessageIn(size_t nId, size_t nBytes) {
+				auto& b = Local();
+				size_t i = std::min(nId, stats_snapshot::MaxMessageIds - 1);
+				Bump(b.counters[size_t(stat::messages_in)], 1);
+				Bump(b.counters[size_t(stat::bytes_in)], nBytes);
+				Bump(b.messagesInById[i], 1);
+				Bump(b.bytesInById[i], nBytes);
+			}
+
+			// A frame went out. Fragments of a big message count their bytes as they go,
+			// but the message itself only once, with its last fragment.
+			void FrameOut(size_t nId, size_t nBytes, bool bMessageComplete) {
+				auto& b = Local();
+				size_t i = std::min(nId, stats_snapshot::MaxMessageIds - 1);
+				Bump(b.counters[size_t(stat::bytes_out)], nBytes);
+				Bump(b.bytesOutById[i], nBytes);
+				if (bMessageComplete) {
+					Bump(b.counters[size_t(stat::messages_out)], 1);
+					Bump(b.messagesOutById[i], 1);
+				}
+			}
+
+			// Adds up every thread's block. Can be called from any thread.
+			stats_snapshot Snapshot() {
+				stats_snapshot snap;
+				std::scoped_lock lock(muxBlocks);
+				for (auto& pBlock : m_vBlocks) {
+					auto& b = *pBlock;
+					for (size_t i = 0; i < size_t(stat::count); i++) snap.counters[i] += b.counters[i].load(std::memory_order_relaxed);
+					for (size_t i = 0; i < size_t(disconnect_reason::count); i++) snap.disconnects[i] += b.disconnects[i].load(std::memory_order_relaxed);
+					for (size_t i = 0; i < stats_snapshot::MaxMessageIds; i++) {
+						snap.messagesInById[i] += b.messagesInById[i].load(std::memory_order_relaxed);
+						snap.bytesInById[i] += b.bytesInById[i].load(std::memory_order_relaxed);
+						snap.messagesOutById[i] += b.messagesOutById[i].load(std::memory_order_relaxed);
+						snap.bytesOutById[i] += b.bytesOutById[i].load(std::memory_order_relaxed);
+					}
+				}
+				return snap;
+			}
+
+		private:
+			struct block {
+				std::atomic<uint64_t> counters[size_t(stat::count)] = {};
+				std::atomic<uint64_t> disconnects[size_t(disconnect_reason::count)] = {};
+				std::atomic<uint64_t> messagesInById[stats_snapshot::MaxMessageIds] = {};
+				std::atomic<uint64_t> bytesInById[stats_snapshot::MaxMessageIds] = {};
+				std::atomic<uint64_t> messagesOutById[stats_snapshot::MaxMessageIds] = {};
+				std::atomic<uint64_t> bytesOutById[stats_snapshot::MaxMessageIds] = {};
+			};
+
+			// Only the owning thread writes, so a plain load + store is enough - no locked
+			// read-modify-write on the hot path. Gauges wrap around below zero per block,
+			// which comes out right once the blocks are added together.
+			static void Bump(std::atomic<uint64_t>& n, int64_t nDelta) {
+				n.store(n.load(std::memory_order_relaxed) + uint64_t(nDelta), std::memory_order_relaxed);
+			}
+
+			block& Local() {
+				// Each thread remembers the block it got from the last stats object it
+				// counted into. Instances are numbered rather than compared by address so
+				// a new server at an old one's address never picks up a dead block.
+				thread_local uint64_t nCachedInstance = 0;
+				thread_local block* pCached = nullptr;
+
+				if (nCachedInstance != m_nInstance) {
+					std::scoped_lock lock(muxBlocks);
+					auto& pBlock = m_mapThreadBlocks[std::this_thread::get_id()];
+					if (!pBlock) {
+						m_vBlocks.push_back(std::make_unique<block>());
+						pBlock = m_vBlocks.back().get();
+					}
+					pCached = pBlock;
+					nCachedInstance = m_nInstance;
+				}
+				return *pCached;
+			}
+
+			static uint64_t NextInstance() {
+				static std::atomic<uint64_t> nInstances = 0;
+				return ++nInstances;
+			}
+
+		private:
+			const uint64_t m_nInstance;
+			std::mutex muxBlocks;
+			std::vector<std::unique_ptr<block>> m_vBlocks;
+			std::unordered_map<std::thread::id, block*> m_mapThreadBlocks;
+		};
+
+	}
+
+}
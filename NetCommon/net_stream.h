@@ -0,0 +1,73 @@
+#pragma once
+#include "net_common.h"
+#include "net_message.h"
+
+/*
+	Streaming delivery - large messages handed over a piece at a time as they
+	arrive, rather than once the whole body is in memory.
+
+	Normally a message sent in fragments (see net_lanes.h) is put back together
+	before it reaches OnMessage, which means holding all of it. For things like
+	map downloads or replays that is a lot of memory per connection for no good
+	reason, so a message id can be given a handler instead:
+
+		server.SetStreamHandler(MsgTypes::MapChunk, [](auto client, const stream_chunk<MsgTypes>& chunk) {
+			file.write(chunk.pData, chunk.nSize);		// chunk.nOffset of chunk.header.size
+			if (chunk.bLast) ...
+		});
+
+	Every message with that id then goes to the handler and never to OnMessage -
+	small ones in a single chunk. The connection never holds more than one read's
+	worth of a streamed message.
+
+	The handler runs on the asio thread, in order, one chunk at a time. Keep it
+	short: the connection reads nothing else while it runs. If the connection drops
+	part way through and the session resumes, the message starts again from
+	offset 0. Streamed messages are not recorded by traffic_recorder.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		template <typename T>
+		class connection;
+
+
+		template <typename T>
+		struct stream_chunk {
+			message_header<T> header;		// size is the whole message's
+			size_t nOffset = 0;				// where pData goes within the body
+			const uint8_t* pData = nullptr;
+			size_t nSize = 0;
+			bool bLast = false;
+		};
+
+		template <typename T>
+		using stream_handler = std::function<void(std::shared_ptr<connection<T>>, const stream_chunk<T>&)>;
+
+
+		// Handlers by message id. Connections share one of these and it doesn't change
+		// underneath them - setting a handler makes a new one.
+		template <typename T>
+		class stream_table {
+
+		public:
+			void Set(T id, stream_handler<T> handler) {
+				size_t i = size_t(id);
+				if (i >= m_vHandlers.size()) m_vHandlers.resize(i + 1);
+				m_vHandlers[i] = std::move(handler);
+			}
+
+			const stream_handler<T>* Find(T id) const {
+				size_t i = size_t(id);
+				return i < m_vHandlers.size() && m_vHandlers[i] ? &m_vHandlers[i] : nullptr;
+			}
+
+		private:
+			std::vector<stream_handler<T>> m_vHandlers;
+		};
+
+	}
+
+}
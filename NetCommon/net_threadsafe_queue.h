@@ -78,6 +78,15 @@ namespace olc {
 				return t;
 			}
 
+			// Everything queued so far, for one lock instead of one per item. Passing the
+			// same deque back in every time lets the queue and it trade blocks.
+			size_t pop_all(std::deque<T>& deqOut) {
+				deqOut.clear();
+				std::scoped_lock lock(muxQueue);
+				deqQueue.swap(deqOut);
+				return deqOut.size();
+			}
+
 
 
 
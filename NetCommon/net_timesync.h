@@ -0,0 +1,100 @@
+#pragma once
+#include "net_common.h"
+
+/*
+	Time sync - round trip time, jitter and the other end's clock, per connection.
+
+	Every so often each end sends a time_sync request stamped with its own
+	steady_clock (t0). The other end stamps when it read it (t1) and when it
+	answered (t2), and the answer is stamped again when it arrives back (t3).
+	As with NTP:
+
+		round trip	= (t3 - t0) - (t2 - t1)		the time the other end sat on it doesn't count
+		offset		= ((t1 - t0) + (t2 - t3)) / 2	their clock minus ours
+
+	The offset is only exact if both directions took equally long, and the less
+	time a sample spent in queues the more likely that is - so the offset is taken
+	from whichever of the last few samples had the shortest round trip, not
+	averaged. Jitter is how much consecutive round trips differ (RFC 3550).
+
+	steady_clock never jumps, unlike the system clock, and the offset absorbs the
+	two machines' clocks having started at different times. Drift between them is
+	a few parts per million, which the regular samples keep up with.
+
+	Leave bNoDelay (net_latency.h) off and a small frame can wait out the other
+	end's delayed ACK, which shows up as tens of milliseconds of round trip.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		struct time_sync_policy {
+			bool bEnabled = true;
+			std::chrono::milliseconds interval{ 1000 };
+			std::chrono::milliseconds burstInterval{ 100 };		// the first nBurst samples come quicker
+			size_t nBurst = 5;
+			size_t nWindow = 8;		// samples the offset is picked from
+		};
+
+
+		class clock_estimator {
+
+		public:
+			clock_estimator(size_t nWindow = 8) : m_vWindow(std::max<size_t>(nWindow, 1)) {
+			}
+
+			// One exchange, t0 and t3 on our clock, t1 and t2 on theirs, all in ns.
+			// Returns the round trip, or -1 if the stamps make no sense.
+			int64_t Sample(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+				int64_t nRtt = (t3 - t0) - (t2 - t1);
+				if (t3 < t0 || t2 < t1 || nRtt < 0) return -1;
+				int64_t nOffset = ((t1 - t0) + (t2 - t3)) / 2;
+
+				if (m_nSamples > 0) {
+					int64_t nDelta = std::abs(nRtt - m_nLastRtt);
+					m_nJitter += (nDelta - m_nJitter) / 16;
+				}
+				m_nLastRtt = nRtt;
+
+				m_vWindow[m_nSamples % m_vWindow.size()] = { nRtt, nOffset };
+				m_nSamples++;
+
+				size_t nValid = std::min<size_t>(m_nSamples, m_vWindow.size());
+				size_t nBest = 0;
+				for (size_t i = 1; i < nValid; i++) {
+					if (m_vWindow[i].nRtt < m_vWindow[nBest].nRtt) nBest = i;
+				}
+				m_nOffset = m_vWindow[nBest].nOffset;
+				return nRtt;
+			}
+
+			// Their clock minus ours
+			int64_t Offset() const {
+				return m_nOffset;
+			}
+
+			int64_t Jitter() const {
+				return m_nJitter;
+			}
+
+			uint64_t Samples() const {
+				return m_nSamples;
+			}
+
+		private:
+			struct sample {
+				int64_t nRtt = 0;
+				int64_t nOffset = 0;
+			};
+
+			std::vector<sample> m_vWindow;
+			uint64_t m_nSamples = 0;
+			int64_t m_nLastRtt = 0;
+			int64_t m_nJitter = 0;
+			int64_t m_nOffset = 0;
+		};
+
+	}
+
+}
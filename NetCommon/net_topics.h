@@ -0,0 +1,98 @@
+#pragma once
+#include "net_common.h"
+
+/*
+	Topics - named groups of connections (a party, a guild, a chat channel, an
+	instance) that can be messaged all at once with server_interface::Publish.
+
+	Each topic keeps its members in a dense vector, and each connection remembers
+	where it sits in every topic it belongs to, so unsubscribing is a swap with
+	the last member rather than a search. Nothing here is locked - like
+	OnMessage, it is only ever touched from the thread calling Update().
+*/
+
+namespace olc {
+
+	namespace net {
+
+		using topic_id = uint32_t;
+
+		template <typename T>
+		class connection;
+
+		template <typename T>
+		class topic_registry {
+
+		public:
+			// false if the connection was already a member
+			bool Subscribe(const std::shared_ptr<connection<T>>& client, topic_id topic) {
+				auto& mapPositions = m_mapMemberships[client.get()];
+				if (mapPositions.count(topic)) return false;
+
+				auto& vMembers = m_mapTopics[topic];
+				mapPositions[topic] = vMembers.size();
+				vMembers.push_back(client);
+				return true;
+			}
+
+			// false if the connection wasn't a member
+			bool Unsubscribe(connection<T>* pClient, topic_id topic) {
+				auto itClient = m_mapMemberships.find(pClient);
+				if (itClient == m_mapMemberships.end()) return false;
+
+				auto itPos = itClient->second.find(topic);
+				if (itPos == itClient->second.end()) return false;
+
+				RemoveMember(topic, itPos->second);
+				itClient->second.erase(itPos);
+				if (itClient->second.empty()) m_mapMemberships.erase(itClient);
+				return true;
+			}
+
+			// Takes a connection out of everything it subscribed to
+			void UnsubscribeAll(connection<T>* pClient) {
+				auto itClient = m_mapMemberships.find(pClient);
+				if (itClient == m_mapMemberships.end()) return;
+
+				for (auto& [topic, nPos] : itClient->second) {
+					RemoveMember(topic, nPos);
+				}
+				m_mapMemberships.erase(itClient);
+			}
+
+			// Members in no particular order - it changes as others leave
+			const std::vector<std::shared_ptr<connection<T>>>& Members(topic_id topic) const {
+				static const std::vector<std::shared_ptr<connection<T>>> vNone;
+				auto it = m_mapTopics.find(topic);
+				return it != m_mapTopics.end() ? it->second : vNone;
+			}
+
+			void Clear() {
+				m_mapTopics.clear();
+				m_mapMemberships.clear();
+			}
+
+		private:
+			void RemoveMember(topic_id topic, size_t nPos) {
+				auto itTopic = m_mapTopics.find(topic);
+				auto& vMembers = itTopic->second;
+
+				// Move the last member into the gap and tell it where it now lives
+				if (nPos + 1 != vMembers.size()) {
+					vMembers[nPos] = std::move(vMembers.back());
+					m_mapMemberships[vMembers[nPos].get()][topic] = nPos;
+				}
+				vMembers.pop_back();
+
+				if (vMembers.empty()) m_mapTopics.erase(itTopic);
+			}
+
+		private:
+			std::unordered_map<topic_id, std::vector<std::shared_ptr<connection<T>>>> m_mapTopics;
+			// connection -> (topic -> position in that topic's member list)
+			std::unordered_map<connection<T>*, std::unordered_map<topic_id, size_t>> m_mapMemberships;
+		};
+
+	}
+
+}
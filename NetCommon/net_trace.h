@@ -0,0 +1,395 @@
+#pragma once
+#include "net_common.h"
+#include <condition_variable>
+#include <cstdio>
+
+/*
+	Timeline tracing - which thread did what, and for how long, around a stall the
+	counters in net_stats.h can only say happened.
+
+		trace_zone zone("on_message", "id", uint64_t(msg.header.id));	// to the end of the scope
+
+	- Compiled out unless OLC_NET_TRACE is defined to 1 before including any of this.
+	  Then a zone costs two clock reads and a handful of relaxed stores into a ring
+	  belonging to the calling thread - no locks, no allocation.
+	- Rings overwrite their oldest events, so at any moment they hold the last
+	  Capacity events of every thread: a flight recorder rather than a log.
+	- Dump(path) writes what is there as Chrome trace-event JSON, which chrome://tracing
+	  and ui.perfetto.dev open. Zones show up as nested bars per thread, async spans
+	  (a write from being issued to its completion) on tracks of their own.
+	- SetTrigger(threshold, prefix) has a background thread write prefix_N.json
+	  whenever a zone takes longer than threshold, at most once per cooldown - leave
+	  it on and the spike is waiting for you afterwards.
+
+	The connection records read_header, read_body, read_fragment, enqueue and write,
+	with the write and body read also as async spans. The server records accept,
+	update, on_message, broadcast and publish.
+*/
+
+#ifndef OLC_NET_TRACE
+#define OLC_NET_TRACE 0
+#endif
+
+namespace olc {
+
+	namespace net {
+
+		constexpr bool trace_enabled = OLC_NET_TRACE != 0;
+
+		enum class trace_kind : uint8_t {
+			zone,		// a scope on the recording thread
+			span		// an async operation, shown on a track of its own keyed by nArg
+		};
+
+		// Fields are atomics only so a dump can read a ring while its thread writes to
+		// it, all the accesses are relaxed
+		struct trace_event {
+			std::atomic<const char*> sName = nullptr;
+			std::atomic<const char*> sArg = nullptr;
+			std::atomic<int64_t> nStart = 0;		// ns since the trace started
+			std::atomic<int64_t> nDuration = 0;
+			std::atomic<uint64_t> nArg = 0;
+			std::atomic<trace_kind> kind = trace_kind::zone;
+		};
+
+		// A plain copy, for the dump
+		struct trace_record {
+			const char* sName;
+			const char* sArg;
+			int64_t nStart;
+			int64_t nDuration;
+			uint64_t nArg;
+			trace_kind kind;
+			uint32_t nThread;
+		};
+
+
+		// Single producer (the owning thread), read by whoever is dumping
+		class trace_ring {
+
+		public:
+			static constexpr size_t Capacity = 8192;
+
+			void Push(const char* sName, const char* sArg, int64_t nStart, int64_t nDuration, uint64_t nArg, trace_kind kind) {
+				size_t nWrite = m_nWrite.load(std::memory_order_relaxed);
+				// Orders the stores below after the count a reader checks against
+				std::atomic_thread_fence(std::memory_order_release);
+				auto& e = m_events[nWrite % Capacity];
+				e.sName.store(sName, std::memory_order_relaxed);
+				e.sArg.store(sArg, std::memory_order_relaxed);
+				e.nStart.store(nStart, std::memory_order_relaxed);
+				e.nDuration.store(nDuration, std::memory_order_relaxed);
+				e.nArg.store(nArg, std::memory_order_relaxed);
+				e.kind.store(kind, std::memory_order_relaxed);
+				m_nWrite.store(nWrite + 1, std::memory_order_release);
+			}
+
+			// Copies out what the ring holds. Anything the owning thread may have been
+			// overwriting while we copied is left out.
+			void Read(std::vector<trace_record>& vOut) const {
+				size_t nEnd = m_nWrite.load(std::memory_order_acquire);
+				size_t nBegin = nEnd > Capacity ? nEnd - Capacity : 0;
+
+				size_t nFirst = vOut.size();
+				for (size_t i = nBegin; i < nEnd; i++) {
+					auto& e = m_events[i % Capacity];
+					vOut.push_back({ e.sName.load(std::memory_order_relaxed), e.sArg.load(std::memory_order_relaxed),
+						e.nStart.load(std::memory_order_relaxed), e.nDuration.load(std::memory_order_relaxed),
+						e.nArg.load(std::memory_order_relaxed), e.kind.load(std::memory_order_relaxed), nThread });
+				}
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				size_t nNow = m_nWrite.load(std::memory_order_relaxed);
+				size_t nValid = nNow >= Capacity ? nNow - Capacity + 1 : 0;
+				if (nValid > nBegin) {
+					size_t nTorn = std::min(nValid - nBegin, nEnd - nBegin);
+					vOut.erase(vOut.begin() + nFirst, vOut.begin() + nFirst + nTorn);
+				}
+			}
+
+			void Reset() {
+				m_nWrite.store(0, std::memory_order_relaxed);
+				sThreadName = nullptr;
+				bAbandoned = false;
+			}
+
+			uint32_t nThread = 0;
+			std::atomic<const char*> sThreadName = nullptr;
+			std::atomic<bool> bAbandoned = false;	// its thread has exited, free for the next one
+
+		private:
+			alignas(64) std::atomic<size_t> m_nWrite = 0;
+			trace_event m_events[Capacity];
+		};
+
+
+		class trace_log {
+
+		public:
+			static trace_log& Get() {
+				static trace_log trace;
+				return trace;
+			}
+
+			trace_log(const trace_log&) = delete;
+
+			~trace_log() {
+				{
+					std::scoped_lock lock(m_muxWake);
+					m_bStop = true;
+				}
+				m_cvWake.notify_one();
+				if (m_thread.joinable()) m_thread.join();
+			}
+
+			void Zone(const char* sName, const char* sArg, std::chrono::steady_clock::time_point tpStart,
+				std::chrono::steady_clock::time_point tpEnd, uint64_t nArg) {
+				int64_t nDuration = (tpEnd - tpStart).count();
+				Local().Push(sName, sArg, (tpStart - m_tpStart).count(), nDuration, nArg, trace_kind::zone);
+
+				if (nDuration > m_nTrigger.load(std::memory_order_relaxed)) m_bTriggered.store(true, std::memory_order_relaxed);
+			}
+
+			void Span(const char* sName, std::chrono::steady_clock::time_point tpStart,
+				std::chrono::steady_clock::time_point tpEnd, uint64_t nTrack) {
+				Local().Push(sName, nullptr, (tpStart - m_tpStart).count(), (tpEnd - tpStart).count(), nTrack, trace_kind::span);
+			}
+
+			// What the calling thread is called in the viewer. sName must outlive the trace.
+			void ThreadName(const char* sName) {
+				Local().sThreadName = sName;
+			}
+
+			// Whenever a zone takes longer than threshold, write sPrefix_N.json from a
+			// background thread - at most once per cooldown, and nMaxCaptures in all
+			void SetTrigger(std::chrono::nanoseconds threshold, const std::string& sPrefix,
+				std::chrono::milliseconds cooldown = std::chrono::seconds(10), size_t nMaxCaptures = 10) {
+				{
+					std::scoped_lock lock(m_muxWake);
+					m_sPrefix = sPrefix;
+					m_cooldown = cooldown;
+					m_nMaxCaptures = nMaxCaptures;
+					if (!m_thread.joinable()) m_thread = std::thread([this]() { Watch(); });
+				}
+				m_bTriggered = false;
+				m_nTrigger = threshold.count();
+			}
+
+			void ClearTrigger() {
+				m_nTrigger = std::numeric_limits<int64_t>::max();
+			}
+
+			// Captures written by the trigger so far
+			size_t Captures() const {
+				return m_nCaptures;
+			}
+
+			// Everything the rings hold right now, oldest first
+			std::vector<trace_record> Snapshot() {
+				std::vector<trace_record> v;
+				{
+					std::scoped_lock lock(m_muxRings);
+					for (auto& pRing : m_vRings) pRing->Read(v);
+				}
+				std::stable_sort(v.begin(), v.end(), [](const trace_record& a, const trace_record& b) { return a.nStart < b.nStart; });
+				return v;
+			}
+
+			// The whole capture as Chrome trace-event JSON
+			std::string Json() {
+				auto vRecords = Snapshot();
+
+				std::string s = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+				bool bFirst = true;
+				auto next = [&]() {
+					if (!bFirst) s += ",\n";
+					bFirst = false;
+				};
+
+				{
+					std::scoped_lock lock(m_muxRings);
+					for (auto& pRing : m_vRings) {
+						const char* sName = pRing->sThreadName.load();
+						if (!sName) continue;
+						next();
+						s += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(pRing->nThread) +
+							",\"args\":{\"name\":\"" + Escape(sName) + "\"}}";
+					}
+				}
+
+				char sNumber[64];
+				for (auto& r : vRecords) {
+					if (!r.sName) continue;
+					std::string sName = Escape(r.sName);
+					std::string sTid = std::to_string(r.nThread);
+
+					if (r.kind == trace_kind::zone) {
+						next();
+						std::snprintf(sNumber, sizeof(sNumber), "%.3f,\"dur\":%.3f", double(r.nStart) / 1000.0, double(r.nDuration) / 1000.0);
+						s += "{\"name\":\"" + sName + "\",\"cat\":\"net\",\"ph\":\"X\",\"ts\":" + sNumber + ",\"pid\":1,\"tid\":" + sTid;
+						if (r.sArg) s += ",\"args\":{\"" + Escape(r.sArg) + "\":" + std::to_string(r.nArg) + "}";
+						s += "}";
+					}
+					else {
+						std::string sId = std::to_string(r.nArg);
+						next();
+						std::snprintf(sNumber, sizeof(sNumber), "%.3f", double(r.nStart) / 1000.0);
+						s += "{\"name\":\"" + sName + "\",\"cat\":\"net\",\"ph\":\"b\",\"id\":" + sId + ",\"ts\":" + sNumber + ",\"pid\":1,\"tid\":" + sTid + "}";
+						next();
+						std::snprintf(sNumber, sizeof(sNumber), "%.3f", double(r.nStart + r.nDuration) / 1000.0);
+						s += "{\"name\":\"" + sName + "\",\"cat\":\"net\",\"ph\":\"e\",\"id\":" + sId + ",\"ts\":" + sNumber + ",\"pid\":1,\"tid\":" + sTid + "}";
+					}
+				}
+
+				s += "\n]}\n";
+				return s;
+			}
+
+			bool Dump(const std::string& sPath) {
+				std::string s = Json();
+				std::FILE* pFile = std::fopen(sPath.c_str(), "w");
+				if (!pFile) return false;
+				bool bOk = std::fwrite(s.data(), 1, s.size(), pFile) == s.size();
+				return std::fclose(pFile) == 0 && bOk;
+			}
+
+		private:
+			trace_log() : m_tpStart(std::chrono::steady_clock::now()) {
+			}
+
+			// The calling thread's ring, made on first use - or one left behind by a thread
+			// that has exited, so threads coming and going don't keep adding rings
+			trace_ring& Local() {
+				struct holder {
+					std::shared_ptr<trace_ring> p;
+					~holder() { if (p) p->bAbandoned = true; }
+				};
+				thread_local holder h;
+				if (!h.p) {
+					std::scoped_lock lock(m_muxRings);
+					for (auto& pRing : m_vRings) {
+						if (!pRing->bAbandoned) continue;
+						pRing->Reset();
+						h.p = pRing;
+						break;
+					}
+					if (!h.p) {
+						h.p = std::make_shared<trace_ring>();
+						h.p->nThread = uint32_t(m_vRings.size() + 1);
+						m_vRings.push_back(h.p);
+					}
+				}
+				return *h.p;
+			}
+
+			void Watch() {
+				std::chrono::steady_clock::time_point tpLast;
+				bool bCaptured = false;
+				std::unique_lock lock(m_muxWake);
+				while (!m_bStop) {
+					m_cvWake.wait_for(lock, std::chrono::milliseconds(10));
+					if (!m_bTriggered.exchange(false)) continue;
+
+					auto tpNow = std::chrono::steady_clock::now();
+					if (m_nCaptures >= m_nMaxCaptures || (bCaptured && tpNow - tpLast < m_cooldown)) continue;
+					tpLast = tpNow;
+					bCaptured = true;
+
+					std::string sPath = m_sPrefix + "_" + std::to_string(m_nCaptures.load()) + ".json";
+					lock.unlock();
+					bool bOk = Dump(sPath);
+					lock.lock();
+					if (bOk) m_nCaptures++;
+				}
+			}
+
+			static std::string Escape(const char* s) {
+				std::string sOut;
+				for (; *s; s++) {
+					if (*s == '"' || *s == '\\') sOut += '\\';
+					if (uint8_t(*s) >= 0x20) sOut += *s;
+				}
+				return sOut;
+			}
+
+		private:
+			std::chrono::steady_clock::time_point m_tpStart;
+
+			std::mutex m_muxRings;
+			std::vector<std::shared_ptr<trace_ring>> m_vRings;
+
+			std::atomic<int64_t> m_nTrigger = std::numeric_limits<int64_t>::max();
+			std::atomic<bool> m_bTriggered = false;
+			std::atomic<size_t> m_nCaptures = 0;
+			std::string m_sPrefix;
+			std::chrono::milliseconds m_cooldown{ 0 };
+			size_t m_nMaxCaptures = 0;
+
+			std::mutex m_muxWake;
+			std::condition_variable m_cvWake;
+			std::thread m_thread;
+			bool m_bStop = false;
+		};
+
+
+		// Records from construction to the end of the scope. Does nothing at all unless
+		// OLC_NET_TRACE is on. sName and sArg must be string literals, only the pointers
+		// are kept.
+		class trace_zone {
+
+		public:
+			trace_zone(const char* sName, const char* sArg = nullptr, uint64_t nArg = 0) {
+				if constexpr (trace_enabled) {
+					m_sName = sName;
+					m_sArg = sArg;
+					m_nArg = nArg;
+					m_tpStart = std::chrono::steady_clock::now();
+				}
+			}
+
+			~trace_zone() {
+				if constexpr (trace_enabled) {
+					auto tpEnd = std::chrono::steady_clock::now();
+					if (tpEnd - m_tpStart < m_minimum) return;
+					trace_log::Get().Zone(m_sName, m_sArg, m_tpStart, tpEnd, m_nArg);
+				}
+			}
+
+			trace_zone(const trace_zone&) = delete;
+			trace_zone& operator=(const trace_zone&) = delete;
+
+			// For an argument only known by the end, such as how much was done
+			void Arg(uint64_t nArg) {
+				m_nArg = nArg;
+			}
+
+			// Don't record it after all unless it took at least this long - for loops that
+			// mostly find nothing to do and would otherwise fill the ring with it
+			void DropBelow(std::chrono::nanoseconds minimum) {
+				m_minimum = minimum;
+			}
+
+		private:
+			const char* m_sName = nullptr;
+			const char* m_sArg = nullptr;
+			uint64_t m_nArg = 0;
+			std::chrono::steady_clock::time_point m_tpStart;
+			std::chrono::nanoseconds m_minimum{ 0 };
+		};
+
+		// An async operation from tpStart until now, on the track nTrack
+		inline void TraceSpan(const char* sName, std::chrono::steady_clock::time_point tpStart, uint64_t nTrack) {
+			if constexpr (trace_enabled) {
+				trace_log::Get().Span(sName, tpStart, std::chrono::steady_clock::now(), nTrack);
+			}
+		}
+
+		inline void TraceThreadName(const char* sName) {
+			if constexpr (trace_enabled) {
+				trace_log::Get().ThreadName(sName);
+			}
+		}
+
+	}
+
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include "net_common.h"
+
+/*
+	A connection normally reads and writes its TCP socket directly. Anything else
+	that can move bytes in order between two ends - see net_shm.h, or
+	memory_transport below - can stand in for the socket by implementing this, and
+	the connection above it (framing, lanes, sessions, stats...) carries on exactly
+	as it would over TCP.
+*/
+
+namespace olc {
+
+	namespace net {
+
+		class byte_transport {
+
+		public:
+			using handler = std::function<void(std::error_code, std::size_t)>;
+
+			virtual ~byte_transport() = default;
+
+			// Like asio::async_read / async_write - the handler runs on the connection's
+			// io_context once all n bytes are done, or with an error. One of each at a time.
+			// Reading after the other end has closed fails with asio::error::eof, anything
+			// still pending when close() is called fails with asio::error::operation_aborted.
+			virtual void async_read(void* pData, size_t nBytes, handler h) = 0;
+			virtual void async_write(const void* pData, size_t nBytes, handler h) = 0;
+
+			// A frame's header and body as one write. Over TCP the two must go out
+			// together - a body written on its own waits (Nagle) for the header's ACK,
+			// which the other end delays. Off TCP there is no such problem, and this
+			// default simply writes one after the other.
+			virtual void async_write(const void* pHead, size_t nHead, const void* pBody, size_t nBody, handler h) {
+				if (nBody == 0) {
+					async_write(pHead, nHead, std::move(h));
+					return;
+				}
+				async_write(pHead, nHead, [this, pBody, nHead, nBody, h = std::move(h)](std::error_code ec, std::size_t length) mutable {
+					if (ec) {
+						h(ec, length);
+						return;
+					}
+					async_write(pBody, nBody, [nHead, h = std::move(h)](std::error_code ec, std::size_t length) { h(ec, nHead + length); });
+				});
+			}
+
+			virtual bool is_open() const = 0;
+			virtual void close() = 0;
+		};
+
+
+		// Two transports joined back to back inside one process - whatever one writes,
+		// the other reads. No sockets involved, which makes it handy for benchmarks
+		// and for trying out connection code.
+		class memory_transport : public byte_transport {
+
+		public:
+			static std::pair<std::unique_ptr<byte_transport>, std::unique_ptr<byte_transport>>
+				CreatePair(asio::io_context& contextA, asio::io_context& contextB) {
+				auto pAtoB = std::make_shared<channel>();
+				auto pBtoA = std::make_shared<channel>();
+				return {
+					std::unique_ptr<byte_transport>(new memory_transport(contextA, pBtoA, pAtoB)),
+					std::unique_ptr<byte_transport>(new memory_transport(contextB, pAtoB, pBtoA))
+				};
+			}
+
+			~memory_transport() override {
+				close();
+			}
+
+			void async_read(void* pData, size_t nBytes, handler h) override {
+				std::scoped_lock lock(m_pIn->mux);
+				m_pIn->read = { static_cast<uint8_t*>(pData), nBytes, std::move(h), &m_context };
+				m_pIn->work.emplace(m_context.get_executor());
+				m_pIn->TryCompleteRead();
+			}
+
+			void async_write(const void* pData, size_t nBytes, handler h) override {
+				std::error_code ec;
+				{
+					std::scoped_lock lock(m_pOut->mux);
+					if (m_pOut->bClosed) {
+						ec = asio::error::broken_pipe;
+						nBytes = 0;
+					}
+					else {
+						auto p = static_cast<const uint8_t*>(pData);
+						m_pOut->vBuffer.insert(m_pOut->vBuffer.end(), p, p + nBytes);
+						m_pOut->TryCompleteRead();
+					}
+				}
+				asio::post(m_context, [h = std::move(h), ec, nBytes]() { h(ec, nBytes); });
+			}
+			using byte_transport::async_write;
+
+			bool is_open() const override {
+				return !m_bClosed;
+			}
+
+			void close() override {
+				if (m_bClosed.exchange(true)) return;
+				{
+					// Our own read is abandoned...
+					std::scoped_lock lock(m_pIn->mux);
+					m_pIn->bClosed = true;
+					m_pIn->TryCompleteRead(asio::error::operation_aborted);
+				}
+				{
+					// ...the other end's finishes what it can and then sees eof
+					std::scoped_lock lock(m_pOut->mux);
+					m_pOut->bClosed = true;
+					m_pOut->TryCompleteRead();
+				}
+			}
+
+		private:
+			// One direction. Bytes are appended at the back and consumed from nReadPos.
+			struct channel {
+				struct pending_read {
+					uint8_t* pData = nullptr;
+					size_t nBytes = 0;
+					handler h;
+					asio::io_context* pContext = nullptr;
+				};
+
+				std::mutex mux;
+				std::vector<uint8_t> vBuffer;
+				size_t nReadPos = 0;
+				pending_read read;
+				std::optional<asio::executor_work_guard<asio::io_context::executor_type>> work;
+				bool bClosed = false;
+
+				// mux held
+				void TryCompleteRead(std::error_code ec = {}) {
+					if (!read.h) return;
+
+					size_t nAvailable = vBuffer.size() - nReadPos;
+					if (!ec) {
+						if (nAvailable >= read.nBytes) {
+							std::memcpy(read.pData, vBuffer.data() + nReadPos, read.nBytes);
+							nReadPos += read.nBytes;
+							if (nReadPos == vBuffer.size()) {
+								vBuffer.clear();
+								nReadPos = 0;
+							}
+							else if (nReadPos > 65536 && nReadPos * 2 > vBuffer.size()) {
+								vBuffer.erase(vBuffer.begin(), vBuffer.begin() + nReadPos);
+								nReadPos = 0;
+							}
+						}
+						else if (bClosed) {
+							ec = asio::error::eof;
+						}
+						else {
+							return;
+						}
+					}
+
+					asio::post(*read.pContext, [h = std::move(read.h), ec, n = ec ? 0 : read.nBytes]() { h(ec, n); });
+					read = {};
+					work.reset();
+				}
+			};
+
+			memory_transport(asio::io_context& context, std::shared_ptr<channel> pIn, std::shared_ptr<channel> pOut)
+				: m_context(context), m_pIn(std::move(pIn)), m_pOut(std::move(pOut)) {
+			}
+
+		private:
+			asio::io_context& m_context;
+			std::shared_ptr<channel> m_pIn;
+			std::shared_ptr<channel> m_pOut;
+			std::atomic<bool> m_bClosed = false;
+		};
+
+	}
+
+}
@@ -0,0 +1,737 @@
+#pragma once
+#include "net_common.h"
+#include "net_transport.h"
+#include "net_log.h"
+
+/*
+	An io_uring backend for TCP connections on Linux.
+
+	Over asio's default reactor every read costs an epoll wake-up plus a recv(), and
+	every write a send() of its own. Here a connection's socket is handed to a
+	uring_loop shared by every connection on the same io_context instead:
+
+	- Reads are one multishot receive per socket, armed once. The kernel picks a
+	  buffer from a ring of them registered up front, fills it and posts a
+	  completion - no syscall from us per read at all.
+	- Writes from all connections are queued as they come and submitted together
+	  with one io_uring_enter() at the end of whatever asio was running at the time.
+	- Completions raise an eventfd that asio waits on, so the loop needs no thread of
+	  its own and handlers run on the io_context thread like any others. One wake-up
+	  covers every completion that arrived in the meantime.
+
+	Turning it on:
+
+		server.SetSocketBackend(olc::net::socket_backend::uring);	// before Start()
+		client.SetSocketBackend(olc::net::socket_backend::uring);	// before Connect()
+
+	If the kernel can't do it (older than 6.0, io_uring disabled by a sysctl or a
+	seccomp profile...) Create() says why in the log and returns nullptr, and the
+	connections stay on the normal asio path. Define OLC_NET_URING 0 to leave all of
+	this out of the build, e.g. when the kernel headers are too old to compile it.
+
+	Everything below except close() and is_open() must be called on the io_context
+	thread, the same rule as for an asio socket.
+*/
+
+#ifndef OLC_NET_URING
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define OLC_NET_URING 1
+#endif
+#endif
+#endif
+
+#ifndef OLC_NET_URING
+#define OLC_NET_URING 0
+#endif
+
+#if OLC_NET_URING
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <unordered_map>
+#endif
+
+namespace olc {
+
+	namespace net {
+
+		// How a server or client does its socket I/O
+		enum class socket_backend {
+			asio,		// asio's reactor (epoll on Linux) - works everywhere
+			uring		// io_uring where available, asio otherwise
+		};
+
+		struct uring_options {
+			uint32_t nEntries = 1024;			// submission queue size
+			uint32_t nBuffers = 256;			// receive buffers, a power of 2
+			uint32_t nBufferBytes = 16 * 1024;
+			size_t nInboxLimit = 256 * 1024;	// per socket, received but not yet read
+		};
+
+		// Counters since the loop was created
+		struct uring_stats {
+			uint64_t nEnters = 0;			// io_uring_enter calls
+			uint64_t nSubmitted = 0;		// requests handed to the kernel
+			uint64_t nCompletions = 0;
+			uint64_t nWakeups = 0;			// times asio woke us up for completions
+		};
+
+#if OLC_NET_URING
+
+		class uring_loop : public std::enable_shared_from_this<uring_loop> {
+
+			// One socket handed to the loop. Kept alive by the loop until its fd is closed
+			// and the kernel has finished with everything submitted for it.
+			struct socket_state {
+				int fd = -1;
+				std::atomic<bool> bOpen = true;
+				bool bClosed = false;			// loop side, fd shut down
+				uint32_t nInFlight = 0;
+
+				// Received bytes nobody has asked for yet
+				std::vector<uint8_t> vInbox;
+				size_t nInboxPos = 0;
+				bool bRecvArmed = false;
+				bool bRecvCancelling = false;
+				bool bEof = false;
+				std::error_code ecRecv;
+				bool bDelivering = false;		// inside Deliver(), which picks up new reads itself
+
+				uint8_t* pRead = nullptr;
+				size_t nReadWant = 0, nReadDone = 0;
+				byte_transport::handler hRead;
+
+				// Up to two pieces, header and body, sent together
+				const uint8_t* pWrite = nullptr;
+				const uint8_t* pWriteTail = nullptr;
+				size_t nWriteHead = 0;
+				size_t nWriteWant = 0, nWriteDone = 0;
+				byte_transport::handler hWrite;
+				iovec vWriteIov[2] = {};
+				msghdr writeMsg = {};
+
+				size_t InboxSize() const {
+					return vInbox.size() - nInboxPos;
+				}
+			};
+
+			enum : uint64_t { op_recv = 1, op_send = 2, op_cancel = 3, op_mask = 7 };
+
+		public:
+			class transport : public byte_transport {
+
+			public:
+				transport(std::shared_ptr<uring_loop> pLoop, std::shared_ptr<socket_state> pSocket)
+					: m_pLoop(std::move(pLoop)), m_pSocket(std::move(pSocket)) {
+				}
+
+				~transport() override {
+					close();
+				}
+
+				void async_read(void* pData, size_t nBytes, handler h) override {
+					m_pLoop->Read(m_pSocket, static_cast<uint8_t*>(pData), nBytes, std::move(h));
+				}
+
+				void async_write(const void* pData, size_t nBytes, handler h) override {
+					m_pLoop->Write(m_pSocket, static_cast<const uint8_t*>(pData), nBytes, nullptr, 0, std::move(h));
+				}
+
+				void async_write(const void* pHead, size_t nHead, const void* pBody, size_t nBody, handler h) override {
+					m_pLoop->Write(m_pSocket, static_cast<const uint8_t*>(pHead), nHead, static_cast<const uint8_t*>(pBody), nBody, std::move(h));
+				}
+
+				bool is_open() const override {
+					return m_pSocket->bOpen;
+				}
+
+				// Any thread - the actual shutdown happens on the loop's
+				void close() override {
+					if (!m_pSocket->bOpen.exchange(false)) return;
+					asio::post(m_pLoop->m_context, [pLoop = m_pLoop, pSocket = m_pSocket]() { pLoop->Close(pSocket); });
+				}
+
+			private:
+				std::shared_ptr<uring_loop> m_pLoop;
+				std::shared_ptr<socket_state> m_pSocket;
+			};
+
+			// A loop for connections on this context, or nullptr if io_uring can't be used
+			static std::shared_ptr<uring_loop> Create(asio::io_context& context, const uring_options& options = {}) {
+				std::shared_ptr<uring_loop> pLoop(new uring_loop(context, options));
+				if (!pLoop->Setup()) return nullptr;
+				return pLoop;
+			}
+
+			~uring_loop() {
+				Shutdown();
+				if (m_fdRing >= 0) ::close(m_fdRing);
+				if (m_pBufRing) munmap(m_pBufRing, m_nBufRingBytes);
+				if (m_pSqes) munmap(m_pSqes, m_nSqeBytes);
+				if (m_pRing) munmap(m_pRing, m_nRingBytes);
+			}
+
+			// Takes over a connected socket, leaving it closed. nullptr if the loop has been
+			// shut down, in which case the socket is left as it was.
+			std::unique_ptr<byte_transport> Adopt(asio::ip::tcp::socket& socket) {
+				if (m_bShutdown) return nullptr;
+
+				auto pSocket = std::make_shared<socket_state>();
+				asio::error_code ec;
+				pSocket->fd = socket.release(ec);
+				if (ec) {
+					LogWarn("[URING] Could not take over socket: {}", ec.message());
+					return nullptr;
+				}
+
+				// asio may have left it non-blocking, which would hand us EAGAIN instead of
+				// letting the kernel wait for data
+				int nFlags = fcntl(pSocket->fd, F_GETFL);
+				if (nFlags >= 0) fcntl(pSocket->fd, F_SETFL, nFlags & ~O_NONBLOCK);
+
+				m_mapSockets[pSocket.get()] = pSocket;
+				ArmEvent();
+				return std::make_unique<transport>(shared_from_this(), pSocket);
+			}
+
+			// Cancels everything, closes every socket and lets go of the io_context. Call it
+			// once the context has stopped running, before the context is destroyed.
+			void Shutdown() {
+				if (m_bShutdown) return;
+				m_bShutdown = true;
+
+				for (auto& [p, pSocket] : m_mapSockets) ::shutdown(pSocket->fd, SHUT_RDWR);
+
+				// Wait for the kernel to let go of our buffers before they are freed
+				Submit();
+				auto tpGiveUp = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+				while (m_nInFlight > 0 && std::chrono::steady_clock::now() < tpGiveUp) {
+					Reap(false);
+					if (m_nInFlight > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+
+				// Nothing will complete what is still waiting, and a handler may be all that
+				// keeps its connection alive - let go of them once we are done with the map
+				std::vector<byte_transport::handler> vAbandoned;
+				for (auto& [p, pSocket] : m_mapSockets) {
+					::close(pSocket->fd);
+					vAbandoned.push_back(std::move(pSocket->hRead));
+					vAbandoned.push_back(std::move(pSocket->hWrite));
+					pSocket->hRead = nullptr;
+					pSocket->hWrite = nullptr;
+				}
+				m_mapSockets.clear();
+				m_pEvent.reset();
+			}
+
+			uring_stats Stats() const {
+				uring_stats s;
+				s.nEnters = m_nEnters.load(std::memory_order_relaxed);
+				s.nSubmitted = m_nSubmitted.load(std::memory_order_relaxed);
+				s.nCompletions = m_nCompletions.load(std::memory_order_relaxed);
+				s.nWakeups = m_nWakeups.load(std::memory_order_relaxed);
+				return s;
+			}
+
+		private:
+			uring_loop(asio::io_context& context, const uring_options& options)
+				: m_context(context), m_options(options) {
+			}
+
+			bool Setup() {
+				io_uring_params params{};
+				params.flags = IORING_SETUP_CQSIZE;
+				params.cq_entries = m_options.nEntries * 4;
+				m_fdRing = int(syscall(__NR_io_uring_setup, m_options.nEntries, &params));
+				if (m_fdRing < 0) return SetupFailed("io_uring_setup");
+				if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+					errno = ENOTSUP;
+					return SetupFailed("feature check");
+				}
+
+				// Submission and completion rings share one mapping, the entries are another
+				m_nRingBytes = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+					params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+				void* pRing = mmap(nullptr, m_nRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fdRing, IORING_OFF_SQ_RING);
+				if (pRing == MAP_FAILED) return SetupFailed("mmap rings");
+				m_pRing = static_cast<uint8_t*>(pRing);
+
+				m_nSqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+				void* pSqes = mmap(nullptr, m_nSqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fdRing, IORING_OFF_SQES);
+				if (pSqes == MAP_FAILED) return SetupFailed("mmap sqes");
+				m_pSqes = static_cast<io_uring_sqe*>(pSqes);
+
+				m_pSqHead = reinterpret_cast<uint32_t*>(m_pRing + params.sq_off.head);
+				m_pSqTail = reinterpret_cast<uint32_t*>(m_pRing + params.sq_off.tail);
+				m_pSqArray = reinterpret_cast<uint32_t*>(m_pRing + params.sq_off.array);
+				m_nSqMask = *reinterpret_cast<uint32_t*>(m_pRing + params.sq_off.ring_mask);
+				m_nSqEntries = params.sq_entries;
+				m_nSqTail = *m_pSqTail;
+				m_pCqHead = reinterpret_cast<uint32_t*>(m_pRing + params.cq_off.head);
+				m_pCqTail = reinterpret_cast<uint32_t*>(m_pRing + params.cq_off.tail);
+				m_nCqMask = *reinterpret_cast<uint32_t*>(m_pRing + params.cq_off.ring_mask);
+				m_pCqes = reinterpret_cast<io_uring_cqe*>(m_pRing + params.cq_off.cqes);
+
+				// The receive buffers, registered once as a ring the kernel takes them from
+				uint32_t nBuffers = m_options.nBuffers;
+				if (nBuffers == 0 || (nBuffers & (nBuffers - 1)) != 0 || nBuffers > 32768) return SetupFailed("nBuffers must be a power of 2");
+				m_vBuffers.resize(size_t(nBuffers) * m_options.nBufferBytes);
+				m_nBufRingBytes = nBuffers * sizeof(io_uring_buf);
+				void* pBufRing = mmap(nullptr, m_nBufRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (pBufRing == MAP_FAILED) return SetupFailed("mmap buffer ring");
+				m_pBufRing = static_cast<io_uring_buf*>(pBufRing);
+
+				io_uring_buf_reg reg{};
+				reg.ring_addr = reinterpret_cast<uint64_t>(m_pBufRing);
+				reg.ring_entries = nBuffers;
+				reg.bgid = 0;
+				if (syscall(__NR_io_uring_register, m_fdRing, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return SetupFailed("register buffer ring");
+				for (uint32_t i = 0; i < nBuffers; i++) RecycleBuffer(uint16_t(i));
+				PublishBuffers();
+
+				// Completions bump this, which is what asio waits on
+				int fdEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				if (fdEvent < 0) return SetupFailed("eventfd");
+				m_pEvent = std::make_unique<asio::posix::stream_descriptor>(m_context, fdEvent);
+				if (syscall(__NR_io_uring_register, m_fdRing, IORING_REGISTER_EVENTFD, &fdEvent, 1) < 0) return SetupFailed("register eventfd");
+
+				LogInfo("[URING] Ring of {} entries, {} x {} byte receive buffers", params.sq_entries, nBuffers, m_options.nBufferBytes);
+				return true;
+			}
+
+			bool SetupFailed(const char* sWhat) {
+				LogWarn("[URING] {} failed, staying on asio: {}", sWhat, std::strerror(errno));
+				m_bShutdown = true;
+				return false;
+			}
+
+			int Enter(uint32_t nSubmit, uint32_t nWait, uint32_t nFlags) {
+				m_nEnters.fetch_add(1, std::memory_order_relaxed);
+				return int(syscall(__NR_io_uring_enter, m_fdRing, nSubmit, nWait, nFlags, nullptr, 0));
+			}
+
+			// A blank submission entry, or nullptr if even submitting didn't make room
+			io_uring_sqe* NextSqe() {
+				if (m_nSqTail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) == m_nSqEntries) {
+					Submit();
+					if (m_nSqTail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) == m_nSqEntries) return nullptr;
+				}
+				uint32_t nIndex = m_nSqTail & m_nSqMask;
+				io_uring_sqe* pSqe = &m_pSqes[nIndex];
+				std::memset(pSqe, 0, sizeof(io_uring_sqe));
+				m_pSqArray[nIndex] = nIndex;
+				m_nSqTail++;
+				m_nInFlight++;
+				return pSqe;
+			}
+
+			// Hands everything queued so far to the kernel in one go
+			void Submit() {
+				if (m_fdRing < 0) return;
+				__atomic_store_n(m_pSqTail, m_nSqTail, __ATOMIC_RELEASE);
+				uint32_t nPending = m_nSqTail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+				if (nPending == 0) return;
+
+				int n = Enter(nPending, 0, 0);
+				if (n > 0) m_nSubmitted.fetch_add(uint64_t(n), std::memory_order_relaxed);
+				else if (n < 0 && errno != EAGAIN && errno != EBUSY && errno != EINTR) {
+					LogError("[URING] Submit failed: {}", std::strerror(errno));
+				}
+			}
+
+			// Writes queued by one batch of handlers go out together once asio gets round
+			// to this, rather than one syscall each
+			void RequestSubmit() {
+				if (m_bSubmitPosted) return;
+				m_bSubmitPosted = true;
+				asio::post(m_context, [wpLoop = weak_from_this()]() {
+					if (auto pLoop = wpLoop.lock()) {
+						pLoop->m_bSubmitPosted = false;
+						pLoop->Submit();
+					}
+				});
+			}
+
+			void ArmEvent() {
+				if (m_bEventArmed || !m_pEvent) return;
+				m_bEventArmed = true;
+				m_pEvent->async_read_some(asio::buffer(&m_nEventCount, sizeof(m_nEventCount)),
+					[this](std::error_code ec, std::size_t length) {
+						if (ec == asio::error::operation_aborted) return;
+						m_bEventArmed = false;
+						m_nWakeups.fetch_add(1, std::memory_order_relaxed);
+						Reap(true);
+						Submit();
+
+						// Nothing left to wait for lets the io_context run out of work
+						if (!m_mapSockets.empty()) ArmEvent();
+					});
+			}
+
+			void Reap(bool bDispatch) {
+				uint32_t nHead = *m_pCqHead;
+				for (;;) {
+					uint32_t nTail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+					if (nHead == nTail) break;
+
+					while (nHead != nTail) {
+						io_uring_cqe cqe = m_pCqes[nHead & m_nCqMask];
+						nHead++;
+						__atomic_store_n(m_pCqHead, nHead, __ATOMIC_RELEASE);
+						m_nCompletions.fetch_add(1, std::memory_order_relaxed);
+						if (!(cqe.flags & IORING_CQE_F_MORE)) m_nInFlight--;
+
+						if (cqe.flags & IORING_CQE_F_BUFFER) {
+							uint16_t nBuffer = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+							if (bDispatch && cqe.res > 0) Receive(cqe, BufferData(nBuffer));
+							RecycleBuffer(nBuffer);
+						}
+						if (bDispatch) Complete(cqe);
+					}
+				}
+				PublishBuffers();
+			}
+
+			void Complete(const io_uring_cqe& cqe) {
+				auto pSocket = reinterpret_cast<socket_state*>(cqe.user_data & ~uint64_t(op_mask));
+				auto it = m_mapSockets.find(pSocket);
+				if (it == m_mapSockets.end()) return;
+				auto s = it->second;
+
+				switch (cqe.user_data & op_mask) {
+				case op_recv:
+					if (!(cqe.flags & IORING_CQE_F_MORE)) {
+						s->nInFlight--;
+						s->bRecvArmed = false;
+					}
+					if (cqe.res == 0) {
+						s->bEof = true;
+					}
+					else if (cqe.res < 0) {
+						if (cqe.res == -EINVAL && m_bMultishot) {
+							// Kernel older than 6.0 - one receive per completion then
+							LogInfo("[URING] No multishot receive, falling back to single shot");
+							m_bMultishot = false;
+						}
+						else if (cqe.res == -ECANCELED && s->bRecvCancelling) {
+							s->bRecvCancelling = false;
+						}
+						else if (cqe.res != -ENOBUFS) {
+							s->ecRecv = std::error_code(-cqe.res, std::system_category());
+						}
+					}
+					Deliver(s);
+					break;
+
+				case op_send:
+					s->nInFlight--;
+					if (s->bClosed) break;
+					if (cqe.res < 0) {
+						FinishWrite(s, std::error_code(-cqe.res, std::system_category()));
+					}
+					else {
+						s->nWriteDone += size_t(cqe.res);
+						if (s->nWriteDone < s->nWriteWant) QueueSend(s);
+						else FinishWrite(s, {});
+					}
+					break;
+
+				case op_cancel:
+					s->nInFlight--;
+					break;
+				}
+
+				Rearm(s);
+				Release(s);
+			}
+
+			// Bytes that came in for a socket go straight into its pending read if there is
+			// one, otherwise into its inbox
+			void Receive(const io_uring_cqe& cqe, const uint8_t* pData) {
+				auto it = m_mapSockets.find(reinterpret_cast<socket_state*>(cqe.user_data & ~uint64_t(op_mask)));
+				if (it == m_mapSockets.end() || it->second->bClosed) return;
+				socket_state& s = *it->second;
+
+				size_t nBytes = size_t(cqe.res);
+				if (s.hRead && s.InboxSize() == 0) {
+					size_t n = std::min(nBytes, s.nReadWant - s.nReadDone);
+					std::memcpy(s.pRead + s.nReadDone, pData, n);
+					s.nReadDone += n;
+					pData += n;
+					nBytes -= n;
+				}
+				if (nBytes > 0) {
+					if (s.nInboxPos > 0 && s.nInboxPos == s.vInbox.size()) {
+						s.vInbox.clear();
+						s.nInboxPos = 0;
+					}
+					s.vInbox.insert(s.vInbox.end(), pData, pData + nBytes);
+				}
+			}
+
+			// Completes the pending read, over and over while its handler asks for more that
+			// is already here
+			void Deliver(const std::shared_ptr<socket_state>& s) {
+				if (s->bDelivering) return;
+				s->bDelivering = true;
+				while (s->hRead && !s->bClosed) {
+					size_t n = std::min(s->InboxSize(), s->nReadWant - s->nReadDone);
+					std::memcpy(s->pRead + s->nReadDone, s->vInbox.data() + s->nInboxPos, n);
+					s->nReadDone += n;
+					s->nInboxPos += n;
+					if (s->nInboxPos == s->vInbox.size()) {
+						s->vInbox.clear();
+						s->nInboxPos = 0;
+					}
+
+					std::error_code ec;
+					if (s->nReadDone < s->nReadWant) {
+						if (s->bEof) ec = asio::error::eof;
+						else if (s->ecRecv) ec = s->ecRecv;
+						else break;
+					}
+
+					auto h = std::move(s->hRead);
+					s->hRead = nullptr;
+					h(ec, s->nReadDone);
+				}
+				s->bDelivering = false;
+			}
+
+			void FinishWrite(const std::shared_ptr<socket_state>& s, std::error_code ec) {
+				auto h = std::move(s->hWrite);
+				s->hWrite = nullptr;
+				h(ec, s->nWriteDone);
+			}
+
+			// Keeps a receive armed unless the reader has fallen behind, in which case the
+			// armed one is cancelled until the inbox drains - TCP flow control does the rest
+			void Rearm(const std::shared_ptr<socket_state>& s) {
+				if (s->bClosed || s->bEof || s->ecRecv) return;
+
+				if (s->InboxSize() > m_options.nInboxLimit) {
+					if (s->bRecvArmed && !s->bRecvCancelling && m_bMultishot) {
+						io_uring_sqe* pSqe = NextSqe();
+						if (!pSqe) return;
+						pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+						pSqe->addr = reinterpret_cast<uint64_t>(s.get()) | op_recv;
+						pSqe->user_data = reinterpret_cast<uint64_t>(s.get()) | op_cancel;
+						s->nInFlight++;
+						s->bRecvCancelling = true;
+						RequestSubmit();
+					}
+					return;
+				}
+
+				if (s->bRecvArmed) return;
+				io_uring_sqe* pSqe = NextSqe();
+				if (!pSqe) return;
+				pSqe->opcode = IORING_OP_RECV;
+				pSqe->fd = s->fd;
+				pSqe->flags = IOSQE_BUFFER_SELECT;
+				pSqe->buf_group = 0;
+				pSqe->ioprio = m_bMultishot ? IORING_RECV_MULTISHOT : 0;
+				pSqe->user_data = reinterpret_cast<uint64_t>(s.get()) | op_recv;
+				s->nInFlight++;
+				s->bRecvArmed = true;
+				RequestSubmit();
+			}
+
+			void QueueSend(const std::shared_ptr<socket_state>& s) {
+				io_uring_sqe* pSqe = NextSqe();
+				if (!pSqe) {
+					asio::post(m_context, [this, s]() { if (s->hWrite) FinishWrite(s, asio::error::no_buffer_space); });
+					return;
+				}
+				pSqe->fd = s->fd;
+				pSqe->msg_flags = MSG_NOSIGNAL;
+				if (s->nWriteDone < s->nWriteHead && s->nWriteWant > s->nWriteHead) {
+					// Still some header to go - both pieces in one sendmsg
+					s->vWriteIov[0] = { const_cast<uint8_t*>(s->pWrite + s->nWriteDone), s->nWriteHead - s->nWriteDone };
+					s->vWriteIov[1] = { const_cast<uint8_t*>(s->pWriteTail), s->nWriteWant - s->nWriteHead };
+					s->writeMsg = {};
+					s->writeMsg.msg_iov = s->vWriteIov;
+					s->writeMsg.msg_iovlen = 2;
+					pSqe->opcode = IORING_OP_SENDMSG;
+					pSqe->addr = reinterpret_cast<uint64_t>(&s->writeMsg);
+					pSqe->len = 1;
+				}
+				else {
+					const uint8_t* p = s->nWriteDone < s->nWriteHead ? s->pWrite + s->nWriteDone : s->pWriteTail + (s->nWriteDone - s->nWriteHead);
+					pSqe->opcode = IORING_OP_SEND;
+					pSqe->addr = reinterpret_cast<uint64_t>(p);
+					pSqe->len = uint32_t(std::min<size_t>(s->nWriteWant - s->nWriteDone, 0x7FFFFFFF));
+				}
+				pSqe->user_data = reinterpret_cast<uint64_t>(s.get()) | op_send;
+				s->nInFlight++;
+				RequestSubmit();
+			}
+
+			void Read(const std::shared_ptr<socket_state>& s, uint8_t* pData, size_t nBytes, byte_transport::handler h) {
+				if (s->bClosed || m_bShutdown) {
+					asio::post(m_context, [h = std::move(h)]() { h(asio::error::operation_aborted, 0); });
+					return;
+				}
+
+				s->pRead = pData;
+				s->nReadWant = nBytes;
+				s->nReadDone = 0;
+				s->hRead = std::move(h);
+
+				// Never complete from in here, asio doesn't either
+				if (s->bDelivering) {
+					return;
+				}
+				else if (s->InboxSize() > 0 || s->bEof || s->ecRecv) {
+					asio::post(m_context, [this, wpLoop = weak_from_this(), s]() {
+						if (wpLoop.expired()) return;
+						Deliver(s);
+						Rearm(s);
+					});
+				}
+				else {
+					Rearm(s);
+				}
+			}
+
+			void Write(const std::shared_ptr<socket_state>& s, const uint8_t* pHead, size_t nHead, const uint8_t* pTail, size_t nTail, byte_transport::handler h) {
+				if (s->bClosed || m_bShutdown) {
+					asio::post(m_context, [h = std::move(h)]() { h(asio::error::broken_pipe, 0); });
+					return;
+				}
+
+				s->pWrite = pHead;
+				s->pWriteTail = pTail;
+				s->nWriteHead = nHead;
+				s->nWriteWant = nHead + nTail;
+				s->nWriteDone = 0;
+				s->hWrite = std::move(h);
+				QueueSend(s);
+			}
+
+			// Shutting the socket down ends whatever the kernel has armed for it, the fd
+			// itself is closed once those have all come back
+			void Close(const std::shared_ptr<socket_state>& s) {
+				if (s->bClosed || m_bShutdown) return;
+				s->bClosed = true;
+				s->bOpen = false;
+				::shutdown(s->fd, SHUT_RDWR);
+
+				if (s->hRead) {
+					asio::post(m_context, [h = std::move(s->hRead)]() { h(asio::error::operation_aborted, 0); });
+					s->hRead = nullptr;
+				}
+				if (s->hWrite) {
+					asio::post(m_context, [h = std::move(s->hWrite)]() { h(asio::error::operation_aborted, 0); });
+					s->hWrite = nullptr;
+				}
+				s->vInbox.clear();
+				s->nInboxPos = 0;
+				Release(s);
+			}
+
+			void Release(const std::shared_ptr<socket_state>& s) {
+				if (!s->bClosed || s->nInFlight > 0) return;
+				::close(s->fd);
+				m_mapSockets.erase(s.get());
+				if (m_mapSockets.empty() && m_pEvent) {
+					// Let run() return once nothing is connected, as it would over asio
+					m_pEvent->cancel();
+					m_bEventArmed = false;
+				}
+			}
+
+			uint8_t* BufferData(uint16_t nBuffer) {
+				return m_vBuffers.data() + size_t(nBuffer) * m_options.nBufferBytes;
+			}
+
+			void RecycleBuffer(uint16_t nBuffer) {
+				io_uring_buf& b = m_pBufRing[m_nBufTail & (m_options.nBuffers - 1)];
+				b.addr = reinterpret_cast<uint64_t>(BufferData(nBuffer));
+				b.len = m_options.nBufferBytes;
+				b.bid = nBuffer;
+				m_nBufTail++;
+			}
+
+			// The tail sits where the first entry's resv would be. Not through
+			// io_uring_buf_ring, whose flexible array lands 8 bytes late in C++.
+			void PublishBuffers() {
+				__atomic_store_n(&m_pBufRing[0].resv, m_nBufTail, __ATOMIC_RELEASE);
+			}
+
+		private:
+			asio::io_context& m_context;
+			uring_options m_options;
+			bool m_bShutdown = false;
+			bool m_bMultishot = true;
+
+			int m_fdRing = -1;
+			uint8_t* m_pRing = nullptr;
+			size_t m_nRingBytes = 0;
+			io_uring_sqe* m_pSqes = nullptr;
+			size_t m_nSqeBytes = 0;
+
+			uint32_t* m_pSqHead = nullptr;
+			uint32_t* m_pSqTail = nullptr;
+			uint32_t* m_pSqArray = nullptr;
+			uint32_t m_nSqMask = 0;
+			uint32_t m_nSqEntries = 0;
+			uint32_t m_nSqTail = 0;			// ours, published to the kernel by Submit()
+			uint32_t* m_pCqHead = nullptr;
+			uint32_t* m_pCqTail = nullptr;
+			uint32_t m_nCqMask = 0;
+			io_uring_cqe* m_pCqes = nullptr;
+			uint32_t m_nInFlight = 0;		// requests the kernel hasn't finished with
+			bool m_bSubmitPosted = false;
+
+			std::vector<uint8_t> m_vBuffers;
+			io_uring_buf* m_pBufRing = nullptr;		// laid out as io_uring_buf_ring
+			size_t m_nBufRingBytes = 0;
+			uint16_t m_nBufTail = 0;
+
+			std::unique_ptr<asio::posix::stream_descriptor> m_pEvent;
+			uint64_t m_nEventCount = 0;
+			bool m_bEventArmed = false;
+
+			std::unordered_map<socket_state*, std::shared_ptr<socket_state>> m_mapSockets;
+
+			std::atomic<uint64_t> m_nEnters = 0;
+			std::atomic<uint64_t> m_nSubmitted = 0;
+			std::atomic<uint64_t> m_nCompletions = 0;
+			std::atomic<uint64_t> m_nWakeups = 0;
+		};
+
+#else
+
+		// Built without io_uring - asking for it leaves everything on asio
+		class uring_loop {
+
+		public:
+			static std::shared_ptr<uring_loop> Create(asio::io_context& context, const uring_options& options = {}) {
+				LogWarn("[URING] Not built in, staying on asio");
+				return nullptr;
+			}
+
+			std::unique_ptr<byte_transport> Adopt(asio::ip::tcp::socket& socket) {
+				return nullptr;
+			}
+
+			void Shutdown() {
+			}
+
+			uring_stats Stats() const {
+				return {};
+			}
+		};
+
+#endif
+
+	}
+
+}
@@ -0,0 +1,88 @@
+#include <iostream>
+#include <string>
+#include <olc_net.h>
+#include <net_replay.h>
+
+/*
+	Plays a traffic log captured with server_interface::StartRecording() back into
+	a server, so handler changes can be benchmarked against real sessions.
+
+		NetReplay <log> [speed]
+
+	speed 1 is real time, 10 is ten times faster, 0 is as fast as possible.
+
+	The server below mirrors SimpleServer - swap in your own server class (it only
+	needs to be a server_interface subclass) to replay into your real handlers.
+*/
+
+enum class CustomMsgTypes : uint32_t {
+
+	ServerAccept,
+	ServerDeny,
+	ServerPing,
+	MessageAll,
+	ServerMessage
+
+};
+
+class ReplayServer : public olc::net::server_interface<CustomMsgTypes> {
+
+public:
+	// Never Start()ed, so the port is only bound, not listened on
+	ReplayServer() : olc::net::server_interface<CustomMsgTypes>(0) {
+
+	}
+
+protected:
+	virtual bool OnClientConnect(std::shared_ptr<olc::net::connection<CustomMsgTypes>> client) {
+		return true;
+	}
+
+	virtual void OnClientDisconnect(std::shared_ptr<olc::net::connection<CustomMsgTypes>> client) {
+
+	}
+
+	virtual void OnMessage(std::shared_ptr<olc::net::connection<CustomMsgTypes>> client, olc::net::message<CustomMsgTypes>& msg) {
+		switch (msg.header.id) {
+			case CustomMsgTypes::ServerPing: {
+				// Bounce the message back
+				client->Send(msg);
+			}
+			break;
+
+			case CustomMsgTypes::MessageAll: {
+				olc::net::message<CustomMsgTypes> msgOut;
+				msgOut.header.id = CustomMsgTypes::ServerMessage;
+				msgOut << client->GetID();
+				MessageAllClients(msgOut, client);
+			}
+			break;
+		}
+	}
+
+};
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cout << "Usage: NetReplay <log> [speed]\n";
+		return 1;
+	}
+
+	double dSpeed = argc > 2 ? std::stod(argv[2]) : 1.0;
+
+	ReplayServer server;
+	olc::net::traffic_replayer<CustomMsgTypes> replayer(server);
+
+	if (!replayer.Open(argv[1])) {
+		std::cout << "Could not open " << argv[1] << "\n";
+		return 1;
+	}
+
+	auto res = replayer.Run(dSpeed);
+
+	std::cout << "Replayed " << res.nMessages << " messages (" << res.nBytes << " bytes) from "
+		<< res.nConnections << " connections in " << res.dSeconds << "s - "
+		<< (res.dSeconds > 0.0 ? double(res.nMessages) / res.dSeconds : 0.0) << " msg/s\n";
+
+	return 0;
+}
@@ -95,6 +95,10 @@ int main() {
 					std::chrono::system_clock::time_point timeThen;
 					msg >> timeThen;
 					std::cout << "Ping: " << std::chrono::duration<double>(timeNow - timeThen).count() << "\n";
+
+					// The connection measures this itself, without the server's Update() loop in the way
+					std::cout << "RTT: " << std::chrono::duration<double>(c.RoundTripTime()).count()
+						<< " Jitter: " << std::chrono::duration<double>(c.Jitter()).count() << "\n";
 				}
 				break;
 